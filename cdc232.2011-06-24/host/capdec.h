@@ -0,0 +1,112 @@
+/* Name: capdec.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Decoder of the records of the capture mode (CAPTURE_MODE, see vendor.h
+    and mega48/capture.h), shared by cdccap and cdcmodel. It keeps the time
+    in 1/256 ticks with the same arithmetic as the firmware, so the times
+    of bytes in a run do not drift. A record may continue in the next call.
+*/
+
+#ifndef __capdec_h_included__
+#define __capdec_h_included__
+
+#include <stdint.h>
+#include <string.h>
+#include "../mega48/vendor.h"
+
+typedef struct capEvent {
+    uint64_t    time;           /* ticks times 256 since the first start */
+    uint8_t     data, flags;    /* CAP_* without CAP_DELTA */
+} capEvent_t;
+
+enum { CAPDEC_CODE, CAPDEC_START, CAPDEC_DELTA, CAPDEC_DATA };
+
+typedef struct capDecoder {
+    uint32_t    hz;             /* ticks per second, 0 before the start */
+    uint32_t    chr;            /* ticks per character times 256 */
+    uint64_t    time;           /* of the last byte */
+    uint64_t    delta;
+    int         state, left, shift, step;
+    uint8_t     flags, start[8];
+    unsigned long   bad;        /* bytes that are no record */
+} capDecoder_t;
+
+static void capDecInit(capDecoder_t *d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+/* Decodes n bytes of records into out, which needs room for n events.
+ * Returns the number of events.
+ */
+static long capDecode(capDecoder_t *d, const uint8_t *in, long n, capEvent_t *out)
+{
+long    i, o = 0;
+uint8_t b;
+
+    for(i = 0; i < n; i++){
+        b = in[i];
+        switch(d->state){
+        case CAPDEC_CODE:
+            d->step = 1;
+            d->flags = 0;
+            if(b == CAP_START){
+                d->state = CAPDEC_START;
+                d->left = 8;
+            }else if(d->hz == 0 || b > CAP_START){
+                d->bad++;
+            }else if(b < CAP_RUN_DELTA){
+                d->left = (b & (CAP_MAX_RUN - 1)) + 1;
+                d->state = CAPDEC_DATA;
+            }else if(b < CAP_FLAGGED){
+                d->left = (b & (CAP_MAX_RUN - 1)) + 1;
+                d->state = CAPDEC_DELTA;
+            }else{
+                d->left = 1;
+                d->flags = b & 0x1f;
+                d->state = b & CAP_DELTA ? CAPDEC_DELTA : CAPDEC_DATA;
+            }
+            if(d->state == CAPDEC_DELTA){
+                d->delta = 0;
+                d->shift = 0;
+            }
+            break;
+        case CAPDEC_START:
+            d->start[8 - d->left] = b;
+            if(--d->left == 0){
+                d->hz = d->start[0] | d->start[1] << 8 | d->start[2] << 16 | (uint32_t)d->start[3] << 24;
+                d->chr = d->start[4] | d->start[5] << 8 | d->start[6] << 16 | (uint32_t)d->start[7] << 24;
+                d->state = CAPDEC_CODE;
+            }
+            break;
+        case CAPDEC_DELTA:
+            d->delta |= (uint64_t)(b & 0x7f) << d->shift;
+            d->shift += 7;
+            if(!(b & 0x80)){
+                d->time = ((d->time >> 8) + d->delta) << 8;
+                d->step = 0;
+                d->state = CAPDEC_DATA;
+            }
+            break;
+        case CAPDEC_DATA:
+            if(d->step)
+                d->time += d->chr;
+            d->step = 1;
+            out[o].time = d->time;
+            out[o].data = b;
+            out[o++].flags = d->flags;
+            if(--d->left == 0)
+                d->state = CAPDEC_CODE;
+            break;
+        }
+    }
+    return o;
+}
+
+#endif  /*  __capdec_h_included__  */
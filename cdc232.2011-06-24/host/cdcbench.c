@@ -0,0 +1,822 @@
+/* Name: cdcbench.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Throughput and latency test for the CDC-232 on Linux. The device side
+    is a /dev/ttyACM* or the pty of the simulator, the optional peer is
+    whatever is wired to the UART (a USB-serial adapter or the second pty of
+    the simulator). Without a peer, TXD must be wired to RXD or the device
+    must be in loopback (baud rate 1 with BENCH_MODES).
+
+    Every test sends a counting pattern (position mod 251), or the bytes
+    of a log file given with -L, in chunks and records when each chunk was
+    written and when its last byte arrived. The latencies are reported as
+    percentiles.
+
+    -C moves the device side from the tty to control transfers
+    (VENDOR_RQ_DATA, firmware with EP0_DATA). A thread pumps the data
+    between the usbfs node and a socket pair, whose other end takes the
+    place of the tty in the tests, so the results compare with the bulk
+    path of the same test.
+
+    -Z turns on the compressed mode (VENDOR_RQ_COMP, firmware with
+    COMP_MODE) and puts the codec of lzcomp.h between the tty and a socket
+    pair in the same way. With -L and a real log it shows the compression
+    ratio in both directions and, against a run without -Z, the gain.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <endian.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/usbdevice_fs.h>
+#include "../mega48/vendor.h"
+#include "lzcomp.h"
+
+#define PATTERN(pos)    (logLen ? logData[(pos) % logLen] : (unsigned char)((pos) % 251))
+#define IDLE_TIMEOUT    2.0     /* s without data ends a test */
+
+/* termios2 from asm/termbits.h, which cannot be included with termios.h */
+#ifndef BOTHER
+#define BOTHER  0010000
+#endif
+struct termios2 {
+    tcflag_t    c_iflag, c_oflag, c_cflag, c_lflag;
+    cc_t        c_line;
+    cc_t        c_cc[19];
+    speed_t     c_ispeed, c_ospeed;
+};
+
+typedef struct stream {
+    const char      *name;
+    int             wfd, rfd;
+    long            chunk;          /* bytes per chunk */
+    long            count;          /* number of chunks */
+    int             stopAndWait;    /* wait for each chunk before the next */
+    double          gap;            /* s between chunks in stopAndWait */
+    double          *sent;          /* write time of each chunk */
+    double          *lat;           /* latency of each chunk */
+    long            done;           /* chunks completely received */
+    long            rxBytes, errors;
+    int             writerDone;
+    double          tStart, tEnd;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t       wt, rt;
+} stream_t;
+
+typedef struct pump {
+    int             usbFd, fd;
+    volatile int    stop;
+    unsigned long   inTransfers, outTransfers, inBytes, outBytes;
+    double          tStart, tEnd;
+    pthread_t       t;
+} pump_t;
+
+typedef struct tunnel {
+    int             usbFd, ttyFd, fd;
+    volatile int    stop;
+    lzCodec_t       enc, dec;
+    volatile unsigned   syncs;  /* of dec, the encoder follows them */
+    unsigned long   inRaw, inCoded, outRaw, outCoded;
+    pthread_t       rt, wt;
+} tunnel_t;
+
+static int      baud = 9600, dataBits = 8, stopBits = 1;
+static char     parity = 'n';
+static int      verbose;
+static unsigned char    *logData;
+static long     logLen;
+
+/* ------------------------------------------------------------------------- */
+
+static double  now(void)
+{
+struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void die(const char *what)
+{
+    perror(what);
+    exit(1);
+}
+
+static speed_t  speedCode(int b)
+{
+    switch(b){
+    case 50: return B50;        case 75: return B75;
+    case 110: return B110;      case 134: return B134;
+    case 150: return B150;      case 200: return B200;
+    case 300: return B300;      case 600: return B600;
+    case 1200: return B1200;    case 1800: return B1800;
+    case 2400: return B2400;    case 4800: return B4800;
+    case 9600: return B9600;    case 19200: return B19200;
+    case 38400: return B38400;  case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    }
+    return 0;
+}
+
+/* Opens a tty raw with the line coding of the options. A read returns after
+ * 0.1 s without data. Baud rates without a Bxxx constant (e.g. 1 for the
+ * loopback mode) are set with termios2.
+ */
+static int  openTty(const char *path)
+{
+struct termios  t;
+int             fd, bits = TIOCM_DTR | TIOCM_RTS;
+
+    if((fd = open(path, O_RDWR | O_NOCTTY)) < 0)
+        die(path);
+    if(tcgetattr(fd, &t) < 0)
+        die(path);
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS);
+    t.c_cflag |= dataBits == 5 ? CS5 : dataBits == 6 ? CS6 : dataBits == 7 ? CS7 : CS8;
+    if(stopBits == 2)
+        t.c_cflag |= CSTOPB;
+    if(parity != 'n')
+        t.c_cflag |= parity == 'o' ? PARENB | PARODD : PARENB;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 1;
+    if(speedCode(baud))
+        cfsetspeed(&t, speedCode(baud));
+    if(tcsetattr(fd, TCSANOW, &t) < 0)
+        die(path);
+    if(!speedCode(baud)){
+        struct termios2 t2;
+
+        if(ioctl(fd, TCGETS2, &t2) < 0)
+            die("TCGETS2");
+        t2.c_cflag = (t2.c_cflag & ~CBAUD) | BOTHER;
+        t2.c_ispeed = t2.c_ospeed = baud;
+        if(ioctl(fd, TCSETS2, &t2) < 0)
+            die("TCSETS2");
+    }
+    ioctl(fd, TIOCMBIS, &bits);     /* fails on a pty, harmless */
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static void writeAll(int fd, const unsigned char *p, long len)
+{
+ssize_t n;
+
+    while(len > 0){
+        if((n = write(fd, p, len)) < 0){
+            if(errno == EINTR || errno == EAGAIN)
+                continue;
+            die("write");
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/* Drops whatever is still in flight from an earlier run. */
+static void drain(int fd)
+{
+unsigned char   buf[256];
+
+    while(read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+/* ------------------------------------------------------------------------- */
+/* streams                                                                   */
+/* ------------------------------------------------------------------------- */
+
+static void *writer(void *arg)
+{
+stream_t        *s = arg;
+unsigned char   *buf = malloc(s->chunk);
+long            k, i, pos = 0;
+
+    for(k = 0; k < s->count; k++){
+        for(i = 0; i < s->chunk; i++)
+            buf[i] = PATTERN(pos + i);
+        pos += s->chunk;
+        pthread_mutex_lock(&s->lock);
+        if(s->stopAndWait){
+            struct timespec ts;
+            double          limit = now() + IDLE_TIMEOUT;
+
+            while(s->done < k && now() < limit){
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += 10000000;
+                if(ts.tv_nsec >= 1000000000){
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+            }
+            if(s->done < k){    /* lost data, give up */
+                pthread_mutex_unlock(&s->lock);
+                break;
+            }
+        }
+        s->sent[k] = now();
+        if(k == 0)
+            s->tStart = s->sent[0];
+        pthread_mutex_unlock(&s->lock);
+        writeAll(s->wfd, buf, s->chunk);
+        if(s->stopAndWait && s->gap > 0 && k + 1 < s->count){
+            pthread_mutex_lock(&s->lock);
+            while(s->done <= k && !s->tEnd)
+                pthread_cond_wait(&s->cond, &s->lock);
+            pthread_mutex_unlock(&s->lock);
+            usleep(s->gap * 1e6);
+        }
+    }
+    pthread_mutex_lock(&s->lock);
+    s->writerDone = 1;
+    pthread_mutex_unlock(&s->lock);
+    free(buf);
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+stream_t        *s = arg;
+unsigned char   buf[4096];
+long            total = s->chunk * s->count, pos = 0, i;
+double          last = now(), t;
+ssize_t         n;
+
+    while(pos < total){
+        n = read(s->rfd, buf, sizeof(buf));
+        t = now();
+        if(n < 0 && errno != EINTR && errno != EAGAIN)
+            die("read");
+        if(n <= 0){
+            if(t - last > IDLE_TIMEOUT)
+                break;
+            continue;
+        }
+        last = t;
+        pthread_mutex_lock(&s->lock);
+        for(i = 0; i < n && pos < total; i++, pos++){
+            if(buf[i] != PATTERN(pos))
+                s->errors++;
+            if((pos + 1) % s->chunk == 0){
+                s->lat[s->done] = t - s->sent[s->done];
+                s->done++;
+            }
+        }
+        s->rxBytes = pos;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    pthread_mutex_lock(&s->lock);
+    s->tEnd = last;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void streamInit(stream_t *s, const char *name, int wfd, int rfd, long chunk, long count)
+{
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->wfd = wfd;
+    s->rfd = rfd;
+    s->chunk = chunk;
+    s->count = count;
+    s->sent = calloc(count, sizeof(double));
+    s->lat = calloc(count, sizeof(double));
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+}
+
+static void streamStart(stream_t *s)
+{
+    drain(s->rfd);
+    pthread_create(&s->rt, NULL, reader, s);
+    pthread_create(&s->wt, NULL, writer, s);
+}
+
+static void streamJoin(stream_t *s)
+{
+    pthread_join(s->wt, NULL);
+    pthread_join(s->rt, NULL);
+}
+
+static int  cmpDouble(const void *a, const void *b)
+{
+double  x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double   percentile(const double *sorted, long n, double p)
+{
+long    i = (long)(p * n + 0.999999) - 1;
+
+    return sorted[i < 0 ? 0 : i >= n ? n - 1 : i];
+}
+
+static int  streamReport(stream_t *s)
+{
+long    total = s->chunk * s->count;
+double  dt = s->tEnd - s->tStart;
+
+    printf("%-6s %ld/%ld bytes in %.3f s, %.0f B/s, errors %ld, lost %ld\n",
+           s->name, s->rxBytes, total, dt, dt > 0 ? s->rxBytes / dt : 0.0,
+           s->errors, total - s->rxBytes);
+    if(s->done > 0){
+        qsort(s->lat, s->done, sizeof(double), cmpDouble);
+        printf("       latency per %ld byte chunk (%ld): p50 %.2f ms, p99 %.2f ms, p999 %.2f ms, max %.2f ms\n",
+               s->chunk, s->done, percentile(s->lat, s->done, 0.5) * 1e3,
+               percentile(s->lat, s->done, 0.99) * 1e3,
+               percentile(s->lat, s->done, 0.999) * 1e3,
+               s->lat[s->done - 1] * 1e3);
+    }
+    return s->errors || s->rxBytes != total;
+}
+
+/* Peer side of the echo test: returns everything it receives. */
+static void *echoer(void *arg)
+{
+int             fd = *(int *)arg;
+unsigned char   buf[256];
+ssize_t         n;
+
+    for(;;){
+        if((n = read(fd, buf, sizeof(buf))) > 0)
+            writeAll(fd, buf, n);
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* vendor requests                                                           */
+/* ------------------------------------------------------------------------- */
+
+/* Finds the usbfs node of the USB device behind a tty via sysfs. Returns -1
+ * for a pty or a tty that is not on USB.
+ */
+static int  openUsbDevice(int ttyFd)
+{
+struct stat st;
+char        path[PATH_MAX + 32], dir[PATH_MAX], *p;
+int         bus = -1, dev = -1, fd;
+FILE        *f;
+
+    if(fstat(ttyFd, &st) < 0)
+        return -1;
+    snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device", major(st.st_rdev), minor(st.st_rdev));
+    if(!realpath(path, dir))
+        return -1;
+    if((p = strrchr(dir, '/')) == NULL)     /* interface -> device */
+        return -1;
+    *p = 0;
+    snprintf(path, sizeof(path), "%s/busnum", dir);
+    if((f = fopen(path, "r")) != NULL){
+        if(fscanf(f, "%d", &bus) != 1)
+            bus = -1;
+        fclose(f);
+    }
+    snprintf(path, sizeof(path), "%s/devnum", dir);
+    if((f = fopen(path, "r")) != NULL){
+        if(fscanf(f, "%d", &dev) != 1)
+            dev = -1;
+        fclose(f);
+    }
+    if(bus < 0 || dev < 0)
+        return -1;
+    snprintf(path, sizeof(path), "/dev/bus/usb/%03d/%03d", bus, dev);
+    if((fd = open(path, O_RDWR)) < 0 && verbose)
+        perror(path);
+    return fd;
+}
+
+static int  vendorRequest(int usbFd, int in, int request, int value, void *data, int len)
+{
+struct usbdevfs_ctrltransfer    c;
+
+    c.bRequestType = in ? 0xc0 : 0x40;
+    c.bRequest = request;
+    c.wValue = value;
+    c.wIndex = 0;
+    c.wLength = len;
+    c.timeout = 1000;
+    c.data = data;
+    return ioctl(usbFd, USBDEVFS_CONTROL, &c);
+}
+
+/* Clears the device counters. The bench request also selects the mode, so
+ * the current mode is read and written back.
+ */
+static void vendorClear(int usbFd)
+{
+vendorBench_t   b;
+
+    vendorRequest(usbFd, 0, VENDOR_RQ_LATENCY, 0, NULL, 0);
+    vendorRequest(usbFd, 0, VENDOR_RQ_PERF, 0, NULL, 0);
+    if(vendorRequest(usbFd, 1, VENDOR_RQ_BENCH, 0, &b, sizeof(b)) == sizeof(b))
+        vendorRequest(usbFd, 0, VENDOR_RQ_BENCH, b.mode | b.order << 8, NULL, 0);
+}
+
+static double   ticksToUs(unsigned ticks, int shift, unsigned cpuKHz)
+{
+    return cpuKHz ? (double)ticks * (1 << shift) * 1000 / cpuKHz : 0;
+}
+
+static void vendorReport(int usbFd)
+{
+vendorLatency_t l;
+vendorPerf_t    p;
+vendorBench_t   b;
+vendorRs485_t   r;
+vendorMpcm_t    m;
+int             i;
+
+    if(vendorRequest(usbFd, 1, VENDOR_RQ_PERF, 0, &p, sizeof(p)) == sizeof(p)){
+        int s = p.tickShift, k = le16toh(p.cpuKHz);
+
+        printf("device perf: %u loops/s, max loop %.0f us, usbPoll %.0f us, uartPoll %.0f us\n",
+               le32toh(p.loopsPerSec), ticksToUs(le16toh(p.maxLoop), s, k),
+               ticksToUs(le16toh(p.maxUsbPoll), s, k), ticksToUs(le16toh(p.maxUartPoll), s, k));
+        printf("       peak rx_buf %u, tx_buf %u, IN %u, OUT %u packets\n",
+               p.rxPeak, p.txPeak, le32toh(p.inPackets), le32toh(p.outPackets));
+        printf("       OUT NAKed %u times for %.1f ms, dropped: framing %u, parity %u, overrun %u, break %u, tx %u\n",
+               le16toh(p.disabledCount), ticksToUs(le32toh(p.disabledTicks), s, k) / 1000,
+               le16toh(p.rxFraming), le16toh(p.rxParity), le16toh(p.rxOverrun),
+               le16toh(p.rxBreak), le16toh(p.txDropped));
+        printf("       USB packets dropped: CRC %u, duplicates %u\n",
+               le16toh(p.usbCrcErrors), le16toh(p.usbDuplicates));
+    }
+    if(vendorRequest(usbFd, 1, VENDOR_RQ_LATENCY, 0, &l, sizeof(l)) == sizeof(l)){
+        int s = l.tickShift, k = le16toh(l.cpuKHz);
+
+        printf("device latency histogram (bytes, < us)\n");
+        for(i = 0; i < VENDOR_LAT_BUCKETS; i++){
+            if(l.rx[i] || l.tx[i])
+                printf("       %s%8.0f  rx %5u  tx %5u\n", i == VENDOR_LAT_BUCKETS - 1 ? ">=" : "  ",
+                       ticksToUs(i == VENDOR_LAT_BUCKETS - 1 ? 1u << (i - 1) : 1u << i, s, k),
+                       le16toh(l.rx[i]), le16toh(l.tx[i]));
+        }
+    }
+    if(vendorRequest(usbFd, 1, VENDOR_RQ_BENCH, 0, &b, sizeof(b)) == sizeof(b)){
+        printf("device bench: mode %u, OUT %u bytes in %u packets, IN %u bytes, dropped %u\n",
+               b.mode, le32toh(b.outBytes), le32toh(b.outPackets), le32toh(b.inBytes), le32toh(b.dropped));
+        if(b.mode >= BENCH_PRBS_IN)
+            printf("       PRBS-%u %s, uart %u, checked %u bytes, %u bit errors, %u resyncs\n",
+                   b.order, b.synced ? "synced" : "not synced", le32toh(b.uartBytes),
+                   le32toh(b.checkedBytes), le32toh(b.errorBits), le32toh(b.resyncs));
+    }
+    if(vendorRequest(usbFd, 1, VENDOR_RQ_RS485, 0, &r, sizeof(r)) == sizeof(r)){
+        printf("device RS-485: %u turnarounds, hold %u, released up to %u ticks late (8 clocks)\n",
+               le16toh(r.turnarounds), r.hold, r.lateMax);
+        if(r.flags & RS485_ECHO)
+            printf("       %u echoes dropped, %u collisions\n",
+                   le16toh(r.echoes), le16toh(r.collisions));
+    }
+    if(vendorRequest(usbFd, 1, VENDOR_RQ_MPCM, 0, &m, sizeof(m)) == sizeof(m) && (m.flags & MPCM_NINE_BITS)){
+        printf("device 9 bit mode: %u addresses received", le16toh(m.addresses));
+        if(m.flags & MPCM_FILTER)
+            printf(", %u for 0x%02x%s, %u data frames dropped", le16toh(m.matched), m.address,
+                   m.flags & MPCM_ADDR2 ? " or the second address" : "", le16toh(m.dropped));
+        printf("\n");
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* data on control transfers                                                 */
+/* ------------------------------------------------------------------------- */
+
+/* Every round reads the room and the received bytes, then sends what the
+ * room allows. The device NAKs nothing here, so an idle round sleeps 1 ms.
+ */
+static void *pumpThread(void *arg)
+{
+pump_t          *p = arg;
+unsigned char   in[254], out[254];
+int             n, m;
+
+    while(!p->stop){
+        if((n = vendorRequest(p->usbFd, 1, VENDOR_RQ_DATA, 0, in, sizeof(in))) < 1)
+            die("VENDOR_RQ_DATA IN");
+        p->inTransfers++;
+        p->inBytes += n - 1;
+        if(n > 1)
+            writeAll(p->fd, in + 1, n - 1);
+        m = 0;
+        if(in[0] > 0 && (m = recv(p->fd, out, in[0], MSG_DONTWAIT)) > 0){
+            if(vendorRequest(p->usbFd, 0, VENDOR_RQ_DATA, 0, out, m) != m)
+                die("VENDOR_RQ_DATA OUT");
+            p->outTransfers++;
+            p->outBytes += m;
+        }
+        if(n == 1 && m <= 0)
+            usleep(1000);
+    }
+    return NULL;
+}
+
+/* Turns the mode on and returns the end of the socket pair for the tests,
+ * a read on it returns after 0.1 s without data like on the tty.
+ */
+static int  pumpStart(pump_t *p, int usbFd)
+{
+int             sv[2];
+struct timeval  tv = { 0, 100000 };
+unsigned char   room;
+
+    if(vendorRequest(usbFd, 0, VENDOR_RQ_DATA, 1, NULL, 0) < 0
+            || vendorRequest(usbFd, 1, VENDOR_RQ_DATA, 0, &room, 1) != 1){
+        fprintf(stderr, "the device has no data on control transfers (EP0_DATA)\n");
+        exit(1);
+    }
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        die("socketpair");
+    if(setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+        die("SO_RCVTIMEO");
+    memset(p, 0, sizeof(*p));
+    p->usbFd = usbFd;
+    p->fd = sv[1];
+    p->tStart = now();
+    pthread_create(&p->t, NULL, pumpThread, p);
+    return sv[0];
+}
+
+static void pumpStop(pump_t *p)
+{
+double  dt;
+
+    p->stop = 1;
+    pthread_join(p->t, NULL);
+    p->tEnd = now();
+    vendorRequest(p->usbFd, 0, VENDOR_RQ_DATA, 0, NULL, 0);
+    dt = p->tEnd - p->tStart;
+    printf("control transfers: IN %lu (%.1f bytes, %.0f/s), OUT %lu (%.1f bytes, %.0f/s)\n",
+           p->inTransfers, p->inTransfers ? (double)p->inBytes / p->inTransfers : 0.0,
+           dt > 0 ? p->inTransfers / dt : 0.0,
+           p->outTransfers, p->outTransfers ? (double)p->outBytes / p->outTransfers : 0.0,
+           dt > 0 ? p->outTransfers / dt : 0.0);
+}
+
+/* ------------------------------------------------------------------------- */
+/* compressed mode                                                           */
+/* ------------------------------------------------------------------------- */
+
+/* tty -> decoder -> socket */
+static void *tunnelReader(void *arg)
+{
+tunnel_t        *t = arg;
+unsigned char   code[256], raw[LZ_DECODE_MAX(sizeof(code))];
+ssize_t         n;
+long            m;
+
+    while(!t->stop){
+        if((n = read(t->ttyFd, code, sizeof(code))) <= 0)
+            continue;
+        m = lzDecode(&t->dec, code, n, raw);
+        t->syncs = t->dec.syncs;
+        t->inCoded += n;
+        t->inRaw += m;
+        writeAll(t->fd, raw, m);
+    }
+    return NULL;
+}
+
+/* socket -> encoder -> tty */
+static void *tunnelWriter(void *arg)
+{
+tunnel_t        *t = arg;
+unsigned char   raw[256], code[2 * sizeof(raw)];
+ssize_t         n;
+long            m;
+unsigned        synced = 0;
+
+    while(!t->stop){
+        if(synced != t->syncs){     /* the device lost OUT code */
+            synced = t->syncs;
+            m = lzSync(&t->enc, code);
+            t->outCoded += m;
+            writeAll(t->ttyFd, code, m);
+        }
+        if((n = read(t->fd, raw, sizeof(raw))) <= 0)
+            continue;
+        m = lzEncode(&t->enc, raw, n, code);
+        t->outRaw += n;
+        t->outCoded += m;
+        writeAll(t->ttyFd, code, m);
+    }
+    return NULL;
+}
+
+/* Turns the mode on with both sides at the start of the code and returns
+ * the end of the socket pair for the tests.
+ */
+static int  tunnelStart(tunnel_t *t, int usbFd, int ttyFd)
+{
+int             sv[2];
+struct timeval  tv = { 0, 100000 };
+vendorComp_t    c;
+
+    drain(ttyFd);
+    if(vendorRequest(usbFd, 0, VENDOR_RQ_COMP, 1, NULL, 0) < 0
+            || vendorRequest(usbFd, 1, VENDOR_RQ_COMP, 0, &c, sizeof(c)) != sizeof(c) || !c.active){
+        fprintf(stderr, "the device has no compressed mode (COMP_MODE)\n");
+        exit(1);
+    }
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        die("socketpair");
+    if(setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0
+            || setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+        die("SO_RCVTIMEO");
+    memset(t, 0, sizeof(*t));
+    lzInit(&t->enc);
+    lzInit(&t->dec);
+    t->usbFd = usbFd;
+    t->ttyFd = ttyFd;
+    t->fd = sv[1];
+    pthread_create(&t->rt, NULL, tunnelReader, t);
+    pthread_create(&t->wt, NULL, tunnelWriter, t);
+    return sv[0];
+}
+
+/* Reports the ratio on both sides, turning the mode off clears the device
+ * counters.
+ */
+static void tunnelStop(tunnel_t *t)
+{
+vendorComp_t    c;
+
+    t->stop = 1;
+    pthread_join(t->rt, NULL);
+    pthread_join(t->wt, NULL);
+    printf("compression: IN %lu bytes in %lu (%.2f:1), OUT %lu bytes in %lu (%.2f:1)\n",
+           t->inRaw, t->inCoded, t->inCoded ? (double)t->inRaw / t->inCoded : 0.0,
+           t->outRaw, t->outCoded, t->outCoded ? (double)t->outRaw / t->outCoded : 0.0);
+    if(vendorRequest(t->usbFd, 1, VENDOR_RQ_COMP, 0, &c, sizeof(c)) == sizeof(c))
+        printf("device compression: rx_buf %u bytes in %u, tx_buf %u bytes from %u, %u resyncs\n",
+               le32toh(c.rxRaw), le32toh(c.rxCoded), le32toh(c.txRaw), le32toh(c.txCoded), c.resyncs);
+    vendorRequest(t->usbFd, 0, VENDOR_RQ_COMP, 0, NULL, 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: cdcbench [options] device test\n"
+        "  device   /dev/ttyACM0 or the pty of the simulator\n"
+        "  test     tx     device -> peer, streaming\n"
+        "           rx     peer -> device, streaming (needs -p)\n"
+        "           bidir  both at once (needs -p)\n"
+        "           echo   device -> peer -> device, one chunk at a time\n"
+        "           burst  device -> peer, one chunk at a time with a gap\n"
+        "options:\n"
+        "  -p peer  tty on the UART side; without it TXD-RXD must be looped\n"
+        "  -b baud  (9600), 1 selects the loopback of BENCH_MODES\n"
+        "  -f 8n1   data bits, parity n/e/o, stop bits\n"
+        "  -n bytes total bytes for tx/rx/bidir (16384)\n"
+        "  -s size  chunk size (tx/rx/bidir 64, echo 1, burst 512)\n"
+        "  -c count chunks for echo/burst (1000/20)\n"
+        "  -g ms    gap between bursts (100)\n"
+        "  -u path  usbfs node for the vendor counters, found via sysfs otherwise\n"
+        "  -C       device side on control transfers instead of the tty (EP0_DATA)\n"
+        "  -Z       compressed mode, codec between the tty and the tests (COMP_MODE)\n"
+        "  -L file  send the bytes of a log file instead of the counting pattern\n"
+        "  -v       verbose\n"
+        "The exit code is 1 on lost or corrupted data.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+const char  *peerPath = NULL, *usbPath = NULL, *test;
+long        bytes = 16384, size = 0, count = 0;
+double      gap = 0.1;
+int         opt, fd, peer = -1, usbFd, fail = 0, control = 0, compress = 0;
+stream_t    s1, s2;
+pthread_t   et;
+pump_t      pump;
+tunnel_t    tunnel;
+FILE        *log;
+
+    while((opt = getopt(argc, argv, "p:b:f:n:s:c:g:u:CZL:v")) != -1){
+        switch(opt){
+        case 'p': peerPath = optarg; break;
+        case 'b': baud = atoi(optarg); break;
+        case 'f':
+            if(strlen(optarg) != 3 || !strchr("5678", optarg[0]) || !strchr("neo", optarg[1]) || !strchr("12", optarg[2]))
+                usage();
+            dataBits = optarg[0] - '0';
+            parity = optarg[1];
+            stopBits = optarg[2] - '0';
+            break;
+        case 'n': bytes = atol(optarg); break;
+        case 's': size = atol(optarg); break;
+        case 'c': count = atol(optarg); break;
+        case 'g': gap = atof(optarg) / 1000; break;
+        case 'u': usbPath = optarg; break;
+        case 'C': control = 1; break;
+        case 'Z': compress = 1; break;
+        case 'L':
+            if((log = fopen(optarg, "rb")) == NULL)
+                die(optarg);
+            logData = malloc(1 << 20);
+            logLen = fread(logData, 1, 1 << 20, log);
+            fclose(log);
+            if(logLen <= 0){
+                fprintf(stderr, "%s: empty\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'v': verbose = 1; break;
+        default: usage();
+        }
+    }
+    if(argc - optind != 2 || (control && compress))
+        usage();
+    test = argv[optind + 1];
+    if(dataBits < 8)
+        fprintf(stderr, "warning: %d data bits, the pattern will not fit\n", dataBits);
+
+    fd = openTty(argv[optind]);
+    if(peerPath)
+        peer = openTty(peerPath);
+    usbFd = usbPath ? open(usbPath, O_RDWR) : openUsbDevice(fd);
+    if(usbFd >= 0)
+        vendorClear(usbFd);
+    else if(verbose)
+        fprintf(stderr, "no vendor interface, device counters are not read\n");
+    if((control || compress) && usbFd < 0){
+        fprintf(stderr, "-%c needs the usbfs node of the device\n", control ? 'C' : 'Z');
+        exit(1);
+    }
+    if(control)
+        fd = pumpStart(&pump, usbFd);   /* the tty stays open with its coding */
+    if(compress)
+        fd = tunnelStart(&tunnel, usbFd, fd);
+
+    if(!strcmp(test, "tx")){
+        streamInit(&s1, "tx", fd, peer >= 0 ? peer : fd, size ? size : 64, bytes / (size ? size : 64));
+        streamStart(&s1);
+        streamJoin(&s1);
+        fail = streamReport(&s1);
+    }else if(!strcmp(test, "rx") || !strcmp(test, "bidir")){
+        if(peer < 0)
+            usage();
+        size = size ? size : 64;
+        streamInit(&s1, "rx", peer, fd, size, bytes / size);
+        if(test[0] == 'b'){
+            streamInit(&s2, "tx", fd, peer, size, bytes / size);
+            streamStart(&s2);
+        }
+        streamStart(&s1);
+        streamJoin(&s1);
+        fail = streamReport(&s1);
+        if(test[0] == 'b'){
+            streamJoin(&s2);
+            fail |= streamReport(&s2);
+        }
+    }else if(!strcmp(test, "echo") || !strcmp(test, "burst")){
+        int isEcho = test[0] == 'e';
+
+        if(isEcho && peer >= 0)
+            pthread_create(&et, NULL, echoer, &peer);
+        streamInit(&s1, test, fd, isEcho || peer < 0 ? fd : peer,
+                   size ? size : isEcho ? 1 : 512, count ? count : isEcho ? 1000 : 20);
+        s1.stopAndWait = 1;
+        s1.gap = isEcho ? 0 : gap;
+        streamStart(&s1);
+        streamJoin(&s1);
+        fail = streamReport(&s1);
+    }else{
+        usage();
+    }
+    if(control)
+        pumpStop(&pump);
+    if(compress)
+        tunnelStop(&tunnel);
+    if(usbFd >= 0)
+        vendorReport(usbFd);
+    return fail;
+}
@@ -0,0 +1,366 @@
+/* Name: cdccap.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Host side of the capture mode of the ATmega firmware (-DCAPTURE_MODE,
+    see mega48/capture.h and the records in mega48/vendor.h). It sets the
+    line coding on the /dev/ttyACM*, turns the mode on with
+    VENDOR_RQ_CAPTURE on the usbfs node of the device, and writes what the
+    USART receives as pcap (LINKTYPE_USER0) or as text with -t.
+
+    A packet is a burst of bytes: a gap of -g characters or more between
+    two bytes starts a new one. Its first byte holds the CAP_* flags of its
+    bytes, the data follows. A byte with a framing or parity error or a
+    break ends its packet, a byte after an overrun or lost bytes starts
+    one. The time of a packet is that of its first byte, on the clock of
+    the device from the time the mode was turned on.
+
+    When cdccap ends (SIGINT, SIGTERM, -n), the mode is turned off and the
+    device counters are printed on stderr.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/sysmacros.h>
+#include <linux/usbdevice_fs.h>
+#include "../mega48/vendor.h"
+#include "capdec.h"
+
+#define LINKTYPE_USER0  147
+#define PACKET_MAX      4096    /* data bytes, a longer burst is split */
+
+/* termios2 from asm/termbits.h, which cannot be included with termios.h */
+#ifndef BOTHER
+#define BOTHER  0010000
+#endif
+struct termios2 {
+    tcflag_t    c_iflag, c_oflag, c_cflag, c_lflag;
+    cc_t        c_line;
+    cc_t        c_cc[19];
+    speed_t     c_ispeed, c_ospeed;
+};
+
+typedef struct packet {
+    uint64_t    time, last;     /* of the first and the last byte */
+    uint8_t     flags;
+    uint8_t     data[1 + PACKET_MAX];
+    int         len;            /* with the flags byte */
+} packet_t;
+
+static int      baud = 9600, dataBits = 8, stopBits = 1;
+static char     parity = 'n';
+static double   gapChars = 2.0;
+static int      text, verbose;
+static struct timeval   startTime;
+static unsigned long    packets, bytes, flagged;
+static volatile int     stopRequested;
+
+/* ------------------------------------------------------------------------- */
+
+static void die(const char *what)
+{
+    perror(what);
+    exit(1);
+}
+
+/* Opens a tty raw with the line coding of the options, a read returns
+ * after 0.1 s without data.
+ */
+static int  openTty(const char *path)
+{
+struct termios  t;
+struct termios2 t2;
+int             fd;
+
+    if((fd = open(path, O_RDWR | O_NOCTTY)) < 0)
+        die(path);
+    if(tcgetattr(fd, &t) < 0)
+        die(path);
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CRTSCTS);
+    t.c_cflag |= dataBits == 5 ? CS5 : dataBits == 6 ? CS6 : dataBits == 7 ? CS7 : CS8;
+    if(stopBits == 2)
+        t.c_cflag |= CSTOPB;
+    if(parity != 'n')
+        t.c_cflag |= parity == 'o' ? PARENB | PARODD : PARENB;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 1;
+    if(tcsetattr(fd, TCSANOW, &t) < 0)
+        die(path);
+    if(ioctl(fd, TCGETS2, &t2) < 0)
+        die("TCGETS2");
+    t2.c_cflag = (t2.c_cflag & ~CBAUD) | BOTHER;
+    t2.c_ispeed = t2.c_ospeed = baud;
+    if(ioctl(fd, TCSETS2, &t2) < 0)
+        die("TCSETS2");
+    return fd;
+}
+
+/* Finds the usbfs node of the USB device behind a tty via sysfs. */
+static int  openUsbDevice(int ttyFd)
+{
+struct stat st;
+char        path[PATH_MAX + 32], dir[PATH_MAX], *p;
+int         bus = -1, dev = -1;
+FILE        *f;
+
+    if(fstat(ttyFd, &st) < 0)
+        return -1;
+    snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device", major(st.st_rdev), minor(st.st_rdev));
+    if(!realpath(path, dir))
+        return -1;
+    if((p = strrchr(dir, '/')) == NULL)     /* interface -> device */
+        return -1;
+    *p = 0;
+    snprintf(path, sizeof(path), "%s/busnum", dir);
+    if((f = fopen(path, "r")) != NULL){
+        if(fscanf(f, "%d", &bus) != 1)
+            bus = -1;
+        fclose(f);
+    }
+    snprintf(path, sizeof(path), "%s/devnum", dir);
+    if((f = fopen(path, "r")) != NULL){
+        if(fscanf(f, "%d", &dev) != 1)
+            dev = -1;
+        fclose(f);
+    }
+    if(bus < 0 || dev < 0)
+        return -1;
+    snprintf(path, sizeof(path), "/dev/bus/usb/%03d/%03d", bus, dev);
+    return open(path, O_RDWR);
+}
+
+static int  vendorRequest(int usbFd, int in, int request, int value, void *data, int len)
+{
+struct usbdevfs_ctrltransfer    c;
+
+    c.bRequestType = in ? 0xc0 : 0x40;
+    c.bRequest = request;
+    c.wValue = value;
+    c.wIndex = 0;
+    c.wLength = len;
+    c.timeout = 1000;
+    c.data = data;
+    return ioctl(usbFd, USBDEVFS_CONTROL, &c);
+}
+
+/* ------------------------------------------------------------------------- */
+/* output                                                                    */
+/* ------------------------------------------------------------------------- */
+
+/* pcap is in the byte order of the writer, the magic tells the reader */
+static void put16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, 2);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+}
+
+static void pcapHeader(void)
+{
+uint8_t h[24];
+
+    put32(h, 0xa1b2c3d4);
+    put16(h + 4, 2);            /* version 2.4 */
+    put16(h + 6, 4);
+    put32(h + 8, 0);            /* time zone */
+    put32(h + 12, 0);           /* accuracy */
+    put32(h + 16, 1 + PACKET_MAX);
+    put32(h + 20, LINKTYPE_USER0);
+    fwrite(h, 1, sizeof(h), stdout);
+}
+
+static void flagNames(char *s, uint8_t flags)
+{
+    *s = 0;
+    if(flags & CAP_FRAMING)
+        strcat(s, " framing");
+    if(flags & CAP_PARITY)
+        strcat(s, " parity");
+    if(flags & CAP_BREAK)
+        strcat(s, " break");
+    if(flags & CAP_OVERRUN)
+        strcat(s, " overrun");
+    if(flags & CAP_LOST)
+        strcat(s, " lost");
+}
+
+static void packetFlush(packet_t *p, const capDecoder_t *d)
+{
+double          t = d->hz ? p->time / 256.0 / d->hz : 0.0;
+uint8_t         h[16];
+struct timeval  tv;
+char            names[64];
+int             i;
+
+    if(p->len == 0)
+        return;
+    p->data[0] = p->flags;
+    if(text){
+        flagNames(names, p->flags);
+        printf("%12.6f %4d%s:", t, p->len - 1, names);
+        for(i = 1; i < p->len; i++)
+            printf(" %02x", p->data[i]);
+        printf("\n");
+    }else{
+        tv.tv_sec = startTime.tv_sec + (long)t;
+        tv.tv_usec = startTime.tv_usec + (long)((t - (long)t) * 1e6);
+        if(tv.tv_usec >= 1000000){
+            tv.tv_sec++;
+            tv.tv_usec -= 1000000;
+        }
+        put32(h, tv.tv_sec);
+        put32(h + 4, tv.tv_usec);
+        put32(h + 8, p->len);
+        put32(h + 12, p->len);
+        fwrite(h, 1, sizeof(h), stdout);
+        fwrite(p->data, 1, p->len, stdout);
+    }
+    fflush(stdout);
+    packets++;
+    flagged += p->flags != 0;
+    p->len = 0;
+}
+
+static void packetAdd(packet_t *p, const capDecoder_t *d, const capEvent_t *e)
+{
+    if(p->len && (e->time - p->last >= gapChars * d->chr
+            || e->flags & (CAP_OVERRUN | CAP_LOST) || p->len > PACKET_MAX))
+        packetFlush(p, d);
+    if(p->len == 0){
+        p->time = e->time;
+        p->flags = 0;
+        p->len = 1;
+    }
+    p->data[p->len++] = e->data;
+    p->flags |= e->flags;
+    p->last = e->time;
+    bytes++;
+    if(e->flags & (CAP_FRAMING | CAP_PARITY | CAP_BREAK))
+        packetFlush(p, d);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void onSignal(int sig)
+{
+    stopRequested = 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: cdccap [options] /dev/ttyACMx > file.pcap\n"
+        "  -b baud   baud rate (default 9600)\n"
+        "  -f 8N1    data bits, parity (N, E, O), stop bits (default 8N1)\n"
+        "  -g chars  a gap of this many characters starts a packet (default 2)\n"
+        "  -n sec    stop after this many seconds\n"
+        "  -t        text instead of pcap\n"
+        "  -v        verbose\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+static packet_t pkt;
+uint8_t         buf[256];
+capEvent_t      ev[sizeof(buf)];
+capDecoder_t    dec;
+vendorCapture_t stats;
+double          seconds = 0;
+struct timeval  tv;
+int             opt, tty, usb, n, i;
+
+    while((opt = getopt(argc, argv, "b:f:g:n:tv")) != -1){
+        switch(opt){
+        case 'b': baud = atoi(optarg); break;
+        case 'f':
+            if(strlen(optarg) != 3 || optarg[0] < '5' || optarg[0] > '8'
+                    || !strchr("NEOneo", optarg[1]) || (optarg[2] != '1' && optarg[2] != '2'))
+                usage();
+            dataBits = optarg[0] - '0';
+            parity = optarg[1] | 0x20;
+            stopBits = optarg[2] - '0';
+            break;
+        case 'g': gapChars = atof(optarg); break;
+        case 'n': seconds = atof(optarg); break;
+        case 't': text = 1; break;
+        case 'v': verbose = 1; break;
+        default: usage();
+        }
+    }
+    if(argc - optind != 1 || baud <= 0)
+        usage();
+
+    tty = openTty(argv[optind]);
+    if((usb = openUsbDevice(tty)) < 0){
+        fprintf(stderr, "cdccap: no usbfs node for %s\n", argv[optind]);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    if(vendorRequest(usb, 0, VENDOR_RQ_CAPTURE, 1, NULL, 0) < 0
+            || vendorRequest(usb, 1, VENDOR_RQ_CAPTURE, 0, &stats, sizeof(stats)) != sizeof(stats)
+            || !stats.active){
+        fprintf(stderr, "cdccap: the device has no capture mode, or another mode is on\n");
+        return 1;
+    }
+    gettimeofday(&startTime, NULL);
+    tcflush(tty, TCIFLUSH);     /* data from before the mode */
+    capDecInit(&dec);
+    if(!text)
+        pcapHeader();
+
+    while(!stopRequested){
+        if((n = read(tty, buf, sizeof(buf))) < 0){
+            if(errno == EINTR || errno == EAGAIN)
+                continue;
+            die("read");
+        }
+        if(n == 0)
+            packetFlush(&pkt, &dec);    /* 0.1 s without data */
+        n = capDecode(&dec, buf, n, ev);
+        for(i = 0; i < n; i++)
+            packetAdd(&pkt, &dec, &ev[i]);
+        if(seconds > 0){
+            gettimeofday(&tv, NULL);
+            if(tv.tv_sec - startTime.tv_sec + (tv.tv_usec - startTime.tv_usec) * 1e-6 >= seconds)
+                break;
+        }
+    }
+    packetFlush(&pkt, &dec);
+
+    memset(&stats, 0, sizeof(stats));
+    vendorRequest(usb, 1, VENDOR_RQ_CAPTURE, 0, &stats, sizeof(stats));
+    vendorRequest(usb, 0, VENDOR_RQ_CAPTURE, 0, NULL, 0);
+    fprintf(stderr, "cdccap: %lu bytes in %lu packets, %lu flagged; device: %u bytes, %u errors, "
+            "%u lost, %u bytes of records\n", bytes, packets, flagged, stats.bytes, stats.errors,
+            stats.lost, stats.coded);
+    if(dec.bad)
+        fprintf(stderr, "cdccap: %lu bytes were no record\n", dec.bad);
+    if(verbose && dec.hz)
+        fprintf(stderr, "cdccap: %u ticks/s, %.1f ticks per character\n", dec.hz, dec.chr / 256.0);
+    return 0;
+}
@@ -0,0 +1,415 @@
+/* Name: cdcmux.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Host side of the multi-channel mode of the ATmega firmware (-DMUX_CHANNELS,
+    see mega48/mux.h and the framing in mega48/vendor.h). It sets the baud
+    rate MUX_BAUD_SELECT on the /dev/ttyACM* to select the mode and makes one
+    pty per channel: the first for the USART, the second for the software
+    UART. The settings made on a pty (baud rate, format) are sent to its
+    channel, so each pty behaves like a serial port of its own.
+
+    Data is sent against credit only, in both directions. The device grants
+    the bytes its transmit buffers can take, and cdcmux reads a pty only as
+    far as its channel has credit; cdcmux grants the device the room in the
+    buffer of each pty. A channel whose peer does not read holds back its
+    own data only, the other channel goes on.
+
+    When cdcmux ends (SIGINT, SIGTERM), the tty is set to 9600 bps, which
+    returns the device to the plain CDC mode.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "../mega48/vendor.h"
+
+#define CHANNELS        2
+#define CODING_POLL_MS  20      /* pty settings are polled */
+
+/* termios2 from asm/termbits.h, which cannot be included with termios.h */
+#ifndef BOTHER
+#define BOTHER  0010000
+#endif
+struct termios2 {
+    tcflag_t    c_iflag, c_oflag, c_cflag, c_lflag;
+    cc_t        c_line;
+    cc_t        c_cc[19];
+    speed_t     c_ispeed, c_ospeed;
+};
+
+/* line coding as sent with SET_LINE_CODING */
+typedef struct coding {
+    uint32_t    baud;
+    uint8_t     stop, parity, bits;
+} coding_t;
+
+typedef struct channel {
+    int         master, slave;
+    const char  *name;
+    char        link[256];
+    uint8_t     out[4096];      /* from the device, waiting for the pty */
+    int         outLen;
+    int         txCredit;       /* bytes the device can take */
+    int         rxGranted;      /* bytes granted to the device, not received */
+    coding_t    coding;
+    unsigned long txBytes, rxBytes, overruns;
+} channel_t;
+
+static channel_t    channels[CHANNELS];
+static int          tty = -1, verbose;
+static volatile int stopRequested;
+
+/* ------------------------------------------------------------------------- */
+
+static void die(const char *what)
+{
+    perror(what);
+    exit(1);
+}
+
+static void writeAll(int fd, const uint8_t *p, int len)
+{
+ssize_t n;
+
+    while(len > 0){
+        if((n = write(fd, p, len)) < 0){
+            if(errno == EINTR || errno == EAGAIN)
+                continue;
+            die("write");
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/* Opens the CDC device raw, with the baud rate that selects the mode. */
+static int  ttyOpen(const char *path)
+{
+struct termios  t;
+struct termios2 t2;
+int             fd;
+
+    if((fd = open(path, O_RDWR | O_NOCTTY)) < 0)
+        die(path);
+    if(tcgetattr(fd, &t) < 0)
+        die(path);
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    if(tcsetattr(fd, TCSANOW, &t) < 0)
+        die(path);
+    tcflush(fd, TCIOFLUSH);
+    if(ioctl(fd, TCGETS2, &t2) < 0)
+        die("TCGETS2");
+    t2.c_cflag = (t2.c_cflag & ~CBAUD) | BOTHER;
+    t2.c_ispeed = t2.c_ospeed = MUX_BAUD_SELECT;
+    if(ioctl(fd, TCSETS2, &t2) < 0)
+        die("TCSETS2");
+    return fd;
+}
+
+/* Returns the device to the plain CDC mode. */
+static void ttyClose(void)
+{
+struct termios  t;
+
+    if(tty < 0)
+        return;
+    if(tcgetattr(tty, &t) == 0){
+        cfsetspeed(&t, B9600);
+        tcsetattr(tty, TCSANOW, &t);
+    }
+    close(tty);
+    tty = -1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ptys                                                                      */
+/* ------------------------------------------------------------------------- */
+
+static void ptyOpen(channel_t *c, const char *linkDir, const char *linkName, speed_t speed)
+{
+struct termios  t;
+
+    if((c->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0
+            || grantpt(c->master) < 0 || unlockpt(c->master) < 0)
+        die("posix_openpt");
+    c->name = strdup(ptsname(c->master));
+    /* keep the slave open, the master reads EIO when the last user closes */
+    if((c->slave = open(c->name, O_RDWR | O_NOCTTY)) < 0)
+        die(c->name);
+    tcgetattr(c->slave, &t);
+    cfmakeraw(&t);
+    cfsetspeed(&t, speed);
+    tcsetattr(c->slave, TCSANOW, &t);
+    if(linkDir){
+        snprintf(c->link, sizeof(c->link), "%s/%s", linkDir, linkName);
+        unlink(c->link);
+        if(symlink(c->name, c->link) < 0)
+            perror(c->link);
+    }
+}
+
+static void ptyClose(channel_t *c)
+{
+    if(c->link[0])
+        unlink(c->link);
+}
+
+static void ptyFlush(channel_t *c)
+{
+int     n;
+
+    if(c->outLen && (n = write(c->master, c->out, c->outLen)) > 0){
+        memmove(c->out, c->out + n, c->outLen - n);
+        c->outLen -= n;
+    }
+}
+
+/* Reads the settings of a pty, returns 1 if they changed. */
+static int  ptyCoding(channel_t *c)
+{
+struct termios2 t;
+coding_t        n;
+
+    if(ioctl(c->master, TCGETS2, &t) < 0)
+        return 0;
+    n.baud = t.c_ospeed;
+    n.stop = t.c_cflag & CSTOPB ? 2 : 0;
+    n.parity = !(t.c_cflag & PARENB) ? 0 : t.c_cflag & PARODD ? 1 : 2;
+    switch(t.c_cflag & CSIZE){
+    case CS5: n.bits = 5; break;
+    case CS6: n.bits = 6; break;
+    case CS7: n.bits = 7; break;
+    default: n.bits = 8; break;
+    }
+    if(n.baud == c->coding.baud && n.stop == c->coding.stop
+            && n.parity == c->coding.parity && n.bits == c->coding.bits)
+        return 0;
+    c->coding = n;
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* frames                                                                    */
+/* ------------------------------------------------------------------------- */
+
+static uint8_t  txFrames[512];  /* frames to the device, written at once */
+static int      txLen;
+
+static void txFlush(void)
+{
+    writeAll(tty, txFrames, txLen);
+    txLen = 0;
+}
+
+static void txFrame(uint8_t header, const uint8_t *data, int len)
+{
+    if(txLen + 1 + len > (int)sizeof(txFrames))
+        txFlush();
+    txFrames[txLen++] = header;
+    memcpy(txFrames + txLen, data, len);
+    txLen += len;
+}
+
+static void sendCoding(int ch)
+{
+channel_t   *c = &channels[ch];
+uint8_t     d[7];
+
+    d[0] = c->coding.baud;
+    d[1] = c->coding.baud >> 8;
+    d[2] = c->coding.baud >> 16;
+    d[3] = c->coding.baud >> 24;
+    d[4] = c->coding.stop;
+    d[5] = c->coding.parity;
+    d[6] = c->coding.bits;
+    txFrame(MUX_HDR(ch, MUX_CMD_CODING), d, sizeof(d));
+    if(verbose)
+        fprintf(stderr, "cdcmux: channel %d %u %d%c%d\n", ch, c->coding.baud, c->coding.bits,
+                "noe"[c->coding.parity], c->coding.stop ? 2 : 1);
+}
+
+/* Grants the device the room in the pty buffer. The device counts its
+ * credit in a byte, so no more than 255 bytes are outstanding, and small
+ * grants wait until the outstanding credit is used up.
+ */
+static void sendCredit(int ch)
+{
+channel_t   *c = &channels[ch];
+int         n;
+uint8_t     d;
+
+    n = (int)sizeof(c->out) - c->outLen;
+    if(n > 255)
+        n = 255;
+    n -= c->rxGranted;
+    if(n <= 0 || (n < 32 && c->rxGranted))
+        return;
+    d = n;
+    txFrame(MUX_HDR(ch, MUX_CMD_CREDIT), &d, 1);
+    c->rxGranted += n;
+}
+
+/* Sends what a pty has, as far as the device has granted. */
+static void sendData(int ch)
+{
+channel_t   *c = &channels[ch];
+uint8_t     buf[MUX_DATA_MAX];
+int         n;
+
+    while(c->txCredit > 0){
+        n = c->txCredit < MUX_DATA_MAX ? c->txCredit : MUX_DATA_MAX;
+        if((n = read(c->master, buf, n)) <= 0)
+            break;
+        txFrame(MUX_HDR(ch, n - 1), buf, n);
+        c->txCredit -= n;
+        c->txBytes += n;
+    }
+}
+
+/* Parses the frames from the device, which may be split across reads. */
+static void rxParse(const uint8_t *p, int len)
+{
+static uint8_t  header;
+static int      left;
+channel_t       *c;
+
+    for(; len > 0; p++, len--){
+        if(left == 0){
+            header = *p;
+            if(MUX_HDR_TYPE(header) == MUX_CMD_CREDIT)
+                left = 1;
+            else if(header & MUX_HDR_CMD)
+                left = 0;       /* unknown command without arguments */
+            else
+                left = MUX_HDR_TYPE(header) + 1;
+            continue;
+        }
+        left--;
+        if(MUX_HDR_CHANNEL(header) >= CHANNELS)
+            continue;
+        c = &channels[MUX_HDR_CHANNEL(header)];
+        if(header & MUX_HDR_CMD){
+            c->txCredit += *p;
+        }else{
+            if(c->outLen < (int)sizeof(c->out))
+                c->out[c->outLen++] = *p;
+            else
+                c->overruns++;
+            if(c->rxGranted > 0)
+                c->rxGranted--;
+            c->rxBytes++;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void onSignal(int sig)
+{
+    stopRequested = 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: cdcmux [options] /dev/ttyACMx\n"
+        "  -l dir    create the symlinks dir/mux0 and dir/mux1 to the ptys\n"
+        "  -v        verbose\n"
+        "The ptys of the USART and of the software UART are printed on stdout.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+struct pollfd   pfd[1 + CHANNELS];
+uint8_t         buf[256];
+const char      *linkDir = NULL;
+char            name[16];
+int             opt, ch, n;
+
+    while((opt = getopt(argc, argv, "l:v")) != -1){
+        switch(opt){
+        case 'l': linkDir = optarg; break;
+        case 'v': verbose = 1; break;
+        default: usage();
+        }
+    }
+    if(argc - optind != 1)
+        usage();
+
+    for(ch = 0; ch < CHANNELS; ch++){
+        snprintf(name, sizeof(name), "mux%d", ch);
+        ptyOpen(&channels[ch], linkDir, name, ch == 0 ? B9600 : B2400);
+        printf("%s\n", channels[ch].name);
+    }
+    fflush(stdout);
+    tty = ttyOpen(argv[optind]);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    while(!stopRequested){
+        for(ch = 0; ch < CHANNELS; ch++){
+            channel_t   *c = &channels[ch];
+
+            if(ptyCoding(c))
+                sendCoding(ch);
+            ptyFlush(c);
+            sendCredit(ch);
+            sendData(ch);
+        }
+        if(txLen)
+            txFlush();
+
+        pfd[0].fd = tty;
+        pfd[0].events = POLLIN;
+        for(ch = 0; ch < CHANNELS; ch++){
+            pfd[1 + ch].fd = channels[ch].master;
+            pfd[1 + ch].events = (channels[ch].txCredit > 0 ? POLLIN : 0)
+                                 | (channels[ch].outLen ? POLLOUT : 0);
+        }
+        if(poll(pfd, 1 + CHANNELS, CODING_POLL_MS) < 0){
+            if(errno == EINTR)
+                continue;
+            die("poll");
+        }
+        if(pfd[0].revents & (POLLERR | POLLHUP)){
+            fprintf(stderr, "cdcmux: device lost\n");
+            break;
+        }
+        if(pfd[0].revents & POLLIN){
+            if((n = read(tty, buf, sizeof(buf))) < 0 && errno != EINTR && errno != EAGAIN)
+                die("read");
+            if(n > 0)
+                rxParse(buf, n);
+        }
+    }
+
+    if(verbose){
+        for(ch = 0; ch < CHANNELS; ch++)
+            fprintf(stderr, "cdcmux: channel %d: %lu bytes out, %lu bytes in, %lu overruns\n",
+                    ch, channels[ch].txBytes, channels[ch].rxBytes, channels[ch].overruns);
+    }
+    ttyClose();
+    for(ch = 0; ch < CHANNELS; ch++)
+        ptyClose(&channels[ch]);
+    return 0;
+}
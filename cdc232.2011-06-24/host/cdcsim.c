@@ -0,0 +1,1505 @@
+/* Name: cdcsim.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Runs the firmware (cdcmega.elf, cdctiny85.elf, ...) in simavr and
+    attaches a bit-level low-speed USB host to the D+/D- pins. The host
+    resets and enumerates the device, reads the configuration descriptor
+    to find the CDC endpoints, and then exposes the bulk endpoints as a
+    pseudo-terminal. A second pty is the peer on the UART side, connected
+    to the simulated USART, or to a pin-level UART model on the TXD/RXD
+    pins of the ATtiny45/85.
+
+    This is experimental. It was compiled against the simavr headers but
+    has not been linked with simavr or run on a firmware image yet.
+
+    The host works like a USB host controller on a 1 ms frame: a keep-alive
+    EOP at the start of every frame, then the interrupt IN endpoint at its
+    polling interval, bulk OUT when the pty has data, and bulk IN. Packets
+    are NRZI coded, bit stuffed and timed on the AVR cycle counter, and the
+    device's answers are decoded from its PORT and DDR writes, so the run
+    does not depend on the speed of the host PC. Only the data arriving on
+    the ptys does, and -r paces the simulation to real time for it.
+
+    Settings made on the USB pty (baud rate, format) are sent to the device
+    as SET_LINE_CODING, so host software sees the same behaviour as with
+    /dev/ttyACM*.
+
+    With -p the cycles of every instruction are counted for the context it
+    runs in: the USB interrupt, the other interrupt vectors, the main loop
+    (and within it usbPoll and uartPoll), or sleep. The profile is printed
+    at the end; -w writes the same contexts and the bus state as a VCD
+    timeline for a waveform viewer. Like the rest of this file the
+    profiler has not been run yet; its counts are not cycle budgets.
+
+    -F injects the faults of a noisy bus at given rates: corrupted CRCs in
+    both directions, lost ACKs, NAK storms, bus resets and jitter of the
+    frame start. The summary at the end counts them with the throughput and
+    the time to recover from a reset; lost or doubled serial bytes are
+    found by cdcbench on the ptys. It is untested like the rest.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <libelf.h>
+#include <gelf.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_io.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+
+#define LS_BITRATE      1500000.0   /* low-speed USB */
+
+/* termios2 from asm/termbits.h, which cannot be included with termios.h */
+struct termios2 {
+    tcflag_t    c_iflag, c_oflag, c_cflag, c_lflag;
+    cc_t        c_line;
+    cc_t        c_cc[19];
+    speed_t     c_ispeed, c_ospeed;
+};
+
+typedef struct target {
+    const char  *match;         /* part of the file name */
+    const char  *mmcu;
+    uint32_t    frequency;
+    char        usbPort;        /* USB_CFG_IOPORTNAME */
+    uint8_t     dminus, dplus;
+    char        uartPort;       /* pin UART when the MCU has no USART */
+    uint8_t     txd, rxd;
+    char        ctsPort;        /* CTS input held high, 0 for none */
+    uint8_t     cts;
+    uint8_t     vectors;        /* interrupt vectors including reset */
+    uint8_t     usbVector;      /* USB_INTR_VECTOR */
+} target_t;
+
+/* Defaults for the firmware of this package, see usbconfig.h and uart.h */
+static const target_t   targets[] = {
+    { "cdcmega",   "atmega48",   12000000, 'D', 3, 2,   0, 0, 0,  'C', 5,  26, 1 },
+    { "cdc2313",   "attiny2313", 12000000, 'D', 3, 2,   0, 0, 0,  0, 0,    19, 1 },
+    { "cdctiny45", "attiny45",   16500000, 'B', 3, 4, 'B', 1, 2,  0, 0,    15, 2 },
+    { "cdctiny",   "attiny85",   16500000, 'B', 3, 4, 'B', 1, 2,  0, 0,    15, 2 },
+    { NULL }
+};
+
+static avr_t            *avr;
+static target_t         tgt;
+static double           bitCycles;          /* AVR cycles per USB bit */
+static avr_cycle_count_t frameCycles, nextFrame;
+static int              verbose, realtime;
+static double           wallStart;
+
+/* ------------------------------------------------------------------------- */
+
+static double  now(void)
+{
+struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* ------------------------------------------------------------------------- */
+/* profiler                                                                  */
+/* ------------------------------------------------------------------------- */
+
+#define PROF_MAIN       0       /* contexts */
+#define PROF_SLEEP      1
+#define PROF_VECTOR     2       /* + vector number */
+#define PROF_CONTEXTS   (PROF_VECTOR + 64)
+#define OP_RETI         0x9518
+
+typedef struct symbol {
+    char        *name;
+    uint32_t    addr;           /* byte address in flash */
+} symbol_t;
+
+static symbol_t *symbols;
+static int      symbolCount;
+
+/* functions of the main loop that are profiled separately */
+static struct {
+    const char          *name;
+    uint32_t            addr;
+    uint16_t            sp;     /* stack pointer after the call, 0 outside */
+    avr_cycle_count_t   cycles;
+} profFunc[] = { { "usbPoll" }, { "uartPoll" } };
+
+#define PROF_FUNCS      (int)(sizeof(profFunc) / sizeof(profFunc[0]))
+
+static int              profiling;
+static avr_cycle_count_t profStart, profCycles[PROF_CONTEXTS];
+static uint8_t          profStack[8];       /* nested interrupts */
+static int              profDepth;
+static avr_cycle_count_t profMainEnd, profMaxGap;   /* interrupts only */
+static avr_cycle_count_t profWindow, profWindowMain, profMinMain = ~0ULL, profWindows;
+static FILE             *vcd;
+static unsigned long long vcdLast = ~0ULL;
+static int              vcdBus = -1, hostBus = 1;
+
+/* Reads the function symbols from the ELF file, for names in the profile. */
+static void symbolsLoad(const char *path)
+{
+Elf         *e;
+Elf_Scn     *scn = NULL;
+Elf_Data    *d;
+GElf_Shdr   sh;
+GElf_Sym    s;
+int         fd, i, n;
+
+    if(elf_version(EV_CURRENT) == EV_NONE || (fd = open(path, O_RDONLY)) < 0)
+        return;
+    if((e = elf_begin(fd, ELF_C_READ, NULL)) != NULL){
+        while((scn = elf_nextscn(e, scn)) != NULL){
+            if(gelf_getshdr(scn, &sh) == NULL || sh.sh_type != SHT_SYMTAB || !sh.sh_entsize)
+                continue;
+            d = elf_getdata(scn, NULL);
+            n = sh.sh_size / sh.sh_entsize;
+            symbols = realloc(symbols, (symbolCount + n) * sizeof(symbol_t));
+            for(i = 0; d && i < n; i++){
+                if(gelf_getsym(d, i, &s) == NULL || GELF_ST_TYPE(s.st_info) != STT_FUNC
+                        || s.st_value >= 0x800000)     /* not in flash */
+                    continue;
+                symbols[symbolCount].name = strdup(elf_strptr(e, sh.sh_link, s.st_name));
+                symbols[symbolCount].addr = s.st_value;
+                symbolCount++;
+            }
+        }
+        elf_end(e);
+    }
+    close(fd);
+    for(i = 0; i < PROF_FUNCS; i++){
+        for(n = 0; n < symbolCount; n++){
+            if(strcmp(symbols[n].name, profFunc[i].name) == 0)
+                profFunc[i].addr = symbols[n].addr;
+        }
+    }
+}
+
+/* Name of the function at or before a flash address, "?" if unknown. */
+static const char   *symbolAt(uint32_t addr)
+{
+int     i, best = -1;
+
+    for(i = 0; i < symbolCount; i++){
+        if(symbols[i].addr <= addr && (best < 0 || symbols[i].addr > symbols[best].addr))
+            best = i;
+    }
+    return best < 0 ? "?" : symbols[best].name;
+}
+
+/* Name of the handler of an interrupt vector: the target of the jump in the
+ * vector table, rjmp or jmp.
+ */
+static const char   *vectorName(int vector)
+{
+uint32_t    a = vector * avr->vector_size;
+uint16_t    op = avr->flash[a] | avr->flash[a + 1] << 8;
+
+    if((op & 0xf000) == 0xc000)         /* rjmp */
+        return symbolAt(a + 2 + ((int16_t)(op << 4) >> 3));
+    if((op & 0xfe0e) == 0x940c)         /* jmp */
+        return symbolAt((avr->flash[a + 2] | avr->flash[a + 3] << 8) * 2);
+    return "?";
+}
+
+static uint16_t stackPointer(void)
+{
+    return avr->data[0x5d] | avr->data[0x5e] << 8;  /* SPL, SPH */
+}
+
+/* VCD output, the time unit is ns */
+static void vcdTime(void)
+{
+unsigned long long  t = (avr->cycle - profStart) * 1000000000ULL / avr->frequency;
+
+    if(t != vcdLast){
+        fprintf(vcd, "#%llu\n", t);
+        vcdLast = t;
+    }
+}
+
+static void vcdValue(char id, unsigned value, int bits)
+{
+int     i;
+
+    vcdTime();
+    if(bits == 1){
+        fprintf(vcd, "%u%c\n", value, id);
+        return;
+    }
+    fputc('b', vcd);
+    for(i = bits - 1; i >= 0; i--)
+        fputc('0' + ((value >> i) & 1), vcd);
+    fprintf(vcd, " %c\n", id);
+}
+
+static void vcdContext(void)
+{
+int     v = profDepth ? profStack[profDepth - 1] : 0;
+
+    vcdValue('v', v, 8);
+    vcdValue('u', v != 0 && v == tgt.usbVector, 1);
+}
+
+/* D+/D- as driven by the host or by the device, 0 SE0, 1 J, 2 K */
+static void profBus(int state)
+{
+    if(vcd && state != vcdBus){
+        vcdBus = state;
+        vcdValue('b', state, 2);
+    }
+}
+
+static void profOpenVcd(const char *path)
+{
+int     i;
+
+    if((vcd = fopen(path, "w")) == NULL){
+        perror(path);
+        exit(1);
+    }
+    fprintf(vcd, "$timescale 1ns $end\n$scope module %s $end\n", tgt.mmcu);
+    fprintf(vcd, "$var wire 8 v vector $end\n$var wire 1 u usb_isr $end\n");
+    fprintf(vcd, "$var wire 1 s sleep $end\n$var wire 2 b usb_bus $end\n");
+    for(i = 0; i < PROF_FUNCS; i++)
+        fprintf(vcd, "$var wire 1 %c %s $end\n", 'f' + i, profFunc[i].name);
+    fprintf(vcd, "$upscope $end\n$enddefinitions $end\n");
+}
+
+static void profBegin(void)
+{
+int     i;
+
+    profiling = 1;
+    profStart = profMainEnd = profWindow = avr->cycle;
+    if(vcd){
+        vcdContext();
+        vcdValue('s', 0, 1);
+        for(i = 0; i < PROF_FUNCS; i++)
+            vcdValue('f' + i, 0, 1);
+        profBus(hostBus);
+    }
+}
+
+/* Counts the cycles of one avr_run() for the context it started in and
+ * follows the context: reti leaves an interrupt, a program counter in the
+ * vector table enters one. simavr takes an interrupt at the end of an
+ * instruction, so the few cycles of the interrupt response are counted for
+ * the interrupted context.
+ */
+static void profStep(uint32_t pc, uint16_t op, int sleeping, avr_cycle_count_t before)
+{
+avr_cycle_count_t   c = avr->cycle - before;
+int                 i, ctx, depth = profDepth;
+uint16_t            sp;
+
+    ctx = profDepth ? PROF_VECTOR + profStack[profDepth - 1] : sleeping ? PROF_SLEEP : PROF_MAIN;
+    profCycles[ctx] += c;
+    if(ctx == PROF_MAIN || ctx == PROF_SLEEP){
+        if(before - profMainEnd > profMaxGap)
+            profMaxGap = before - profMainEnd;
+        profMainEnd = avr->cycle;
+        profWindowMain += c;
+        for(i = 0; i < PROF_FUNCS; i++){
+            if(profFunc[i].sp)
+                profFunc[i].cycles += c;
+        }
+    }
+    if(avr->cycle - profWindow >= frameCycles){     /* cycles left per ms */
+        if(profWindowMain < profMinMain)
+            profMinMain = profWindowMain;
+        profWindows++;
+        profWindow += frameCycles;
+        profWindowMain = 0;
+    }
+    if(vcd && sleeping != (avr->state == cpu_Sleeping))
+        vcdValue('s', avr->state == cpu_Sleeping, 1);
+
+    if(!sleeping && op == OP_RETI && profDepth)
+        profDepth--;
+    if(avr->pc == 0){                       /* reset */
+        profDepth = 0;
+    }else if(avr->pc < (uint32_t)tgt.vectors * avr->vector_size && avr->pc != pc){
+        if(profDepth < (int)sizeof(profStack))
+            profStack[profDepth++] = avr->pc / avr->vector_size;
+    }
+    if(vcd && profDepth != depth)
+        vcdContext();
+    if(profDepth)
+        return;
+    sp = stackPointer();
+    for(i = 0; i < PROF_FUNCS; i++){
+        if(profFunc[i].sp && sp > profFunc[i].sp){
+            profFunc[i].sp = 0;             /* returned */
+            if(vcd)
+                vcdValue('f' + i, 0, 1);
+        }else if(!profFunc[i].sp && profFunc[i].addr && avr->pc == profFunc[i].addr){
+            profFunc[i].sp = sp;
+            if(vcd)
+                vcdValue('f' + i, 1, 1);
+        }
+    }
+}
+
+static void profReport(uint32_t baud)
+{
+avr_cycle_count_t   total = avr->cycle - profStart, isr = 0;
+double              ms = (double)total * 1000 / avr->frequency, byteCycles;
+int                 i, v;
+
+    if(!total)
+        return;
+    fprintf(stderr, "cdcsim: profile of %.0f ms, %s at %.3f MHz, %llu cycles\n",
+            ms, tgt.mmcu, avr->frequency / 1e6, (unsigned long long)total);
+    for(v = 0; v < 64; v++){
+        if(!profCycles[PROF_VECTOR + v])
+            continue;
+        isr += profCycles[PROF_VECTOR + v];
+        fprintf(stderr, "  vector %2d %-20s %12llu %6.2f%%%s\n", v, vectorName(v),
+                (unsigned long long)profCycles[PROF_VECTOR + v],
+                100.0 * profCycles[PROF_VECTOR + v] / total, v == tgt.usbVector ? "  USB" : "");
+    }
+    fprintf(stderr, "  %-30s %12llu %6.2f%%\n", "main loop",
+            (unsigned long long)profCycles[PROF_MAIN], 100.0 * profCycles[PROF_MAIN] / total);
+    for(i = 0; i < PROF_FUNCS; i++){
+        if(profFunc[i].addr)
+            fprintf(stderr, "    %-28s %12llu %6.2f%%\n", profFunc[i].name,
+                    (unsigned long long)profFunc[i].cycles, 100.0 * profFunc[i].cycles / total);
+    }
+    if(profCycles[PROF_SLEEP])
+        fprintf(stderr, "  %-30s %12llu %6.2f%%\n", "sleep",
+                (unsigned long long)profCycles[PROF_SLEEP], 100.0 * profCycles[PROF_SLEEP] / total);
+    fprintf(stderr, "  left to the main loop: %.0f cycles/ms on average", (double)(total - isr) / ms);
+    if(profWindows)
+        fprintf(stderr, ", %llu in the worst ms", (unsigned long long)profMinMain);
+    fputc('\n', stderr);
+    byteCycles = (double)avr->frequency * 10 / (baud ? baud : 4800);
+    fprintf(stderr, "  per UART byte at %u baud: %.0f cycles, %.0f left to the main loop\n",
+            baud ? baud : 4800, byteCycles, byteCycles * (total - isr) / total);
+    fprintf(stderr, "  longest time in interrupts without the main loop: %llu cycles (%.2f bytes)\n",
+            (unsigned long long)profMaxGap, profMaxGap / byteCycles);
+}
+
+static void step(void)
+{
+avr_cycle_count_t   before = avr->cycle;
+uint32_t            pc = avr->pc;
+uint16_t            op = avr->flash[pc] | avr->flash[pc + 1] << 8;
+int                 sleeping = avr->state == cpu_Sleeping;
+int                 state = avr_run(avr);
+
+    if(state == cpu_Done || state == cpu_Crashed){
+        fprintf(stderr, "cdcsim: the AVR stopped (state %d) at cycle %llu\n",
+                state, (unsigned long long)avr->cycle);
+        exit(1);
+    }
+    if(profiling)
+        profStep(pc, op, sleeping, before);
+}
+
+static void runUntil(avr_cycle_count_t cycle)
+{
+    while(avr->cycle < cycle)
+        step();
+}
+
+/* ------------------------------------------------------------------------- */
+/* USB wire                                                                  */
+/* ------------------------------------------------------------------------- */
+
+enum { SE0 = 0, J, K };
+
+static avr_irq_t        *dplusIrq, *dminusIrq;
+static uint8_t          usbMask;            /* D+ and D- in PORT/DDR */
+static uint8_t          devPort, devDdr;
+
+/* transmitter */
+static uint8_t          txLine[1200];       /* line state per bit */
+static int              txLen, txPos;
+static avr_cycle_count_t txStart;
+static volatile int     txBusy;
+
+/* receiver */
+#define RX_EDGES        1024
+static struct { avr_cycle_count_t cycle; uint8_t state; } rxEdge[RX_EDGES];
+static int              rxEdges, rxActive, devDriving;
+
+static void hostDrive(int state)
+{
+    /* low-speed: J is D- high, K is D+ high */
+    avr_raise_irq(dplusIrq, state == K);
+    avr_raise_irq(dminusIrq, state == J);
+    hostBus = state;
+    if(!devDriving)
+        profBus(state);
+}
+
+static avr_cycle_count_t txTimer(avr_t *a, avr_cycle_count_t when, void *param)
+{
+    if(txPos >= txLen){
+        hostDrive(J);   /* released, the pull-up keeps J */
+        txBusy = 0;
+        return 0;
+    }
+    hostDrive(txLine[txPos++]);
+    return txStart + (avr_cycle_count_t)(txPos * bitCycles + 0.5);
+}
+
+/* Starts sending the line states in txLine and runs the AVR until done. */
+static void txRun(void)
+{
+    txPos = 0;
+    txBusy = 1;
+    txStart = avr->cycle + 1;
+    avr_cycle_timer_register(avr, 1, txTimer, NULL);
+    while(txBusy)
+        step();
+}
+
+static void devLineChanged(void)
+{
+int     state;
+
+    devDriving = (devDdr & usbMask) != 0;
+    state = (devPort >> tgt.dplus) & 1 ? K : (devPort >> tgt.dminus) & 1 ? J : SE0;
+    profBus(devDriving ? state : hostBus);
+    if(!devDriving || !rxActive)
+        return;
+    if(rxEdges && rxEdge[rxEdges - 1].state == state)
+        return;
+    if(rxEdges < RX_EDGES){
+        rxEdge[rxEdges].cycle = avr->cycle;
+        rxEdge[rxEdges].state = state;
+        rxEdges++;
+    }
+}
+
+static void portNotify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    devPort = value;
+    devLineChanged();
+}
+
+static void ddrNotify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    devDdr = value;
+    devLineChanged();
+}
+
+/* USB reset: SE0 for the given time */
+static void wireReset(double ms)
+{
+    hostDrive(SE0);
+    runUntil(avr->cycle + (avr_cycle_count_t)(ms * avr->frequency / 1000));
+    hostDrive(J);
+}
+
+/* Low-speed keep-alive: EOP at the start of a frame */
+static void wireKeepAlive(void)
+{
+    txLen = 0;
+    txLine[txLen++] = SE0;
+    txLine[txLen++] = SE0;
+    txLine[txLen++] = J;
+    txRun();
+}
+
+/* Encodes a packet: idle gap, SYNC, NRZI with bit stuffing, EOP. */
+static void wireSend(const uint8_t *data, int len)
+{
+int     i, b, ones = 0, line = J;
+uint8_t byte;
+
+    txLen = 0;
+    for(i = 0; i < 4; i++)      /* inter-packet gap */
+        txLine[txLen++] = J;
+    for(i = -1; i < len; i++){
+        byte = i < 0 ? 0x80 : data[i];
+        for(b = 0; b < 8; b++, byte >>= 1){
+            if(byte & 1){
+                ones++;
+            }else{
+                line = line == J ? K : J;
+                ones = 0;
+            }
+            txLine[txLen++] = line;
+            if(ones == 6){      /* stuff a 0 */
+                line = line == J ? K : J;
+                txLine[txLen++] = line;
+                ones = 0;
+            }
+        }
+    }
+    txLine[txLen++] = SE0;
+    txLine[txLen++] = SE0;
+    txLine[txLen++] = J;
+    txRun();
+}
+
+static int  stateAt(avr_cycle_count_t t)
+{
+int     i, state = J;
+
+    for(i = 0; i < rxEdges && rxEdge[i].cycle <= t; i++)
+        state = rxEdge[i].state;
+    return state;
+}
+
+/* Runs the AVR until the device has answered and released the bus, or
+ * until the bus turnaround time has passed. Returns the packet length
+ * without SYNC, WIRE_NONE for no answer or WIRE_ERROR for a bit error.
+ */
+#define WIRE_NONE       -1
+#define WIRE_ERROR      -2
+
+static int  wireReceive(uint8_t *buf, int max)
+{
+avr_cycle_count_t   start = avr->cycle, t0;
+int                 k, bit, state, prev = J, ones = 0, nbits = 0, len = 0;
+uint8_t             byte = 0;
+
+    rxEdges = 0;
+    rxActive = 1;
+    for(;;){
+        step();
+        if(rxEdges == 0 && avr->cycle - start > 18 * bitCycles)
+            break;      /* turnaround timeout */
+        if(rxEdges && !devDriving)
+            break;
+        if(avr->cycle - start > (max + 8) * 10 * bitCycles)
+            break;
+    }
+    rxActive = 0;
+    if(rxEdges == 0)
+        return WIRE_NONE;
+
+    t0 = rxEdge[0].cycle;
+    for(k = 0; ; k++){
+        state = stateAt(t0 + (avr_cycle_count_t)((k + 0.5) * bitCycles));
+        if(state == SE0)
+            break;
+        bit = state == prev;
+        prev = state;
+        if(ones == 6){          /* stuffed bit */
+            if(bit)
+                return WIRE_ERROR;
+            ones = 0;
+            continue;
+        }
+        ones = bit ? ones + 1 : 0;
+        byte = byte >> 1 | bit << 7;
+        if(++nbits == 8){
+            nbits = 0;
+            if(len == 0){
+                if(byte != 0x80)    /* SYNC */
+                    return WIRE_ERROR;
+            }else{
+                if(len > max)
+                    return WIRE_ERROR;
+                buf[len - 1] = byte;
+            }
+            len++;
+        }
+    }
+    if(len == 0 || nbits)
+        return WIRE_ERROR;
+    return len - 1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* USB transactions                                                          */
+/* ------------------------------------------------------------------------- */
+
+#define PID_OUT         0xe1
+#define PID_IN          0x69
+#define PID_SETUP       0x2d
+#define PID_DATA0       0xc3
+#define PID_DATA1       0x4b
+#define PID_ACK         0xd2
+#define PID_NAK         0x5a
+#define PID_STALL       0x1e
+
+/* Results of the transaction functions, >= 0 is the data length */
+#define USB_NAK         -1
+#define USB_STALL       -2
+#define USB_TIMEOUT     -3
+#define USB_ERROR       -4
+#define USB_DUPLICATE   -5      /* IN data with the wrong toggle, ACKed and dropped */
+
+static struct {
+    unsigned long   transactions, naks, timeouts, errors, duplicates;
+} usbStats;
+
+/* fault injection, rates per packet (crc, ack) or per frame (nak, reset) */
+static struct {
+    double      crc, ack, nak, reset;
+    double      jitter;         /* frame start +-us */
+    int         storm;          /* frames of a NAK storm */
+} fault = { .storm = 10 };
+
+static struct {
+    unsigned long   crcOut, crcOutAcked, crcIn, ackOut, ackIn, storms, resets;
+    unsigned long   recoveries;
+    double          recoveryMs, recoveryMaxMs;
+    unsigned long   bytesOut, bytesIn;
+} faultStats;
+
+static int      dataCorrupted;  /* set by sendData() */
+static int      faultActive;    /* not during the enumeration */
+static avr_cycle_count_t faultStart;
+
+static int  faultChance(double rate)
+{
+    return faultActive && rate > 0 && drand48() < rate;
+}
+
+/* Parses "crc=0.01,ack=0.01,nak=0.001,storm=10,reset=1e-4,jitter=2,seed=1" */
+static int  faultParse(char *spec)
+{
+char    *item, *value;
+long    seed = 1;
+
+    for(item = strtok(spec, ","); item; item = strtok(NULL, ",")){
+        if((value = strchr(item, '=')) == NULL)
+            return -1;
+        *value++ = 0;
+        if(strcmp(item, "crc") == 0)
+            fault.crc = atof(value);
+        else if(strcmp(item, "ack") == 0)
+            fault.ack = atof(value);
+        else if(strcmp(item, "nak") == 0)
+            fault.nak = atof(value);
+        else if(strcmp(item, "storm") == 0)
+            fault.storm = atoi(value);
+        else if(strcmp(item, "reset") == 0)
+            fault.reset = atof(value);
+        else if(strcmp(item, "jitter") == 0)
+            fault.jitter = atof(value);
+        else if(strcmp(item, "seed") == 0)
+            seed = atol(value);
+        else
+            return -1;
+    }
+    srand48(seed);
+    return 0;
+}
+
+static uint8_t  crc5(unsigned v, int bits)
+{
+uint8_t crc = 0x1f;
+
+    while(bits--){
+        crc = ((v ^ crc) & 1) ? (crc >> 1) ^ 0x14 : crc >> 1;
+        v >>= 1;
+    }
+    return ~crc & 0x1f;
+}
+
+static uint16_t crc16(const uint8_t *data, int len)
+{
+uint16_t    crc = 0xffff;
+int         i;
+
+    while(len--){
+        crc ^= *data++;
+        for(i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+    }
+    return ~crc;
+}
+
+static void sendToken(uint8_t pid, uint8_t addr, uint8_t ep)
+{
+unsigned    v = addr | ep << 7;
+uint8_t     p[3];
+
+    v |= crc5(v, 11) << 11;
+    p[0] = pid;
+    p[1] = v;
+    p[2] = v >> 8;
+    wireSend(p, 3);
+}
+
+static void sendData(uint8_t pid, const uint8_t *data, int len)
+{
+uint8_t     p[3 + 64];
+uint16_t    crc = crc16(data, len);
+
+    p[0] = pid;
+    memcpy(p + 1, data, len);
+    p[len + 1] = crc;
+    p[len + 2] = crc >> 8;
+    if((dataCorrupted = faultChance(fault.crc)) != 0){
+        p[1 + lrand48() % (len + 2)] ^= 1 << (lrand48() % 8);
+        faultStats.crcOut++;
+    }
+    wireSend(p, len + 3);
+}
+
+static void sendHandshake(uint8_t pid)
+{
+    wireSend(&pid, 1);
+}
+
+static int  handshake(void)
+{
+uint8_t p[4];
+int     n = wireReceive(p, sizeof(p));
+
+    if(n == WIRE_NONE){
+        usbStats.timeouts++;
+        return USB_TIMEOUT;
+    }
+    if(n != 1){
+        usbStats.errors++;
+        return USB_ERROR;
+    }
+    if(p[0] == PID_ACK)
+        return 0;
+    if(p[0] == PID_NAK){
+        usbStats.naks++;
+        return USB_NAK;
+    }
+    if(p[0] == PID_STALL)
+        return USB_STALL;
+    usbStats.errors++;
+    return USB_ERROR;
+}
+
+static int  usbSetup(uint8_t addr, const uint8_t *setup)
+{
+    usbStats.transactions++;
+    sendToken(PID_SETUP, addr, 0);
+    sendData(PID_DATA0, setup, 8);
+    return handshake();
+}
+
+static int  usbOut(uint8_t addr, uint8_t ep, uint8_t *toggle, const uint8_t *data, int len)
+{
+int     r;
+
+    usbStats.transactions++;
+    sendToken(PID_OUT, addr, ep);
+    sendData(*toggle ? PID_DATA1 : PID_DATA0, data, len);
+    if((r = handshake()) == 0){
+        if(dataCorrupted)
+            faultStats.crcOutAcked++;
+        if(faultChance(fault.ack)){     /* sent again with the same toggle */
+            faultStats.ackOut++;
+            usbStats.timeouts++;
+            return USB_TIMEOUT;
+        }
+        *toggle ^= 1;
+    }
+    return r;
+}
+
+static int  usbIn(uint8_t addr, uint8_t ep, uint8_t *toggle, uint8_t *data, int max)
+{
+uint8_t p[1 + 64 + 2];
+int     n;
+
+    usbStats.transactions++;
+    sendToken(PID_IN, addr, ep);
+    n = wireReceive(p, max + 3);
+    if(n == WIRE_NONE){
+        usbStats.timeouts++;
+        return USB_TIMEOUT;
+    }
+    if(n == 1 && p[0] == PID_NAK){
+        usbStats.naks++;
+        return USB_NAK;
+    }
+    if(n == 1 && p[0] == PID_STALL)
+        return USB_STALL;
+    if(n < 3 || (p[0] != PID_DATA0 && p[0] != PID_DATA1)
+            || crc16(p + 1, n - 3) != (p[n - 2] | p[n - 1] << 8)){
+        usbStats.errors++;
+        return USB_ERROR;   /* no handshake, the device sends it again */
+    }
+    if(faultChance(fault.crc)){     /* as above, noise on the way to the host */
+        faultStats.crcIn++;
+        usbStats.errors++;
+        return USB_ERROR;
+    }
+    if(faultChance(fault.ack))
+        faultStats.ackIn++;
+    else
+        sendHandshake(PID_ACK);
+    if((p[0] == PID_DATA1) != *toggle){
+        usbStats.duplicates++;
+        return USB_DUPLICATE;
+    }
+    *toggle ^= 1;
+    memcpy(data, p + 1, n - 3);
+    return n - 3;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ptys and the UART peer                                                    */
+/* ------------------------------------------------------------------------- */
+
+typedef struct pty {
+    int         master, slave;
+    const char  *name;
+    char        link[256];
+    uint8_t     in[64];         /* read from the pty, not yet consumed */
+    int         inLen, inPos;
+    uint8_t     out[4096];      /* waiting for the pty to accept it */
+    int         outLen;
+    unsigned long dropped;
+} pty_t;
+
+static pty_t    usbPty, uartPty;
+
+static void ptyOpen(pty_t *p, const char *linkDir, const char *linkName)
+{
+struct termios  t;
+
+    if((p->master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0
+            || grantpt(p->master) < 0 || unlockpt(p->master) < 0){
+        perror("posix_openpt");
+        exit(1);
+    }
+    p->name = strdup(ptsname(p->master));
+    /* keep the slave open, the master reads EIO when the last user closes */
+    if((p->slave = open(p->name, O_RDWR | O_NOCTTY)) < 0){
+        perror(p->name);
+        exit(1);
+    }
+    tcgetattr(p->slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(p->slave, TCSANOW, &t);
+    if(linkDir){
+        snprintf(p->link, sizeof(p->link), "%s/%s", linkDir, linkName);
+        unlink(p->link);
+        if(symlink(p->name, p->link) < 0)
+            perror(p->link);
+    }
+}
+
+static void ptyClose(pty_t *p)
+{
+    if(p->link[0])
+        unlink(p->link);
+}
+
+/* Returns the number of buffered input bytes, reading more if empty. */
+static int  ptyInput(pty_t *p)
+{
+int     n;
+
+    if(p->inPos >= p->inLen){
+        p->inPos = p->inLen = 0;
+        if((n = read(p->master, p->in, sizeof(p->in))) > 0)
+            p->inLen = n;
+    }
+    return p->inLen - p->inPos;
+}
+
+static void ptyFlush(pty_t *p)
+{
+int     n;
+
+    if(p->outLen && (n = write(p->master, p->out, p->outLen)) > 0){
+        memmove(p->out, p->out + n, p->outLen - n);
+        p->outLen -= n;
+    }
+}
+
+static int  ptyRoom(pty_t *p)
+{
+    return sizeof(p->out) - p->outLen;
+}
+
+static void ptyPut(pty_t *p, const uint8_t *data, int len)
+{
+    if(len > ptyRoom(p)){
+        p->dropped += len - ptyRoom(p);
+        len = ptyRoom(p);
+    }
+    memcpy(p->out + p->outLen, data, len);
+    p->outLen += len;
+}
+
+/* line coding as sent with SET_LINE_CODING */
+static struct {
+    uint32_t    baud;
+    uint8_t     stop, parity, bits;
+} coding;
+
+/* Reads the settings of the USB pty, returns 1 if they changed. */
+static int  ptyCoding(void)
+{
+struct termios2 t;
+uint32_t        baud;
+uint8_t         stop, parity, bits;
+
+    if(ioctl(usbPty.master, TCGETS2, &t) < 0)
+        return 0;
+    baud = t.c_ospeed;
+    stop = t.c_cflag & CSTOPB ? 2 : 0;
+    parity = !(t.c_cflag & PARENB) ? 0 : t.c_cflag & PARODD ? 1 : 2;
+    switch(t.c_cflag & CSIZE){
+    case CS5: bits = 5; break;
+    case CS6: bits = 6; break;
+    case CS7: bits = 7; break;
+    default: bits = 8; break;
+    }
+    if(baud == coding.baud && stop == coding.stop && parity == coding.parity && bits == coding.bits)
+        return 0;
+    coding.baud = baud;
+    coding.stop = stop;
+    coding.parity = parity;
+    coding.bits = bits;
+    return 1;
+}
+
+/* UART peer on the simulated USART */
+static avr_irq_t    *uartInIrq;
+static int          uartXon = 1;
+
+static void uartOutNotify(avr_irq_t *irq, uint32_t value, void *param)
+{
+uint8_t c = value;
+
+    ptyPut(&uartPty, &c, 1);
+}
+
+static void uartXonNotify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    uartXon = 1;
+}
+
+static void uartXoffNotify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    uartXon = 0;
+}
+
+/* UART peer on pins, for the software UART of the ATtiny45/85. The bit time
+ * follows the line coding, the format is always 8N1.
+ */
+static avr_irq_t    *pinRxdIrq;
+static int          pinTxdLevel = 1, pinTxdBit = -1, pinRxdBusy;
+static uint16_t     pinTxdShift, pinRxdShift;
+
+static double   uartBitCycles(void)
+{
+    return (double)avr->frequency / (coding.baud ? coding.baud : 4800);
+}
+
+static avr_cycle_count_t pinTxdTimer(avr_t *a, avr_cycle_count_t when, void *param)
+{
+    if(pinTxdBit < 8){      /* data bits, LSB first */
+        pinTxdShift = pinTxdShift >> 1 | pinTxdLevel << 7;
+        pinTxdBit++;
+        return when + (avr_cycle_count_t)uartBitCycles();
+    }
+    if(pinTxdLevel){        /* valid stop bit */
+        uint8_t c = pinTxdShift;
+
+        ptyPut(&uartPty, &c, 1);
+    }
+    pinTxdBit = -1;
+    return 0;
+}
+
+static void pinTxdNotify(avr_irq_t *irq, uint32_t value, void *param)
+{
+    pinTxdLevel = value & 1;
+    if(!pinTxdLevel && pinTxdBit < 0){      /* start bit */
+        pinTxdBit = 0;
+        pinTxdShift = 0;
+        avr_cycle_timer_register(avr, (avr_cycle_count_t)(1.5 * uartBitCycles()), pinTxdTimer, NULL);
+    }
+}
+
+static avr_cycle_count_t pinRxdTimer(avr_t *a, avr_cycle_count_t when, void *param)
+{
+    if(pinRxdShift == 0){
+        pinRxdBusy = 0;
+        return 0;
+    }
+    avr_raise_irq(pinRxdIrq, pinRxdShift & 1);
+    pinRxdShift >>= 1;
+    return when + (avr_cycle_count_t)uartBitCycles();
+}
+
+static void pinRxdSend(uint8_t c)
+{
+    pinRxdShift = (0x300 | c) << 1;     /* start, 8 data, 2 stop bits */
+    pinRxdBusy = 1;
+    avr_cycle_timer_register(avr, 1, pinRxdTimer, NULL);
+}
+
+/* Moves the data between the UART peer pty and the AVR. */
+static void uartService(void)
+{
+    ptyFlush(&uartPty);
+    if(uartInIrq){
+        while(uartXon && ptyInput(&uartPty))
+            avr_raise_irq(uartInIrq, uartPty.in[uartPty.inPos++]);
+    }else if(pinRxdIrq && !pinRxdBusy && ptyInput(&uartPty)){
+        pinRxdSend(uartPty.in[uartPty.inPos++]);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* host controller                                                           */
+/* ------------------------------------------------------------------------- */
+
+static unsigned long    frameNumber;
+static int              perFrame = 1;       /* bulk transactions per frame */
+static volatile int     stopRequested;
+static avr_cycle_count_t stopCycle;         /* -t, 0 to run until a signal */
+
+static void frameNext(void)
+{
+long long   start = nextFrame;
+
+    if(fault.jitter > 0)
+        start += (long long)((drand48() * 2 - 1) * fault.jitter * avr->frequency / 1e6);
+    runUntil(start);
+    nextFrame += frameCycles;
+    frameNumber++;
+    if(stopCycle && avr->cycle >= stopCycle)
+        stopRequested = 1;
+    wireKeepAlive();
+    ptyFlush(&usbPty);
+    uartService();
+    if(realtime){
+        double  ahead = (double)avr->cycle / avr->frequency - (now() - wallStart);
+
+        if(ahead > 0)
+            usleep(ahead * 1e6);
+    }
+}
+
+/* Starts a new frame unless a transaction with len data bytes still fits. */
+static void frameBudget(int len)
+{
+    if(avr->cycle + (avr_cycle_count_t)((len + 16) * 10 * bitCycles) > nextFrame)
+        frameNext();
+}
+
+static uint8_t  devAddr, ep0Size = 8;
+
+/* Control transfer on EP0. Returns the number of data bytes or USB_*. */
+static int  control(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint8_t *data, uint16_t len)
+{
+uint8_t setup[8] = { type, request, value, value >> 8, index, index >> 8, len, len >> 8 };
+uint8_t buf[64], toggle;
+int     r, n, got = 0, tries = 0;
+
+    while((r = usbSetup(devAddr, setup)) != 0){
+        if(++tries > 1000)
+            return r;
+        frameBudget(8);
+    }
+    toggle = 1;
+    if(type & 0x80){
+        while(got < len){
+            frameBudget(ep0Size);
+            r = usbIn(devAddr, 0, &toggle, buf, ep0Size);
+            if(r == USB_STALL || (r < 0 && ++tries > 1000))
+                return r;
+            if(r < 0)
+                continue;
+            n = r < len - got ? r : len - got;
+            memcpy(data + got, buf, n);
+            got += n;
+            if(r < ep0Size)
+                break;
+        }
+        toggle = 1;
+        for(;;){
+            frameBudget(0);
+            if((r = usbOut(devAddr, 0, &toggle, NULL, 0)) == 0)
+                break;
+            if(r == USB_STALL || ++tries > 1000)
+                return r;
+        }
+    }else{
+        while(got < len){
+            n = len - got < ep0Size ? len - got : ep0Size;
+            frameBudget(n);
+            if((r = usbOut(devAddr, 0, &toggle, data + got, n)) == 0)
+                got += n;
+            else if(r == USB_STALL || ++tries > 1000)
+                return r;
+        }
+        toggle = 1;
+        for(;;){
+            frameBudget(0);
+            r = usbIn(devAddr, 0, &toggle, buf, ep0Size);
+            if(r >= 0 || r == USB_DUPLICATE)
+                break;
+            if(r == USB_STALL || ++tries > 1000)
+                return r;
+        }
+    }
+    return got;
+}
+
+static struct {
+    uint8_t     commIf;
+    uint8_t     in, inSize;
+    uint8_t     out, outSize;
+    uint8_t     intr, intrSize, interval;
+} cdc;
+
+static void enumFailed(const char *step, int r)
+{
+    fprintf(stderr, "cdcsim: enumeration failed at %s (%d)\n", step, r);
+    exit(1);
+}
+
+/* Resets the device, reads the descriptors and configures it. */
+static void enumerate(void)
+{
+uint8_t dev[18], cfg[255], *p;
+int     r, total, ifClass = 0, ifNum = 0;
+
+    wireReset(15);
+    nextFrame = avr->cycle + frameCycles;
+    for(r = 0; r < 20; r++)     /* reset recovery */
+        frameNext();
+    devAddr = 0;
+    if((r = control(0x80, 6, 0x100, 0, dev, 8)) < 8)
+        enumFailed("GET_DESCRIPTOR(device)", r);
+    ep0Size = dev[7];
+    if((r = control(0x00, 5, 1, 0, NULL, 0)) < 0)
+        enumFailed("SET_ADDRESS", r);
+    devAddr = 1;
+    frameNext();
+    if((r = control(0x80, 6, 0x100, 0, dev, 18)) < 18)
+        enumFailed("GET_DESCRIPTOR(device)", r);
+    if((r = control(0x80, 6, 0x200, 0, cfg, 9)) < 9)
+        enumFailed("GET_DESCRIPTOR(configuration)", r);
+    total = cfg[2] | cfg[3] << 8;
+    if(total > (int)sizeof(cfg))
+        total = sizeof(cfg);
+    if((r = control(0x80, 6, 0x200, 0, cfg, total)) < total)
+        enumFailed("GET_DESCRIPTOR(configuration)", r);
+
+    for(p = cfg; p + 2 <= cfg + total && p[0] >= 2; p += p[0]){
+        if(p[1] == 4){          /* interface */
+            ifNum = p[2];
+            ifClass = p[5];
+            if(ifClass == 2)
+                cdc.commIf = ifNum;
+        }else if(p[1] == 5){    /* endpoint */
+            if((p[3] & 3) == 3 && (p[2] & 0x80)){
+                cdc.intr = p[2] & 0x0f;
+                cdc.intrSize = p[4];
+                cdc.interval = p[6] ? p[6] : 1;
+            }else if((p[3] & 3) == 2 && (p[2] & 0x80)){
+                cdc.in = p[2] & 0x0f;
+                cdc.inSize = p[4];
+            }else if((p[3] & 3) == 2){
+                cdc.out = p[2] & 0x0f;
+                cdc.outSize = p[4];
+            }
+        }
+    }
+    if(!cdc.in || !cdc.out || cdc.inSize > 64 || cdc.outSize > 64)
+        enumFailed("finding the bulk endpoints", 0);
+    if((r = control(0x00, 9, cfg[5], 0, NULL, 0)) < 0)
+        enumFailed("SET_CONFIGURATION", r);
+    if(verbose)
+        fprintf(stderr, "cdcsim: %04x:%04x, bulk IN %d (%d), OUT %d (%d), interrupt IN %d every %d ms\n",
+                dev[8] | dev[9] << 8, dev[10] | dev[11] << 8, cdc.in, cdc.inSize,
+                cdc.out, cdc.outSize, cdc.intr, cdc.interval);
+}
+
+static void sendCoding(void)
+{
+uint8_t lc[7];
+
+    lc[0] = coding.baud;
+    lc[1] = coding.baud >> 8;
+    lc[2] = coding.baud >> 16;
+    lc[3] = coding.baud >> 24;
+    lc[4] = coding.stop;
+    lc[5] = coding.parity;
+    lc[6] = coding.bits;
+    if(control(0x21, 0x20, 0, cdc.commIf, lc, 7) < 0)
+        fprintf(stderr, "cdcsim: SET_LINE_CODING failed\n");
+    else if(verbose)
+        fprintf(stderr, "cdcsim: line coding %u %d%c%d\n", coding.baud, coding.bits,
+                "noe"[coding.parity % 3], coding.stop ? 2 : 1);
+}
+
+static void faultReport(void)
+{
+double  s = (double)(avr->cycle - faultStart) / avr->frequency;
+
+    fprintf(stderr, "cdcsim: faults in %.0f ms: %lu OUT CRC errors (%lu ACKed by the device), "
+            "%lu IN CRC errors, %lu+%lu ACKs lost (OUT/IN), %lu NAK storms, %lu bus resets\n",
+            s * 1000, faultStats.crcOut, faultStats.crcOutAcked, faultStats.crcIn,
+            faultStats.ackOut, faultStats.ackIn, faultStats.storms, faultStats.resets);
+    fprintf(stderr, "cdcsim: throughput %.0f B/s OUT, %.0f B/s IN", faultStats.bytesOut / s,
+            faultStats.bytesIn / s);
+    if(faultStats.recoveries)
+        fprintf(stderr, ", recovery after a reset %.1f ms on average, %.1f ms at most",
+                faultStats.recoveryMs / faultStats.recoveries, faultStats.recoveryMaxMs);
+    fputc('\n', stderr);
+}
+
+/* Records the time from a bus reset to the first bulk data after it. */
+static avr_cycle_count_t    resetCycle;
+
+static void recovered(void)
+{
+double  ms;
+
+    if(!resetCycle)
+        return;
+    ms = (avr->cycle - resetCycle) * 1000.0 / avr->frequency;
+    faultStats.recoveries++;
+    faultStats.recoveryMs += ms;
+    if(ms > faultStats.recoveryMaxMs)
+        faultStats.recoveryMaxMs = ms;
+    resetCycle = 0;
+}
+
+static void run(void)
+{
+uint8_t inToggle = 0, outToggle = 0, intrToggle = 0, buf[64];
+int     r, n, i, storm = 0;
+
+    ptyCoding();
+    sendCoding();
+    control(0x21, 0x22, 3, cdc.commIf, NULL, 0);    /* DTR, RTS */
+    faultActive = 1;
+    faultStart = avr->cycle;
+
+    while(!stopRequested){
+        frameNext();
+        if(faultChance(fault.reset)){
+            faultStats.resets++;
+            resetCycle = avr->cycle;
+            faultActive = 0;
+            enumerate();
+            inToggle = outToggle = intrToggle = 0;
+            sendCoding();
+            control(0x21, 0x22, 3, cdc.commIf, NULL, 0);
+            faultActive = 1;
+        }
+        if(frameNumber % 10 == 0 && ptyCoding())
+            sendCoding();
+        if(cdc.intr && frameNumber % cdc.interval == 0){
+            frameBudget(cdc.intrSize);
+            r = usbIn(devAddr, cdc.intr, &intrToggle, buf, cdc.intrSize);
+            if(r >= 10 && buf[1] == 0x20 && verbose)
+                fprintf(stderr, "cdcsim: SERIAL_STATE %02x\n", buf[8]);
+        }
+        for(i = 0; i < perFrame; i++){
+            if((n = ptyInput(&usbPty)) > 0){
+                if(n > cdc.outSize)
+                    n = cdc.outSize;
+                frameBudget(n);
+                if(usbOut(devAddr, cdc.out, &outToggle, usbPty.in + usbPty.inPos, n) == 0){
+                    usbPty.inPos += n;
+                    faultStats.bytesOut += n;
+                    recovered();
+                }
+            }
+            if(ptyRoom(&usbPty) >= cdc.inSize){     /* else leave it to flow control */
+                frameBudget(cdc.inSize);
+                if((r = usbIn(devAddr, cdc.in, &inToggle, buf, cdc.inSize)) > 0){
+                    ptyPut(&usbPty, buf, r);
+                    faultStats.bytesIn += r;
+                    recovered();
+                }
+            }
+        }
+        /* NAK storm: IN tokens back to back until the end of the frame */
+        if(!storm && faultChance(fault.nak)){
+            faultStats.storms++;
+            storm = fault.storm;
+        }
+        if(storm){
+            storm--;
+            while(ptyRoom(&usbPty) >= cdc.inSize
+                    && avr->cycle + (avr_cycle_count_t)((cdc.inSize + 16) * 10 * bitCycles) <= nextFrame){
+                if((r = usbIn(devAddr, cdc.in, &inToggle, buf, cdc.inSize)) > 0){
+                    ptyPut(&usbPty, buf, r);
+                    faultStats.bytesIn += r;
+                }
+            }
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void onSignal(int sig)
+{
+    stopRequested = 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: cdcsim [options] firmware.elf\n"
+        "  -m mcu    simavr MCU name, chosen from the file name otherwise\n"
+        "  -f hz     clock frequency\n"
+        "  -n count  bulk transactions per frame and direction (1)\n"
+        "  -l dir    create the symlinks dir/usb and dir/uart to the ptys\n"
+        "  -r        pace the simulation to real time\n"
+        "  -t ms     stop after this simulated time\n"
+        "  -F spec   inject faults, e.g. crc=0.01,ack=0.01,nak=0.001,storm=10,\n"
+        "            reset=0.0001,jitter=2,seed=1 (rates per packet or frame)\n"
+        "  -p        print a profile of the interrupts and the main loop at the end\n"
+        "  -w file   write the profile timeline to a VCD file\n"
+        "  -v        verbose\n"
+        "The names of the USB pty and of the UART pty are printed on stdout.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+elf_firmware_t      fw;
+const char          *mmcu = NULL, *linkDir = NULL, *vcdPath = NULL, *base;
+uint32_t            frequency = 0, stopMs = 0;
+avr_irq_t           *irq;
+int                 opt, i, profile = 0, faults = 0;
+
+    while((opt = getopt(argc, argv, "m:f:n:l:rt:F:pw:v")) != -1){
+        switch(opt){
+        case 'm': mmcu = optarg; break;
+        case 'f': frequency = atol(optarg); break;
+        case 'n': perFrame = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        case 'l': linkDir = optarg; break;
+        case 'r': realtime = 1; break;
+        case 't': stopMs = atol(optarg); break;
+        case 'F':
+            if(faultParse(optarg) < 0)
+                usage();
+            faults = 1;
+            break;
+        case 'p': profile = 1; break;
+        case 'w': vcdPath = optarg; profile = 1; break;
+        case 'v': verbose = 1; break;
+        default: usage();
+        }
+    }
+    if(argc - optind != 1)
+        usage();
+
+    base = strrchr(argv[optind], '/') ? strrchr(argv[optind], '/') + 1 : argv[optind];
+    for(i = 0; targets[i + 1].match && !strstr(base, targets[i].match); i++)
+        ;
+    tgt = targets[i];
+
+    memset(&fw, 0, sizeof(fw));
+    if(elf_read_firmware(argv[optind], &fw) != 0){
+        fprintf(stderr, "cdcsim: cannot read %s\n", argv[optind]);
+        return 1;
+    }
+    if(mmcu)
+        snprintf(fw.mmcu, sizeof(fw.mmcu), "%s", mmcu);
+    else if(!fw.mmcu[0])
+        snprintf(fw.mmcu, sizeof(fw.mmcu), "%s", tgt.mmcu);
+    if(frequency)
+        fw.frequency = frequency;
+    else if(!fw.frequency)
+        fw.frequency = tgt.frequency;
+    if((avr = avr_make_mcu_by_name(fw.mmcu)) == NULL){
+        fprintf(stderr, "cdcsim: unknown MCU %s\n", fw.mmcu);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &fw);
+    bitCycles = avr->frequency / LS_BITRATE;
+    frameCycles = avr->frequency / 1000;
+    symbolsLoad(argv[optind]);
+    if(vcdPath)
+        profOpenVcd(vcdPath);
+
+    /* USB pins */
+    usbMask = 1 << tgt.dplus | 1 << tgt.dminus;
+    dplusIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.usbPort), tgt.dplus);
+    dminusIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.usbPort), tgt.dminus);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.usbPort), IOPORT_IRQ_REG_PORT),
+                            portNotify, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.usbPort), IOPORT_IRQ_DIRECTION_ALL),
+                            ddrNotify, NULL);
+    hostDrive(J);
+    if(tgt.ctsPort)
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.ctsPort), tgt.cts), 1);
+
+    /* UART peer */
+    ptyOpen(&usbPty, linkDir, "usb");
+    ptyOpen(&uartPty, linkDir, "uart");
+    if((irq = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT)) != NULL){
+        uint32_t    flags = 0;
+
+        avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+        flags &= ~AVR_UART_FLAG_STDIO;
+        avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+        avr_irq_register_notify(irq, uartOutNotify, NULL);
+        uartInIrq = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON),
+                                uartXonNotify, NULL);
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF),
+                                uartXoffNotify, NULL);
+    }else if(tgt.uartPort){
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.uartPort), tgt.txd),
+                                pinTxdNotify, NULL);
+        pinRxdIrq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(tgt.uartPort), tgt.rxd);
+        avr_raise_irq(pinRxdIrq, 1);
+    }
+    printf("%s\n%s\n", usbPty.name, uartPty.name);
+    fflush(stdout);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    wallStart = now();
+
+    /* the firmware may hold SE0 for a while after reset (usbDeviceDisconnect) */
+    runUntil(avr->cycle + avr->frequency / 10);
+    for(i = 0; i < 1000 && (devDdr & usbMask); i++)
+        runUntil(avr->cycle + frameCycles);
+    enumerate();
+    if(stopMs)
+        stopCycle = avr->cycle + (avr_cycle_count_t)stopMs * frameCycles;
+    if(profile)
+        profBegin();     /* the data phase only, not the enumeration */
+    run();
+    if(profiling)
+        profReport(coding.baud);
+    if(vcd)
+        fclose(vcd);
+    if(faults)
+        faultReport();
+
+    if(verbose)
+        fprintf(stderr, "cdcsim: %lu frames, %lu transactions, %lu NAK, %lu timeouts, %lu errors, "
+                "%lu duplicates, %lu+%lu bytes dropped on the ptys\n",
+                frameNumber, usbStats.transactions, usbStats.naks, usbStats.timeouts,
+                usbStats.errors, usbStats.duplicates, usbPty.dropped, uartPty.dropped);
+    ptyClose(&usbPty);
+    ptyClose(&uartPty);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* Name: lzcomp.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Host side of the code of the compressed mode (COMP_MODE, see vendor.h
+    and mega48/comp.h), shared by cdcbench and cdcmodel. The encoder tries
+    every distance in the window, not only the hash candidate like the
+    firmware, so it finds the longest match. Both directions keep their
+    own lzCodec_t, which must start at the same time as the device side.
+    When the decoder of bulk IN has passed a sync (lzCodec_t.syncs), the
+    device has lost OUT code: the encoder starts over with lzSync().
+*/
+
+#ifndef __lzcomp_h_included__
+#define __lzcomp_h_included__
+
+#include <stdint.h>
+#include <string.h>
+#include "../mega48/vendor.h"
+
+/* output room of lzDecode() for n bytes of code */
+#define LZ_DECODE_MAX(n)    ((n) / 2 * COMP_MAX_MATCH + COMP_MAX_MATCH)
+
+/* lzCodec_t.wait: the decoder drops the code up to the next sync, as
+ * comp.c does after it lost an OUT packet (cdcmodel)
+ */
+#define LZ_ALIGN    1           /* drops up to a byte < COMP_MATCH */
+#define LZ_WAIT     2           /* drops tokens up to a sync */
+
+typedef struct lzCodec {
+    uint8_t     hist[COMP_WINDOW];
+    unsigned    pos;            /* bytes coded, wraps with the window */
+    int         token;          /* decoder: first byte of a 2 byte token */
+    int         wait;           /* decoder: 0, LZ_ALIGN, LZ_WAIT */
+    unsigned    syncs;          /* decoder: syncs passed */
+} lzCodec_t;
+
+static void lzInit(lzCodec_t *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+static void lzPut(lzCodec_t *c, uint8_t b)
+{
+    c->hist[c->pos++ % COMP_WINDOW] = b;
+}
+
+/* Starts the encoder over, writes COMP_SYNC_OUT bytes of sync to out and
+ * returns their number.
+ */
+static long lzSync(lzCodec_t *c, uint8_t *out)
+{
+int     i;
+
+    memset(c->hist, 0, sizeof(c->hist));
+    c->pos = 0;
+    for(i = 0; i < COMP_SYNC_OUT; i += 2){
+        out[i] = COMP_ESCAPE;
+        out[i + 1] = COMP_SYNC;
+    }
+    return COMP_SYNC_OUT;
+}
+
+/* Codes n bytes into out, which needs room for 2 * n. Returns the length
+ * of the code.
+ */
+static long lzEncode(lzCodec_t *c, const uint8_t *in, long n, uint8_t *out)
+{
+long    i = 0, o = 0;
+int     d, len, best, dist;
+uint8_t h;
+
+    while(i < n){
+        best = dist = 0;
+        for(d = 1; d <= COMP_WINDOW; d++){
+            for(len = 0; len < COMP_MAX_MATCH && i + len < n; len++){
+                h = len < d ? c->hist[(c->pos - d + len) % COMP_WINDOW] : in[i + len - d];
+                if(h != in[i + len])
+                    break;
+            }
+            if(len > best){
+                best = len;
+                dist = d;
+            }
+        }
+        if(best >= COMP_MIN_MATCH){
+            out[o++] = COMP_MATCH + best - COMP_MIN_MATCH;
+            out[o++] = dist - 1;
+        }else{
+            best = 1;
+            if(in[i] >= COMP_MATCH)
+                out[o++] = COMP_ESCAPE;
+            out[o++] = in[i];
+        }
+        while(best-- > 0)
+            lzPut(c, in[i++]);
+    }
+    return o;
+}
+
+/* Decodes n bytes of code into out (LZ_DECODE_MAX(n) bytes), a token may
+ * continue in the next call. Returns the number of bytes decoded.
+ */
+static long lzDecode(lzCodec_t *c, const uint8_t *in, long n, uint8_t *out)
+{
+long    i, o = 0;
+int     k;
+uint8_t b;
+
+    for(i = 0; i < n; i++){
+        b = in[i];
+        if(c->wait == LZ_ALIGN){
+            if(b < COMP_MATCH)
+                c->wait = LZ_WAIT;
+        }else if(c->wait && c->token != COMP_ESCAPE){
+            c->token = c->token || b < COMP_MATCH ? 0 : b;
+        }else if(c->token == COMP_ESCAPE && b == COMP_SYNC){
+            memset(c->hist, 0, sizeof(c->hist));
+            c->pos = 0;
+            c->wait = 0;
+            c->token = 0;
+            c->syncs++;
+        }else if(c->token == COMP_ESCAPE){
+            if(!c->wait){
+                out[o++] = b;
+                lzPut(c, b);
+            }
+            c->token = 0;
+        }else if(c->token){
+            for(k = c->token - COMP_MATCH + COMP_MIN_MATCH; k > 0; k--){
+                out[o] = c->hist[(c->pos - b - 1) % COMP_WINDOW];
+                lzPut(c, out[o++]);
+            }
+            c->token = 0;
+        }else if(b < COMP_MATCH){
+            out[o++] = b;
+            lzPut(c, b);
+        }else{
+            c->token = b;
+        }
+    }
+    return o;
+}
+
+#endif  /*  __lzcomp_h_included__  */
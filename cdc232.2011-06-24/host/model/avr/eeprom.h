@@ -0,0 +1,29 @@
+/* Name: eeprom.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/* Host replacement of <avr/eeprom.h> for cdcmodel: 256 bytes in RAM,
+ * erased (0xff) at start.
+ */
+
+#ifndef __mock_eeprom_h_included__
+#define __mock_eeprom_h_included__
+
+#include <stdint.h>
+#include <string.h>
+
+extern uint8_t  mockEeprom[256];
+
+#define EEMEM
+#define eeprom_read_byte(p)             (mockEeprom[(uintptr_t)(p) & 0xff])
+#define eeprom_write_byte(p, v)         (mockEeprom[(uintptr_t)(p) & 0xff] = (v))
+#define eeprom_update_byte(p, v)        eeprom_write_byte(p, v)
+#define eeprom_read_block(d, s, n)      memcpy((d), &mockEeprom[(uintptr_t)(s) & 0xff], (n))
+#define eeprom_write_block(s, d, n)     memcpy(&mockEeprom[(uintptr_t)(d) & 0xff], (s), (n))
+#define eeprom_update_block(s, d, n)    eeprom_write_block(s, d, n)
+#define eeprom_busy_wait()
+
+#endif
@@ -0,0 +1,29 @@
+/* Name: interrupt.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/* Host replacement of <avr/interrupt.h> for cdcmodel. The USB interrupt
+ * is taken by the model, sei() is a point where it may happen. The other
+ * interrupt routines of the firmware are called by the model as functions.
+ */
+
+#ifndef __mock_interrupt_h_included__
+#define __mock_interrupt_h_included__
+
+extern void mockSei(void);
+extern void mockCli(void);
+
+#define sei()   mockSei()
+#define cli()   mockCli()
+
+#define ISR(vector, ...)    void vector(void); void vector(void) __VA_ARGS__
+#define ISR_NAKED
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_ALIASOF(v)      __attribute__((alias(#v)))
+#define reti()
+
+#endif
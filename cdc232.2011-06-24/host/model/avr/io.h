@@ -0,0 +1,206 @@
+/* Name: io.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Host replacement of <avr/io.h> for cdcmodel, the ATmega48 subset used
+    by the firmware. Every register access goes through mockIo(), which
+    lets the model time pass, run the USART and take the USB interrupt.
+    Registers are ints so that the model can tell writes from reads of
+    UDR0 and UCSR0A, see cdcmodel.c.
+*/
+
+#ifndef __mock_io_h_included__
+#define __mock_io_h_included__
+
+#include <stdint.h>
+
+#define __AVR_ATmega48__    1
+
+/* uart.h defaults ulong to unsigned long, which has 64 bits here */
+#define ulong   uint32_t
+
+#define MOCK_REGS(X) \
+    X(PORTB) X(PINB) X(DDRB) X(PORTC) X(PINC) X(DDRC) X(PORTD) X(PIND) X(DDRD) \
+    X(MCUSR) X(MCUCR) X(SREG) X(SMCR) X(PRR) X(ACSR) X(SPL) X(SPH) \
+    X(EIMSK) X(EIFR) X(EICRA) X(PCICR) X(PCIFR) X(PCMSK0) X(PCMSK1) X(PCMSK2) \
+    X(UCSR0A) X(UCSR0B) X(UCSR0C) X(UDR0) X(UBRR0L) X(UBRR0H) \
+    X(GPIOR0) X(GPIOR1) X(GPIOR2) \
+    X(TCCR0A) X(TCCR0B) X(TCNT0) X(OCR0A) X(TIFR0) X(TIMSK0) \
+    X(TCCR1A) X(TCCR1B) X(TCCR1C) X(TCNT1) X(OCR1A) X(OCR1B) X(ICR1) X(TIFR1) X(TIMSK1) \
+    X(TCCR2A) X(TCCR2B) X(TCNT2) X(OCR2A) X(TIFR2) X(TIMSK2) \
+    X(EEARL) X(EEARH) X(EEDR) X(EECR) X(WDTCSR) X(OSCCAL)
+
+#define MOCK_ENUM(r)    MOCK_##r,
+enum { MOCK_REGS(MOCK_ENUM) MOCK_NREGS };
+#undef MOCK_ENUM
+
+extern volatile int *mockIo(int reg);
+
+#define MOCK_REG(r)     (*mockIo(MOCK_##r))
+
+#define PORTB   MOCK_REG(PORTB)
+#define PINB    MOCK_REG(PINB)
+#define DDRB    MOCK_REG(DDRB)
+#define PORTC   MOCK_REG(PORTC)
+#define PINC    MOCK_REG(PINC)
+#define DDRC    MOCK_REG(DDRC)
+#define PORTD   MOCK_REG(PORTD)
+#define PIND    MOCK_REG(PIND)
+#define DDRD    MOCK_REG(DDRD)
+#define MCUSR   MOCK_REG(MCUSR)
+#define MCUCR   MOCK_REG(MCUCR)
+#define SREG    MOCK_REG(SREG)
+#define SMCR    MOCK_REG(SMCR)
+#define PRR     MOCK_REG(PRR)
+#define ACSR    MOCK_REG(ACSR)
+#define SPL     MOCK_REG(SPL)
+#define SPH     MOCK_REG(SPH)
+#define EIMSK   MOCK_REG(EIMSK)
+#define EIFR    MOCK_REG(EIFR)
+#define EICRA   MOCK_REG(EICRA)
+#define PCICR   MOCK_REG(PCICR)
+#define PCIFR   MOCK_REG(PCIFR)
+#define PCMSK0  MOCK_REG(PCMSK0)
+#define PCMSK1  MOCK_REG(PCMSK1)
+#define PCMSK2  MOCK_REG(PCMSK2)
+#define UCSR0A  MOCK_REG(UCSR0A)
+#define UCSR0B  MOCK_REG(UCSR0B)
+#define UCSR0C  MOCK_REG(UCSR0C)
+#define UDR0    MOCK_REG(UDR0)
+#define UBRR0L  MOCK_REG(UBRR0L)
+#define UBRR0H  MOCK_REG(UBRR0H)
+#define GPIOR0  MOCK_REG(GPIOR0)
+#define GPIOR1  MOCK_REG(GPIOR1)
+#define GPIOR2  MOCK_REG(GPIOR2)
+#define TCCR0A  MOCK_REG(TCCR0A)
+#define TCCR0B  MOCK_REG(TCCR0B)
+#define TCNT0   MOCK_REG(TCNT0)
+#define OCR0A   MOCK_REG(OCR0A)
+#define TIFR0   MOCK_REG(TIFR0)
+#define TIMSK0  MOCK_REG(TIMSK0)
+#define TCCR1A  MOCK_REG(TCCR1A)
+#define TCCR1B  MOCK_REG(TCCR1B)
+#define TCCR1C  MOCK_REG(TCCR1C)
+#define TCNT1   MOCK_REG(TCNT1)
+#define OCR1A   MOCK_REG(OCR1A)
+#define OCR1B   MOCK_REG(OCR1B)
+#define ICR1    MOCK_REG(ICR1)
+#define TIFR1   MOCK_REG(TIFR1)
+#define TIMSK1  MOCK_REG(TIMSK1)
+#define TCCR2A  MOCK_REG(TCCR2A)
+#define TCCR2B  MOCK_REG(TCCR2B)
+#define TCNT2   MOCK_REG(TCNT2)
+#define OCR2A   MOCK_REG(OCR2A)
+#define TIFR2   MOCK_REG(TIFR2)
+#define TIMSK2  MOCK_REG(TIMSK2)
+#define EEARL   MOCK_REG(EEARL)
+#define EEARH   MOCK_REG(EEARH)
+#define EEDR    MOCK_REG(EEDR)
+#define EECR    MOCK_REG(EECR)
+#define WDTCSR  MOCK_REG(WDTCSR)
+#define OSCCAL  MOCK_REG(OSCCAL)
+
+#define _SFR_IO_ADDR(x)     0
+#define _BV(x)              (1 << (x))
+
+#ifndef RAMEND  /* ATmega48, -DRAMEND=0x4ff for the options that need 1KB */
+#define RAMEND  0x2ff
+#endif
+#define E2END   0xff
+
+/* bits */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PORF    0
+#define EXTRF   1
+#define BORF    2
+#define WDRF    3
+#define INT0    0
+#define INT1    1
+#define INTF0   0
+#define INTF1   1
+#define ISC00   0
+#define ISC01   1
+#define ISC10   2
+#define ISC11   3
+#define PCIE0   0
+#define PCIE1   1
+#define PCIE2   2
+#define PCIF2   2
+#define PCINT8  0
+#define PCINT9  1
+#define PCINT16 0
+#define MPCM0   0
+#define U2X0    1
+#define UPE0    2
+#define DOR0    3
+#define FE0     4
+#define UDRE0   5
+#define TXC0    6
+#define RXC0    7
+#define TXB80   0
+#define RXB80   1
+#define UCSZ02  2
+#define TXEN0   3
+#define RXEN0   4
+#define UDRIE0  5
+#define TXCIE0  6
+#define RXCIE0  7
+#define UCPOL0  0
+#define UCSZ00  1
+#define UCSZ01  2
+#define USBS0   3
+#define UPM00   4
+#define UPM01   5
+#define UMSEL00 6
+#define UMSEL01 7
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define WGM01   1
+#define OCIE0A  1
+#define OCF0A   1
+#define TOV0    0
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define ICES1   6
+#define ICNC1   7
+#define TOV1    0
+#define OCF1A   1
+#define OCF1B   2
+#define ICF1    5
+#define OCIE1A  1
+#define OCIE1B  2
+#define ICIE1   5
+#define COM1A0  6
+#define COM1A1  7
+#define FOC1A   7
+#define CS20    0
+#define CS21    1
+#define CS22    2
+#define WGM21   1
+#define OCF2A   1
+#define OCIE2A  1
+#define TOV2    0
+#define SE      0
+#define SM0     1
+#define SM1     2
+#define SM2     3
+#define EERE    0
+#define EEPE    1
+#define EEMPE   2
+#define EERIE   3
+
+#endif  /* __mock_io_h_included__ */
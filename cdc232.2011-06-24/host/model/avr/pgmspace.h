@@ -0,0 +1,23 @@
+/* Name: pgmspace.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/* Host replacement of <avr/pgmspace.h> for cdcmodel: flash is just memory. */
+
+#ifndef __mock_pgmspace_h_included__
+#define __mock_pgmspace_h_included__
+
+#include <string.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const unsigned char *)(addr))
+#define pgm_read_word(addr)     (*(const unsigned short *)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *)(addr))     /* ulong is uint32_t */
+#define memcpy_P                memcpy
+
+#endif
@@ -0,0 +1,25 @@
+/* Name: sleep.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/* Host replacement of <avr/sleep.h> for cdcmodel. sleep_cpu() lets model
+ * time pass until the next event.
+ */
+
+#ifndef __mock_sleep_h_included__
+#define __mock_sleep_h_included__
+
+extern void mockSleep(void);
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_PWR_DOWN     2
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()             mockSleep()
+#define sleep_mode()            mockSleep()
+
+#endif
@@ -0,0 +1,26 @@
+/* Name: wdt.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/* Host replacement of <avr/wdt.h> for cdcmodel. wdt_reset() counts the
+ * main loop iterations, a stuck main loop is reported by the model.
+ */
+
+#ifndef __mock_wdt_h_included__
+#define __mock_wdt_h_included__
+
+extern void mockWdtReset(void);
+
+#define WDTO_15MS   0
+#define WDTO_250MS  4
+#define WDTO_1S     6
+#define WDTO_2S     7
+
+#define wdt_reset()     mockWdtReset()
+#define wdt_enable(t)
+#define wdt_disable()
+
+#endif
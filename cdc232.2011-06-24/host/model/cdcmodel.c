@@ -0,0 +1,2625 @@
+/* Name: cdcmodel.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/*
+General Description:
+    Host build of the ATmega firmware for protocol level checks and
+    benchmarks at native speed. main.c, uart.c, stats.c, bench.c and
+    usbdrv.c are compiled with gcc against the headers in this directory.
+    The firmware runs in a coroutine, and every access to an I/O register
+    is a point where model time passes (CYCLES_PER_ACCESS) and where the
+    host may take the USB interrupt. The interrupt is a C model of the
+    contract of the assembler module (asmcommon.inc): tokens and data
+    packets go to usbRxBuf/usbRxLen/usbRxToken, IN tokens are answered from
+    usbTxBuf/usbTxLen and usbTxStatus1/3. The line state is not modelled,
+    except for bus reset.
+
+    The USART is a model of the ATmega one: holding register and shift
+    register on the TX side, a 2 byte FIFO and the receive shift register
+    with overrun on the RX side, frame times from UBRR0, U2X0 and UCSR0C.
+    The peer behind it sends random data as long as RTS is high and
+    receives what the device sends.
+
+    A run is a random sequence of bulk OUT, bulk IN, interrupt IN and CDC
+    class requests with random gaps between them, with these checks:
+      - every byte OUT on USB leaves the USART once, in order, with the
+        UBRR0/UCSR0C of the line coding that was set when it was sent, and
+        the coding does not change while a byte is shifted out
+      - every byte the USART received arrives on bulk IN once, in order
+      - no byte is dropped while the device ACKs OUT packets
+      - DATA0/DATA1 alternate on the IN endpoints, CRCs are correct
+      - GET_LINE_CODING returns the coding set before
+      - the main loop runs (watchdog)
+    With EP0_DATA the host also turns the data on control transfers on and
+    off, reads rx_buf and fills tx_buf with VENDOR_RQ_DATA within the room
+    it was told, and checks that 255 bytes are stalled. With COMP_MODE
+    (-DRAMEND=0x4ff) the mode is on for the whole run, the data is text,
+    the host codes and decodes it with lzcomp.h, and the device counters
+    must match the host; after an OUT packet lost to -f the text up to the
+    sync that the host sends back is lost. With CAPTURE_MODE the
+    mode is on for the whole run, bulk IN is decoded with capdec.h, the
+    time of every byte must be within CAP_LATE_MAX of the time the USART
+    received it, and no byte may be lost for want of room in rx_buf. With AUTO_BAUD the
+    run starts with detections of the rate of a peer that drives only the
+    RXD pin, for the pin change interrupt. With RS485_DE the peer waits
+    while DE is high, a frame of it is garbled when DE goes up during it,
+    every byte sent comes back as an echo, and DE must be high while a byte
+    is shifted out and go low after the hold time, within DE_LATE_MAX of
+    the last stop bit (twice that with a hold time); the host reads bulk IN
+    while the device ignores a SETUP. With
+    MPCM_MODE the run is in the 9 bit mode, half of the seeds with the
+    address filter: the USART has TXB80, RXB80 and MPCM0, OUT data has the
+    escapes of vendor.h, the host expects the frames and IN bytes that
+    mpcm.c makes of them, and the device counters must match the host;
+    the peer sends data right after an address, which MPCM0 must not drop
+    where a frame outlasts MPCM_LATENCY.
+    -f corrupts bulk OUT packets after their CRC and loses the ACK of
+    others, so the host sends them again with the same toggle; usbPoll()
+    must drop exactly those copies (USB_CFG_CHECK_CRC_IN_POLL,
+    USB_CFG_DROP_DUPLICATES) and the data checks above still hold.
+    A failure prints the seed and the step, and the run is repeatable with
+    -s. -b runs the benchmarks instead: main loop iterations, register
+    accesses and host time per byte through the firmware, and the
+    throughput in model time for the ways hosts schedule the data
+    endpoints of the configuration descriptor (DATA_EP_INTERVAL): bulk once
+    per frame or back to back as the bus allows, interrupt every bInterval.
+
+    The interleavings are at register access granularity; C code between
+    two accesses runs atomically in the model, unlike on the AVR.
+*/
+
+#undef main
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "avr/io.h"
+#include "usbdrv.h"
+#include "uart.h"
+#include "vendor.h"
+#ifdef COMP_MODE
+#include "../lzcomp.h"
+#endif
+#ifdef CAPTURE_MODE
+#include "../capdec.h"
+#include "capture.h"
+#endif
+#ifdef AUTO_BAUD
+#include "autobaud.h"
+#endif
+#ifdef RS485_DE
+#include "rs485.h"
+#endif
+#ifdef MPCM_MODE
+#include "mpcm.h"
+#endif
+#if defined COMP_MODE && defined CAPTURE_MODE
+#error "COMP_MODE and CAPTURE_MODE exclude each other"
+#endif
+#if defined RS485_DE && defined CAPTURE_MODE
+#error "the model checks RS485_DE without CAPTURE_MODE"
+#endif
+#if defined MPCM_MODE && (defined COMP_MODE || defined CAPTURE_MODE || defined AUTO_BAUD)
+#error "the model checks MPCM_MODE without COMP_MODE, CAPTURE_MODE and AUTO_BAUD"
+#endif
+
+#define CYCLES_PER_ACCESS   20          /* model time per register access */
+#define BIT_CYCLES          (F_CPU / 1500000)   /* low-speed USB bit */
+#define FW_STACK            (256 * 1024)
+
+extern int  firmwareMain(void);
+
+/* usbdrv.c globals used by the assembler module */
+extern uchar            usbRxBuf[2*USB_BUFSIZE];
+extern uchar            usbInputBufOffset;
+extern uchar            usbDeviceAddr;
+extern uchar            usbNewDeviceAddr;
+extern uchar            usbCurrentTok;
+extern volatile uchar   usbTxLen;
+extern uchar            usbTxBuf[USB_BUFSIZE];
+#if USB_CFG_DROP_DUPLICATES
+extern uchar            usbOutToken[2];
+#endif
+
+static unsigned     seed = 1;
+static long         steps = 100000;
+static double       faultRate;          /* -f, per bulk OUT packet */
+static int          resetFlags = 1 << PORF;     /* MCUSR at the start, -w */
+static int          verbose;
+
+static unsigned long long   cycles;     /* model time */
+static unsigned long long   accesses;   /* register accesses */
+static unsigned long long   loops;      /* main loop iterations (wdt_reset) */
+static unsigned long long   lastWdt;
+static unsigned long long   yieldAt;    /* access count at which the host runs */
+static long                 step;
+
+static void fail(const char *fmt, ...)
+{
+va_list ap;
+
+    va_start(ap, fmt);
+    fprintf(stderr, "cdcmodel: seed %u step %ld cycle %llu: ", seed, step, cycles);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(1);
+}
+
+/* xorshift, independent of the C library for repeatable runs */
+static uint32_t rngState;
+
+static uint32_t rnd(void)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static int  rndRange(int lo, int hi)
+{
+    return lo + rnd() % (hi - lo + 1);
+}
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- FIFO ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define QUEUE_SIZE  65536
+
+typedef struct queue {
+    uint32_t    data[QUEUE_SIZE];
+    unsigned    head, tail;
+} queue_t;
+
+static void qPut(queue_t *q, uint32_t v)
+{
+    if(q->head - q->tail >= QUEUE_SIZE)
+        fail("model queue overflow");
+    q->data[q->head++ % QUEUE_SIZE] = v;
+}
+
+static int  qEmpty(queue_t *q)
+{
+    return q->head == q->tail;
+}
+
+static uint32_t qGet(queue_t *q)
+{
+    return q->data[q->tail++ % QUEUE_SIZE];
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Registers ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static int          regs[MOCK_NREGS];
+static int          lastReg = -1;
+
+/* UDR0, UCSR0A, PCIFR and TIFR2 are accessed through a slot holding a
+ * value which the firmware cannot write: bits 8 and up are a sequence
+ * number. If the slot still has it at the next access, the access was a
+ * read. A 1 written to a flag of PCIFR or TIFR2 clears it.
+ */
+static volatile int slot;
+static int          slotReg = -1, slotValue, slotSeq;
+
+static void usartWrite(int reg, int value);
+static void usartRead(void);
+static void usartFlush(void);
+static void usartRxb8(void);
+static int  usartStatus(void);
+static int  usartData(void);
+static void advance(unsigned long long c);
+static int  fwInterrupts(void);
+
+static ucontext_t   hostContext, fwContext;
+static int          inFirmware;
+static int          seiDelay;       /* the instruction after sei runs first */
+static int          woken;          /* host ran or interrupt taken since cli */
+
+static void commit(void)
+{
+    if(slotReg >= 0){
+        if(slot != slotValue && (slotReg == MOCK_PCIFR || slotReg == MOCK_TIFR2))
+            regs[slotReg] &= ~slot;
+        else if(slot != slotValue)
+            usartWrite(slotReg, slot & 0xff);
+        else if(slotReg == MOCK_UDR0)
+            usartRead();
+        slotReg = -1;
+    }
+    if(lastReg >= 0){
+        if(lastReg == MOCK_TCNT1 || lastReg == MOCK_OCR1A || lastReg == MOCK_OCR1B || lastReg == MOCK_ICR1)
+            regs[lastReg] &= 0xffff;
+        else
+            regs[lastReg] &= 0xff;
+        if(lastReg == MOCK_UCSR0B && !(regs[MOCK_UCSR0B] & (1 << RXEN0)))
+            usartFlush();
+        if(lastReg == MOCK_UCSR0B)
+            usartRxb8();
+        lastReg = -1;
+    }
+}
+
+static void tick(void)
+{
+    accesses++;
+    advance(CYCLES_PER_ACCESS);
+    if(!seiDelay && fwInterrupts())
+        woken = 1;
+    seiDelay = 0;
+    if(inFirmware && accesses >= yieldAt && (regs[MOCK_SREG] & 0x80)){
+        inFirmware = 0;
+        swapcontext(&fwContext, &hostContext);
+        woken = 1;
+    }
+}
+
+volatile int *mockIo(int reg)
+{
+    commit();
+    tick();
+    if(reg == MOCK_UDR0 || reg == MOCK_UCSR0A || reg == MOCK_PCIFR || reg == MOCK_TIFR2){
+        slotSeq = (slotSeq + 1) & 0x3fffff;
+        slotValue = ((slotSeq + 1) << 8)
+            | (reg == MOCK_UDR0 ? usartData() : reg == MOCK_UCSR0A ? usartStatus() : regs[reg]);
+        slot = slotValue;
+        slotReg = reg;
+        return &slot;
+    }
+    if(reg == MOCK_UCSR0B){
+        commit();       /* an interrupt in tick() wrote it, RXB80 is read only */
+        usartRxb8();
+    }
+    lastReg = reg;
+    return &regs[reg];
+}
+
+void mockSei(void)
+{
+    commit();
+    regs[MOCK_SREG] |= 0x80;
+    seiDelay = 1;
+    tick();
+}
+
+void mockCli(void)
+{
+    commit();
+    regs[MOCK_SREG] &= ~0x80;
+    woken = 0;
+}
+
+void mockWdtReset(void)
+{
+    commit();
+    loops++;
+    lastWdt = cycles;
+    tick();
+}
+
+void mockDelayUs(double us)
+{
+    commit();
+    advance((unsigned long long)(us * (F_CPU / 1000000.0)));
+    tick();
+}
+
+/* sleep_cpu() after sei(): ends at an interrupt that came after the cli() */
+void mockSleep(void)
+{
+    commit();
+    while(!woken && accesses < yieldAt && !fwInterrupts()){
+        accesses++;
+        advance(CYCLES_PER_ACCESS);
+    }
+    tick();
+}
+
+uint8_t     mockEeprom[256];
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------- CRC (asm replacement) ------------------------ */
+/* ------------------------------------------------------------------------- */
+
+#undef usbCrc16
+#undef usbCrc16Append
+
+static uint16_t crc16(const uint8_t *data, int len)
+{
+uint16_t    crc = 0xffff;
+int         i;
+
+    while(len--){
+        crc ^= *data++;
+        for(i = 0; i < 8; i++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xa001 : crc >> 1;
+    }
+    return crc ^ 0xffff;
+}
+
+/* usbdrv.h passes the pointer as unsigned; cdcmodel is linked with -no-pie
+ * so that the firmware's buffers are below 4 GB.
+ */
+unsigned    usbCrc16(unsigned data, uchar len)
+{
+    return crc16((uint8_t *)(uintptr_t)data, len);
+}
+
+unsigned    usbCrc16Append(unsigned data, uchar len)
+{
+uint8_t     *p = (uint8_t *)(uintptr_t)data;
+uint16_t    crc = crc16(p, len);
+
+    p[len] = crc;
+    p[len + 1] = crc >> 8;
+    return crc;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- USART --------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* the 2 byte receive FIFO, and the receive shift register that keeps a
+ * third frame until the FIFO has room; the next one is lost
+ */
+#define RX_FRAMES   3
+
+static struct {
+    int                 hold, holdFull;
+    int                 shift, shiftBusy, shiftUbrr, shiftCoding;
+    unsigned long long  shiftEnd;
+    int                 txc, u2x, mpcm;
+    int                 fifo[RX_FRAMES], fifoStatus[RX_FRAMES], fifoLen, overrun;
+    int                 fifoBytes[RX_FRAMES];   /* expected on bulk IN */
+    int                 fifoCounted[RX_FRAMES]; /* MPCM_COUNT_*, the counters it took */
+    unsigned long long  fifoAt[RX_FRAMES];      /* when RXC0 came up for it */
+    int                 collided;       /* the peer sent during the frame */
+} usart;
+
+static struct {
+    int                 on;             /* sends data */
+    int                 busy, data;
+    unsigned long long  arrival, next;
+    int                 gap;            /* max idle time in frames */
+    unsigned long       sent, lost;
+    int                 bitCycles;      /* 8N1 at a rate of its own, RXD only */
+    int                 collided;       /* DE went high during the frame */
+} peer;
+
+static queue_t      txExpected;         /* data | UBRR0 << 9 | coding() << 21 */
+static queue_t      rxExpected;         /* bytes the USART received */
+#ifdef CAPTURE_MODE
+static queue_t      rxArrival;          /* and when, in Timer1 ticks */
+#endif
+static unsigned long    txBytes, rxBytes;
+static int          overrunSeen;        /* DOR0 read, SERIAL_STATE not yet seen */
+#ifdef RS485_DE
+static unsigned long long   txEndAt;    /* last stop bit with nothing after it */
+static unsigned long long   deLateMin = ULLONG_MAX, deLateMax;  /* DE release after it */
+static unsigned long    echoBytes, collisions;
+#endif
+
+#define RX_ECHO     0x100               /* usartReceive(): the device's own frame */
+
+/* service latency in cycles for bench(): stop bit to the read of UDR0,
+ * ACK of a bulk OUT packet to the write of UDR0
+ */
+typedef struct latency {
+    unsigned long       n;
+    double              sum, squares;
+    unsigned long long  max;
+} latency_t;
+
+static int          latencyOn;
+static latency_t    rxLatency, txLatency;
+static unsigned long long   txAckAt;    /* 0: no packet waits for UDR0 */
+
+static void latencyAdd(latency_t *l, unsigned long long c)
+{
+    l->n++;
+    l->sum += c;
+    l->squares += (double)c * c;
+    if(c > l->max)
+        l->max = c;
+}
+
+#ifdef MPCM_MODE
+#define MPCM_COUNT_ADDR     1
+#define MPCM_COUNT_MATCH    2
+#define MPCM_COUNT_DROP     4
+
+/* mpcmIrq() clears MPCM0 before the frame after a matching address is in,
+ * unless two full size OUT transactions keep the firmware out for longer
+ */
+#define MPCM_LATENCY        (2 * (3*8+3 + 11*8+3 + 8+3) * BIT_CYCLES + 2 * (8 * BIT_CYCLES))
+
+/* the 9 bit mode as the host set it, and what mpcmRx() does with the
+ * frames in the order of the FIFO
+ */
+static struct {
+    int             flags, address, address2;
+    int             outState;       /* OUT escapes: 0, after 0xff, after 0xff 0x01 */
+    int             genEsc;         /* the generator of OUT data sent 0xff */
+    int             selected;
+    unsigned long   addresses, matched, dropped;
+} mpcm;
+#endif
+
+static int  ubrr(void)
+{
+    return ((regs[MOCK_UBRR0H] << 8) | regs[MOCK_UBRR0L]) & 0xfff;
+}
+
+static int  coding(void)
+{
+    /* UPM, USBS, UCSZ; bit 0 is UCSZ02 */
+    return (regs[MOCK_UCSR0C] & 0x3e) | ((regs[MOCK_UCSR0B] >> UCSZ02) & 1);
+}
+
+static unsigned long long frameCycles(int ubrrValue, int codingValue)
+{
+int     bits;
+
+    bits = 1 + 5 + ((codingValue >> UCSZ00) & 3) + (codingValue & 1) + 1;
+    if(codingValue & (1 << UPM01))
+        bits++;
+    if(codingValue & (1 << USBS0))
+        bits++;
+    return (unsigned long long)(ubrrValue + 1) * (usart.u2x ? 8 : 16) * bits;
+}
+
+static int  dataMask(int codingValue)
+{
+    return (1 << (5 + ((codingValue >> UCSZ00) & 3) + (codingValue & 1))) - 1;
+}
+
+static int  usartStatus(void)
+{
+int     s = usart.u2x | usart.mpcm;
+
+    if(usart.fifoLen)
+        s |= (1 << RXC0) | (usart.fifoStatus[0] & 0xff);
+    if(!usart.holdFull)
+        s |= 1 << UDRE0;
+    if(usart.txc)
+        s |= 1 << TXC0;
+    return s;
+}
+
+static int  usartData(void)
+{
+    return usart.fifoLen ? usart.fifo[0] & 0xff : 0;
+}
+
+/* RXB80 of UCSR0B is bit 8 of the frame at the head of the FIFO */
+static void usartRxb8(void)
+{
+    regs[MOCK_UCSR0B] &= ~(1 << RXB80);
+    if(usart.fifoLen && (usart.fifo[0] & 0x100))
+        regs[MOCK_UCSR0B] |= 1 << RXB80;
+}
+
+static void usartLoad(unsigned long long start)
+{
+    usart.shift = usart.hold;
+    usart.holdFull = 0;
+    usart.shiftBusy = 1;
+    usart.shiftUbrr = ubrr();
+    usart.shiftCoding = coding();
+    usart.collided = 0;
+    usart.shiftEnd = start + frameCycles(usart.shiftUbrr, usart.shiftCoding);
+}
+
+static void usartWrite(int reg, int value)
+{
+    if(reg == MOCK_UCSR0A){
+        if(value & (1 << TXC0))
+            usart.txc = 0;
+        usart.u2x = value & (1 << U2X0);
+        usart.mpcm = value & (1 << MPCM0);
+        return;
+    }
+    if(!(regs[MOCK_UCSR0B] & (1 << TXEN0)))
+        return;
+    if(usart.holdFull)
+        fail("UDR0 written while UDRE0 is clear");
+    usart.hold = value | (regs[MOCK_UCSR0B] & (1 << TXB80) ? 0x100 : 0);
+    usart.holdFull = 1;
+    if(txAckAt){
+        latencyAdd(&txLatency, cycles - txAckAt);
+        txAckAt = 0;
+    }
+    if(!usart.shiftBusy)
+        usartLoad(cycles);
+}
+
+static void usartRead(void)
+{
+int     i;
+
+    if(usart.fifoLen == 0)
+        return;
+    if(usart.fifoStatus[0] & (1 << DOR0))
+        overrunSeen = 1;
+    if(latencyOn && !usart.fifoStatus[0])
+        latencyAdd(&rxLatency, cycles - usart.fifoAt[0]);
+#if defined RS485_DE && defined AUTO_BAUD
+    if((usart.fifoStatus[0] & RX_ECHO) && autobaudActive)
+        echoBytes--;        /* autobaudPoll() drops it, not rs485Echo() */
+#endif
+    for(i = 1; i < usart.fifoLen; i++){
+        usart.fifo[i - 1] = usart.fifo[i];
+        usart.fifoStatus[i - 1] = usart.fifoStatus[i];
+        usart.fifoBytes[i - 1] = usart.fifoBytes[i];
+        usart.fifoCounted[i - 1] = usart.fifoCounted[i];
+        usart.fifoAt[i - 1] = usart.fifoAt[i];
+    }
+    usart.fifoLen--;
+    usartRxb8();
+}
+
+/* The receiver is off, which flushes the FIFO: its bytes are no longer
+ * expected, nor counted by mpcmRx(). uartConfigure() has just reset the
+ * address filter.
+ */
+static void usartFlush(void)
+{
+    while(usart.fifoLen){
+        int     status = usart.fifoStatus[--usart.fifoLen] & ~(1 << DOR0);
+
+#ifdef RS485_DE
+        if(status & RX_ECHO)
+            echoBytes--;
+#endif
+        if(status)
+            continue;
+        rxExpected.head -= usart.fifoBytes[usart.fifoLen];
+        rxBytes--;
+#ifdef CAPTURE_MODE
+        rxArrival.head--;
+#endif
+#ifdef MPCM_MODE
+        mpcm.addresses -= (usart.fifoCounted[usart.fifoLen] & MPCM_COUNT_ADDR) != 0;
+        mpcm.matched -= (usart.fifoCounted[usart.fifoLen] & MPCM_COUNT_MATCH) != 0;
+        mpcm.dropped -= (usart.fifoCounted[usart.fifoLen] & MPCM_COUNT_DROP) != 0;
+#endif
+    }
+    usart.overrun = 0;
+#ifdef MPCM_MODE
+    mpcm.selected = !(mpcm.flags & MPCM_FILTER);
+#endif
+}
+
+#ifdef MPCM_MODE
+/* Puts what mpcmRx() makes of a frame on bulk IN into rxExpected, returns
+ * the number of bytes.
+ */
+static int  mpcmExpect(int data, int *counted)
+{
+int     match;
+
+    if(!(data & 0x100)){
+        if(!mpcm.selected){
+            mpcm.dropped++;
+            *counted = MPCM_COUNT_DROP;
+            return 0;
+        }
+        qPut(&rxExpected, data);
+        if(data != MPCM_ESC)
+            return 1;
+        qPut(&rxExpected, data);
+        return 2;
+    }
+    mpcm.addresses++;
+    *counted = MPCM_COUNT_ADDR;
+    if(mpcm.flags & MPCM_FILTER){
+        data &= 0xff;
+        match = data == mpcm.address || ((mpcm.flags & MPCM_ADDR2) && data == mpcm.address2);
+        mpcm.selected = match;
+        if(!match)
+            return 0;
+        mpcm.matched++;
+        *counted |= MPCM_COUNT_MATCH;
+    }
+    qPut(&rxExpected, MPCM_ESC);
+    qPut(&rxExpected, MPCM_ESC_ADDR);
+    qPut(&rxExpected, data & 0xff);
+    return 3;
+}
+#endif
+
+/* A frame at the receiver. status is FE0 for one garbled by a collision,
+ * or RX_ECHO; the firmware drops both, the others are expected on bulk IN.
+ */
+static void usartReceive(int data, int status)
+{
+    if(!(regs[MOCK_UCSR0B] & (1 << RXEN0)))
+        return;
+    data &= dataMask(coding());
+    if(usart.mpcm && (coding() & 1) && !(data & 0x100)){
+#ifdef MPCM_MODE
+        if(mpcm.selected && !status && frameCycles(ubrr(), coding()) > MPCM_LATENCY)
+            fail("0x%02x after a matching address dropped, MPCM0 is still set", data);
+#endif
+        return;     /* MPCM0: data frames are not received */
+    }
+    if(usart.fifoLen == RX_FRAMES){
+        usart.overrun = 1;
+        peer.lost++;
+        return;
+    }
+    usart.fifo[usart.fifoLen] = data;
+    usart.fifoStatus[usart.fifoLen] = status | (usart.overrun ? 1 << DOR0 : 0);
+    usart.fifoBytes[usart.fifoLen] = 0;
+    usart.fifoCounted[usart.fifoLen] = 0;
+    usart.fifoAt[usart.fifoLen] = cycles;
+    usart.overrun = 0;
+    usart.fifoLen++;
+    usartRxb8();
+#ifdef RS485_DE
+    if(status & RX_ECHO)
+        echoBytes++;
+    else if(status)
+        collisions++;
+#endif
+    if(status)
+        return;
+    rxBytes++;
+#ifdef MPCM_MODE
+    if(coding() & 1){
+        usart.fifoBytes[usart.fifoLen - 1] = mpcmExpect(data, &usart.fifoCounted[usart.fifoLen - 1]);
+        return;
+    }
+#endif
+    usart.fifoBytes[usart.fifoLen - 1] = 1;
+    qPut(&rxExpected, data);
+#ifdef CAPTURE_MODE
+    qPut(&rxArrival, (uint32_t)(cycles >> 6));
+#endif
+}
+
+static void txEmit(int data, int ubrrValue, int codingValue)
+{
+uint32_t    e;
+int         mask;
+
+    if(ubrr() != ubrrValue || coding() != codingValue)
+        fail("line coding changed while 0x%02x was shifted out", data);
+    if(qEmpty(&txExpected))
+        fail("USART sent 0x%02x, nothing was sent on USB", data);
+    e = qGet(&txExpected);
+    mask = dataMask(e >> 21);
+    if((data & mask) != (e & mask))
+        fail("USART sent 0x%02x, expected 0x%02x (byte %lu)", data, e & 0x1ff, txBytes);
+    if(ubrrValue != ((e >> 9) & 0xfff) || codingValue != (int)(e >> 21))
+        fail("byte %lu sent with UBRR %d coding 0x%02x, expected UBRR %d coding 0x%02x",
+            txBytes, ubrrValue, codingValue, (e >> 9) & 0xfff, e >> 21);
+    txBytes++;
+}
+
+static void usartRun(void)
+{
+    while(usart.shiftBusy && cycles >= usart.shiftEnd){
+        txEmit(usart.shift, usart.shiftUbrr, usart.shiftCoding);
+        usart.shiftBusy = 0;
+#ifdef RS485_DE
+        /* the receiver of the transceiver is on, RXC0 comes before TXC0 */
+        usartReceive(usart.shift, usart.collided ? 1 << FE0 : RX_ECHO);
+#endif
+        if(usart.holdFull){
+            usartLoad(usart.shiftEnd);
+        }else{
+            usart.txc = 1;
+#ifdef RS485_DE
+            txEndAt = usart.shiftEnd;
+#endif
+        }
+    }
+}
+
+#ifdef COMP_MODE
+/* Telemetry-like text for the compressed mode, now and then a byte above
+ * 0x7f.
+ */
+typedef struct text {
+    char        line[96];
+    int         len, pos;
+    unsigned    seq;
+} text_t;
+
+static text_t   peerText;
+
+static uint8_t  textNext(text_t *t)
+{
+    if(rnd() % 64 == 0)
+        return 0x80 | rnd();
+    if(t->pos == t->len){
+        t->len = snprintf(t->line, sizeof(t->line), "%08u T=%d.%d V=%d.%02d ADC=%04x %s\r\n",
+            t->seq++, rndRange(18, 25), rnd() % 10, rndRange(3, 5), rnd() % 100, rnd() & 0x3ff,
+            rnd() % 8 ? "OK" : "----------------");
+        t->pos = 0;
+    }
+    return t->line[t->pos++];
+}
+
+#define peerByte()  textNext(&peerText)
+#elif defined MPCM_MODE
+/* With 9 data bits an address now and then, some of them the device's. */
+static int  peerByte(void)
+{
+static const uint8_t    addresses[] = { 0x10, 0x11, 0x12, MPCM_ESC };
+
+    if((coding() & 1) && rnd() % 8 == 0)
+        return 0x100 | addresses[rnd() % sizeof(addresses)];
+    return rnd() & 0xff;
+}
+#else
+#define peerByte()  (rnd() & 0xff)
+#endif
+
+static void peerRun(void)
+{
+    if(peer.busy && cycles >= peer.arrival){
+        peer.busy = 0;
+#ifdef RS485_DE
+        if(regs[MOCK_PORTC] & (1 << UART_CTRL_DE))
+            peer.collided = 1;  /* before deRun() has seen DE */
+#endif
+        if(!peer.bitCycles)
+            usartReceive(peer.data, peer.collided ? 1 << FE0 : 0);
+        peer.collided = 0;
+    }
+#ifdef RS485_DE
+    if(regs[MOCK_PORTC] & (1 << UART_CTRL_DE))
+        return;             /* half duplex, the peer waits for the bus */
+#endif
+    if(!peer.busy && peer.on && cycles >= peer.next && (regs[MOCK_PORTC] & (1 << UART_CTRL_RTS))){
+        unsigned long long  frame = frameCycles(ubrr(), coding());
+
+        if(peer.bitCycles)
+            frame = 10 * peer.bitCycles;
+        peer.busy = 1;
+        peer.data = peerByte();
+        peer.arrival = cycles + frame;
+        peer.next = peer.arrival + frame * (rnd() % (peer.gap + 1));
+#ifdef MPCM_MODE
+        if(peer.data & 0x100)
+            peer.next = peer.arrival;   /* data right after an address */
+#endif
+        peer.sent++;
+    }
+}
+
+#ifdef AUTO_BAUD
+/* The level of RXD, for the pin change interrupt. Only the frames of a
+ * peer at a rate of its own are on the pin, the USART does not see them.
+ */
+static void rxdRun(void)
+{
+int     level = 1, bit;
+
+    if(peer.busy && peer.bitCycles){
+        bit = (cycles + 10 * peer.bitCycles - peer.arrival) / peer.bitCycles;
+        if(bit == 0)
+            level = 0;
+        else if(bit <= 8)
+            level = (peer.data >> (bit - 1)) & 1;
+    }
+    if(level != (regs[MOCK_PIND] & 1)){
+        regs[MOCK_PIND] ^= 1;
+        if(regs[MOCK_PCMSK2] & (1 << PCINT16))
+            regs[MOCK_PCIFR] |= 1 << PCIF2;
+    }
+}
+#endif
+
+#ifdef RS485_DE
+/* TXC0 and OCF2A wait at most for two full size transactions back to back,
+ * which V-USB takes in one interrupt, and for a few cycles of cli()
+ */
+#define DE_LATE_MAX     (2 * (3*8+3 + 11*8+3 + 8+3 + 8) * BIT_CYCLES + 64)
+
+static unsigned long long   timer2Last;
+
+/* Timer2 in CTC mode for the hold time of rs485.c: OCF2A when TCNT2
+ * reaches OCR2A, which counts from 0 again.
+ */
+static void timer2Run(void)
+{
+static const int    prescaler2[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+unsigned            p = prescaler2[regs[MOCK_TCCR2B] & 7];
+
+    if(p == 0){
+        timer2Last = cycles;
+        return;
+    }
+    while(cycles - timer2Last >= p){
+        timer2Last += p;
+        if(regs[MOCK_TCNT2] == regs[MOCK_OCR2A] && (regs[MOCK_TCCR2A] & (1 << WGM21))){
+            regs[MOCK_TCNT2] = 0;
+            regs[MOCK_TIFR2] |= 1 << OCF2A;
+        }else{
+            regs[MOCK_TCNT2] = (regs[MOCK_TCNT2] + 1) & 0xff;
+        }
+    }
+}
+
+/* DE is high while a frame is on the line and drops the hold time after
+ * the last stop bit, late by at most DE_LATE_MAX, or twice that with a
+ * hold time, which TIMER2_COMPA_vect ends. A frame of the peer during
+ * which DE goes high is garbled, and so is the device's.
+ */
+static void deRun(void)
+{
+static int          de;
+int                 now = (regs[MOCK_PORTC] >> UART_CTRL_DE) & 1;
+long long           late = cycles - txEndAt, hold = rs485Stats.hold * 8LL;
+long long           lateMax = hold + (hold ? 2 : 1) * (long long)DE_LATE_MAX;
+
+    if(usart.shiftBusy && !now)
+        fail("DE low while 0x%02x is on the line", usart.shift);
+    if(now && peer.busy){
+        peer.collided = 1;
+        if(usart.shiftBusy)
+            usart.collided = 1;
+    }
+    if(de && !now && txEndAt){
+        if(late < hold - 8)
+            fail("DE released %lld cycles after the last stop bit, the hold time is %lld", late, hold);
+        if((unsigned long long)late < deLateMin)
+            deLateMin = late;
+        if((unsigned long long)late > deLateMax)
+            deLateMax = late;
+    }
+    if(now && !de)
+        txEndAt = 0;    /* raised for a byte not yet written to UDR0 */
+    if(now && !usart.shiftBusy && txEndAt && late > lateMax)
+        fail("DE still high %lld cycles after the last stop bit, at most %lld with the hold time of %lld",
+            late, lateMax, hold);
+    de = now;
+}
+#endif
+
+static void advance(unsigned long long c)
+{
+    cycles += c;
+    if(usart.shiftBusy)
+        usartRun();
+    peerRun();
+#ifdef AUTO_BAUD
+    rxdRun();
+#endif
+#ifdef RS485_DE
+    timer2Run();
+    deRun();
+#endif
+    if((regs[MOCK_TCCR1B] & 7) == 3)    /* timer 1 at clk/64, used by stats.c */
+        regs[MOCK_TCNT1] = (cycles >> 6) & 0xffff;
+    else if((regs[MOCK_TCCR1B] & 7) == 2)   /* clk/8 for autobaud.c */
+        regs[MOCK_TCNT1] = (cycles >> 3) & 0xffff;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------- Timer0 and USART interrupts ---------------------- */
+/* ------------------------------------------------------------------------- */
+
+extern void TIMER0_COMPA_vect(void);
+extern void USART_RX_vect(void);
+#ifdef AUTO_BAUD
+extern void PCINT2_vect(void);
+#endif
+#ifdef RS485_DE
+extern void USART_TX_vect(void);
+extern void TIMER2_COMPA_vect(void);
+#endif
+
+static unsigned long long   timer0Last;
+
+/* Calls the firmware's interrupt routines for Timer0 compare match A (CTC)
+ * and the USART, with RS485_DE for TXC0 and Timer2, with AUTO_BAUD for the
+ * pin change of RXD, at a register access with interrupts enabled. Returns
+ * 1 if one was called, which ends a sleep. USART_UDRE_vect is an alias.
+ */
+static int  fwInterrupts(void)
+{
+static const int    prescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+int                 p, ran = 0;
+
+    if(!(regs[MOCK_SREG] & 0x80))
+        return 0;
+    regs[MOCK_SREG] &= ~0x80;
+    p = prescaler[regs[MOCK_TCCR0B] & 7];
+    if(p && cycles - timer0Last >= (unsigned long long)(regs[MOCK_OCR0A] + 1) * p){
+        timer0Last = cycles;
+        if(regs[MOCK_TIMSK0] & (1 << OCIE0A)){
+            TIMER0_COMPA_vect();
+            ran = 1;
+        }
+    }
+    if(((regs[MOCK_UCSR0B] & (1 << RXCIE0)) && usart.fifoLen)
+        || ((regs[MOCK_UCSR0B] & (1 << UDRIE0)) && !usart.holdFull)){
+        USART_RX_vect();
+        ran = 1;
+    }
+#ifdef RS485_DE
+    if((regs[MOCK_UCSR0B] & (1 << TXCIE0)) && usart.txc){
+        usart.txc = 0;    /* cleared by the interrupt response */
+        USART_TX_vect();
+        ran = 1;
+    }
+    if((regs[MOCK_TIMSK2] & (1 << OCIE2A)) && (regs[MOCK_TIFR2] & (1 << OCF2A))){
+        regs[MOCK_TIFR2] &= ~(1 << OCF2A);
+        TIMER2_COMPA_vect();
+        ran = 1;
+    }
+#endif
+#ifdef AUTO_BAUD
+    if((regs[MOCK_PCICR] & (1 << PCIE2)) && (regs[MOCK_PCIFR] & (1 << PCIF2))){
+        regs[MOCK_PCIFR] &= ~(1 << PCIF2);
+        PCINT2_vect();
+        ran = 1;
+    }
+#endif
+    commit();           /* the last write of a routine, not left for the next access */
+    regs[MOCK_SREG] |= 0x80;
+    return ran;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------- Firmware coroutine ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static char         fwStack[FW_STACK];
+
+static void fwEntry(void)
+{
+    firmwareMain();
+    fail("firmware main() returned");
+}
+
+/* Runs the firmware for n register accesses, or longer until interrupts
+ * are enabled.
+ */
+static void run(long n)
+{
+    yieldAt = accesses + n;
+    inFirmware = 1;
+    swapcontext(&hostContext, &fwContext);
+    if(cycles - lastWdt > F_CPU)
+        fail("main loop stuck, no wdt_reset() for 1 s");
+}
+
+static void runCycles(unsigned long long c)
+{
+    run(c / CYCLES_PER_ACCESS + 1);
+}
+
+static void fwStart(void)
+{
+    memset(regs, 0, sizeof(regs));
+    regs[MOCK_MCUSR] = resetFlags;
+    regs[MOCK_PIND] = 0xff & ~(1 << USB_CFG_DPLUS_BIT);    /* J state */
+    regs[MOCK_PINC] = 0xff;     /* CTS asserted */
+    regs[MOCK_PINB] = 0xff;
+    memset(mockEeprom, 0xff, sizeof(mockEeprom));
+    getcontext(&fwContext);
+    fwContext.uc_stack.ss_sp = fwStack;
+    fwContext.uc_stack.ss_size = sizeof(fwStack);
+    fwContext.uc_link = NULL;
+    makecontext(&fwContext, fwEntry, 0);
+    run(1000);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Interrupt model ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define PID_OUT         0xe1
+#define PID_IN          0x69
+#define PID_SETUP       0x2d
+#define PID_DATA0       0xc3
+#define PID_DATA1       0x4b
+#define PID_ACK         0xd2
+#define PID_NAK         0x5a
+#define PID_STALL       0x1e
+
+#define USB_ACK         1
+#define USB_NAK         2
+#define USB_STALL       3
+#define USB_DATA        4
+#define USB_NONE        5       /* device did not answer */
+
+/* Packets take the bus time of the real ones, with the SYNC byte and EOP,
+ * without bit stuffing. The firmware does not run in between.
+ */
+static void busTime(int bytes)
+{
+    advance((unsigned long long)(bytes * 8 + 3) * BIT_CYCLES);
+}
+
+/* a packet from the device: USB_TX_HOOK of usbconfig.h */
+static void isrSent(void)
+{
+#ifdef USB_TX_HOOK
+    regs[MOCK_GPIOR0] |= 1 << EVENT_USB;
+#endif
+}
+
+static int  intrEnabled(void)
+{
+    return (regs[MOCK_SREG] & 0x80) && (regs[MOCK_EIMSK] & (1 << INT0));
+}
+
+/* token: asmcommon.inc from the address check to storeTokenAndReturn */
+static int  isrToken(uint8_t pid, uint8_t addr, uint8_t ep)
+{
+    busTime(3);
+    if(!intrEnabled())
+        return 0;
+    if((uint8_t)(addr << 1) != usbDeviceAddr){
+        usbCurrentTok = 0;
+        return 0;
+    }
+    if(pid != PID_IN)   /* handleSetupOrOut */
+        usbCurrentTok = (ep & 0xf) ? (ep & 0xf) : pid;
+    return 1;
+}
+
+static int  corruptNext;        /* set by the host for the next data packet */
+
+/* data packet after SETUP or OUT: handleData */
+static int  isrData(uint8_t pid, const uint8_t *data, int len)
+{
+uint8_t     *p;
+uint16_t    crc;
+int         cnt = len + 3, i, bit;
+
+    busTime(len + 3);
+    if(!intrEnabled() || usbCurrentTok == 0)
+        return USB_NONE;
+    busTime(1);
+    isrSent();
+    if(usbRxLen != 0)
+        return USB_NAK;
+    if(cnt < 4){
+#if USB_CFG_DROP_DUPLICATES
+        usbOutToken[usbCurrentTok < 0x10] = pid;    /* storeZlpToken */
+#endif
+        return USB_ACK;
+    }
+    p = usbRxBuf + usbInputBufOffset;
+    p[0] = pid;
+    memcpy(p + 1, data, len);
+    crc = crc16(data, len);
+    p[len + 1] = crc;
+    p[len + 2] = crc >> 8;
+    if(corruptNext){    /* noise on the bus, after the CRC */
+        bit = rnd() % 8;
+        i = 1 + rnd() % (len + 2);
+        p[i] ^= 1 << bit;
+    }
+#if USB_CFG_CHECK_DATA_TOGGLING
+    usbCurrentDataToken = pid;
+#endif
+    usbRxLen = cnt;
+    usbRxToken = usbCurrentTok;
+    usbInputBufOffset = USB_BUFSIZE - usbInputBufOffset;
+    return USB_ACK;
+}
+
+/* IN token: handleIn, handleIn1, handleIn3 and the address assignment
+ * after a data packet in usbdrvasm12.inc
+ */
+static int  isrIn(uint8_t ep, uint8_t *pkt, int *len)
+{
+uint8_t     *buf, cnt;
+uint8_t     handshake;
+
+    if(usbRxLen >= 1)
+        return USB_NAK;
+    ep &= 0xf;
+    if(ep == 0){
+        cnt = usbTxLen;
+        buf = usbTxBuf;
+        if(!(cnt & 0x10))
+            usbTxLen = USBPID_NAK;
+    }else if(ep == USB_CFG_EP3_NUMBER){
+        cnt = usbTxLen3;
+        buf = usbTxBuf3;
+        if(!(cnt & 0x10))
+            usbTxLen3 = USBPID_NAK;
+    }else{
+        cnt = usbTxLen1;
+        buf = usbTxBuf1;
+        if(!(cnt & 0x10))
+            usbTxLen1 = USBPID_NAK;
+    }
+    if(cnt & 0x10){
+        handshake = cnt;
+        busTime(1);
+        isrSent();
+        return handshake == PID_STALL ? USB_STALL : USB_NAK;
+    }
+    if(cnt < 4 || cnt > 12)
+        fail("IN%d: bad length %d in transmit buffer", ep, cnt);
+    *len = cnt - 1;
+    memcpy(pkt, buf, cnt - 1);
+    busTime(cnt - 1);
+    isrSent();
+    usbDeviceAddr = usbNewDeviceAddr << 1;
+    return USB_DATA;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------------- Host --------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static uint8_t      address;
+static int          dataEpType, dataEpInterval;     /* of IN endpoint 1 */
+static uint8_t      outToggle, inToggle1, inToggle3;
+static unsigned long    transactions, naks;
+
+static int  hostSetup(const uint8_t *setup)
+{
+int     r;
+
+    if(!isrToken(PID_SETUP, address, 0))
+        return USB_NONE;
+    r = isrData(PID_DATA0, setup, 8);
+    transactions++;
+    return r;
+}
+
+static int  hostOut(uint8_t ep, uint8_t toggle, const uint8_t *data, int len)
+{
+    if(!isrToken(PID_OUT, address, ep))
+        return USB_NONE;
+    transactions++;
+    return isrData(toggle ? PID_DATA1 : PID_DATA0, data, len);
+}
+
+/* returns the data length or a negative USB_* code */
+static int  hostIn(uint8_t ep, uint8_t *toggle, uint8_t *data)
+{
+uint8_t     pkt[16];
+int         r, len;
+
+    if(!isrToken(PID_IN, address, ep))
+        return -USB_NONE;
+    transactions++;
+    r = isrIn(ep, pkt, &len);
+    if(r != USB_DATA){
+        if(r == USB_NAK)
+            naks++;
+        return -r;
+    }
+    len -= 3;
+    if(crc16(pkt + 1, len) != (pkt[len + 1] | pkt[len + 2] << 8))
+        fail("IN%d: CRC error", ep);
+    if(pkt[0] != (*toggle ? PID_DATA1 : PID_DATA0))
+        fail("IN%d: %s, expected %s", ep, pkt[0] == PID_DATA1 ? "DATA1" : "DATA0",
+            *toggle ? "DATA1" : "DATA0");
+    *toggle ^= 1;
+    busTime(1);     /* ACK */
+    if(data != NULL)
+        memcpy(data, pkt + 1, len);
+    return len;
+}
+
+static int  bulkIn(void);
+
+/* control transfer, waiting for the device as long as it NAKs; the host
+ * goes on reading bulk IN meanwhile, the device may wait for it
+ */
+static int  control(const uint8_t *setup, uint8_t *data)
+{
+int                 len = setup[6] | setup[7] << 8, done = 0, n, r;
+uint8_t             toggle = 1;
+unsigned long long  timeout = cycles + 2 * (unsigned long long)F_CPU;
+
+    while((r = hostSetup(setup)) != USB_ACK){
+        if(r != USB_NAK || cycles > timeout)
+            fail("SETUP %02x %02x: no ACK", setup[0], setup[1]);
+        run(rndRange(1, 200));
+        if(address)
+            bulkIn();
+    }
+    run(rndRange(1, 200));
+    while(done < len){
+        if(setup[0] & 0x80){
+            n = hostIn(0, &toggle, data + done);
+            if(n >= 0){
+                done += n;
+                if(n < 8)
+                    break;
+            }else if(n == -USB_STALL){
+                return -1;
+            }
+        }else{
+            n = len - done > 8 ? 8 : len - done;
+            if(!isrToken(PID_OUT, address, 0))
+                fail("control OUT: no answer");
+            r = isrData(toggle ? PID_DATA1 : PID_DATA0, data + done, n);
+            if(r == USB_ACK){
+                done += n;
+                toggle ^= 1;
+            }else if(r == USB_STALL){
+                return -1;
+            }
+        }
+        if(cycles > timeout)
+            fail("control %02x %02x: data stage timeout", setup[0], setup[1]);
+        run(rndRange(1, 200));
+    }
+    /* status stage */
+    for(;;){
+        if(setup[0] & 0x80){
+            if(!isrToken(PID_OUT, address, 0))
+                fail("control: no answer in status stage");
+            r = isrData(PID_DATA1, NULL, 0);
+            if(r == USB_ACK)
+                break;
+        }else{
+            uint8_t t = 1;
+
+            n = hostIn(0, &t, NULL);
+            if(n == 0)
+                break;
+            if(n > 0)
+                fail("control %02x %02x: data in status stage", setup[0], setup[1]);
+            if(n == -USB_STALL)
+                return -1;
+        }
+        if(cycles > timeout)
+            fail("control %02x %02x: status stage timeout", setup[0], setup[1]);
+        run(rndRange(1, 200));
+    }
+    run(rndRange(1, 200));
+    return done;
+}
+
+static void busReset(void)
+{
+    regs[MOCK_PIND] &= ~((1 << USB_CFG_DPLUS_BIT) | (1 << USB_CFG_DMINUS_BIT));
+    runCycles(F_CPU / 100);     /* 10 ms SE0 */
+    regs[MOCK_PIND] |= 1 << USB_CFG_DMINUS_BIT;
+    address = 0;
+    runCycles(F_CPU / 100);
+}
+
+static void setupPacket(uint8_t *s, uint8_t type, uint8_t rq, unsigned value, unsigned index, unsigned len)
+{
+    s[0] = type;
+    s[1] = rq;
+    s[2] = value;
+    s[3] = value >> 8;
+    s[4] = index;
+    s[5] = index >> 8;
+    s[6] = len;
+    s[7] = len >> 8;
+}
+
+static unsigned long long   attachedAt, configuredAt;
+
+/* The host waits for the device to attach, debounces it for 100 ms
+ * (USB 2.0 7.1.7.3) and resets it before the first request.
+ */
+static void enumerate(void)
+{
+uint8_t     s[8], buf[256];
+int         n, i;
+
+    while(regs[MOCK_DDRD] & ((1 << USB_CFG_DPLUS_BIT) | (1 << USB_CFG_DMINUS_BIT))){
+        if(cycles > 2 * (unsigned long long)F_CPU)
+            fail("device not attached after 2 s");
+        run(200);
+    }
+    attachedAt = cycles;
+    runCycles(F_CPU / 10);
+    busReset();
+    setupPacket(s, 0x80, USBRQ_GET_DESCRIPTOR, USBDESCR_DEVICE << 8, 0, 18);
+    if((n = control(s, buf)) != 18 || buf[1] != USBDESCR_DEVICE)
+        fail("device descriptor: %d bytes", n);
+    setupPacket(s, 0x00, USBRQ_SET_ADDRESS, 5, 0, 0);
+    control(s, NULL);
+    address = 5;
+    setupPacket(s, 0x80, USBRQ_GET_DESCRIPTOR, USBDESCR_CONFIG << 8, 0, 255);
+    if((n = control(s, buf)) < 9 || n != (buf[2] | buf[3] << 8))
+        fail("configuration descriptor: %d bytes", n);
+    for(i = 0; i + 7 <= n && buf[i] >= 2; i += buf[i]){
+        if(buf[i + 1] == USBDESCR_ENDPOINT && buf[i + 2] == 0x81){
+            dataEpType = buf[i + 3] & 3;
+            dataEpInterval = buf[i + 6];
+        }
+    }
+    setupPacket(s, 0x00, USBRQ_SET_CONFIGURATION, 1, 0, 0);
+    if(control(s, NULL) < 0)
+        fail("SET_CONFIGURATION stalled");
+    inToggle1 = inToggle3 = outToggle = 0;
+    configuredAt = cycles;
+    if(verbose)
+        printf("%10llu configured, attached at %llu\n", cycles, attachedAt);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ CDC traffic ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+static const uint32_t   bauds[] = { 9600, 19200, 38400, 57600, 115200, 230400 };
+
+static struct {
+    uint32_t    baud;
+    uint8_t     stop, parity, data;
+} line = { UART_DEFAULT_BPS, 0, 0, 8 };
+
+static uint8_t      outPkt[8];
+static int          outLen;             /* pending OUT packet, 0 for none */
+static int          outDelivered;       /* a good copy of it was ACKed */
+static unsigned long    outCorrupted, outResent, outDropped;
+static uint8_t      serialState;
+static int          notifyPos;          /* bytes of the SERIAL_STATE notification */
+static uint8_t      notify[10];
+static unsigned long    inBytes, outBytes, notifications;
+
+/* what uartConfigure() makes of the coding */
+static uint32_t lineExpected(void)
+{
+int     u, c;
+
+    u = ((F_CPU >> 3) + (line.baud >> 1)) / line.baud - 1;
+    c = ((line.parity == 1 ? 3 : line.parity) << UPM00) | ((line.stop >> 1) << USBS0) | ((line.data - 5) << UCSZ00);
+#ifdef MPCM_MODE
+    if(mpcm.flags & MPCM_NINE_BITS)
+        c |= (3 << UCSZ00) | 1;
+#endif
+    return (u & 0xfff) << 9 | (uint32_t)c << 21;
+}
+
+#ifndef COMP_MODE
+/* the frames of data from USB: with 9 data bits as the escapes of
+ * vendor.h make them
+ */
+static void txQueue(const uint8_t *d, int n)
+{
+uint32_t    e = lineExpected();
+int         i;
+
+    for(i = 0; i < n; i++){
+#ifdef MPCM_MODE
+        if(mpcm.flags & MPCM_NINE_BITS){
+            if(mpcm.outState == 0 && d[i] == MPCM_ESC){
+                mpcm.outState = 1;
+            }else if(mpcm.outState == 1){
+                mpcm.outState = d[i] == MPCM_ESC_ADDR ? 2 : 0;   /* others are dropped */
+                if(d[i] == MPCM_ESC)
+                    qPut(&txExpected, MPCM_ESC | e);
+            }else{
+                qPut(&txExpected, d[i] | (mpcm.outState == 2 ? 0x100 : 0) | e);
+                mpcm.outState = 0;
+            }
+            continue;
+        }
+#endif
+        qPut(&txExpected, d[i] | e);
+    }
+}
+#endif
+
+/* a coding the device took, as setLineCoding() in main.c makes it */
+static void lineSet(uint32_t baud, uint8_t stop, uint8_t parity, uint8_t data)
+{
+    line.baud = baud;
+    line.stop = stop == 1 ? 0 : stop;
+    line.parity = parity > 2 ? 0 : parity;
+    line.data = data;
+    if(verbose)
+        printf("%10llu line coding %u %d%c%d\n", cycles, baud, data, "NOE"[line.parity], stop ? 2 : 1);
+}
+
+static void setLineCoding(uint32_t baud, uint8_t stop, uint8_t parity, uint8_t data)
+{
+uint8_t     s[8], d[7];
+
+    d[0] = baud;
+    d[1] = baud >> 8;
+    d[2] = baud >> 16;
+    d[3] = baud >> 24;
+    d[4] = stop;
+    d[5] = parity;
+    d[6] = data;
+    setupPacket(s, 0x21, 0x20, 0, 0, 7);
+    if(control(s, d) != 7)
+        fail("SET_LINE_CODING failed");
+    lineSet(baud, stop, parity, data);
+}
+
+static void getLineCoding(void)
+{
+uint8_t     s[8], d[7];
+uint32_t    baud;
+
+    setupPacket(s, 0xa1, 0x21, 0, 0, 7);
+    if(control(s, d) != 7)
+        fail("GET_LINE_CODING failed");
+    baud = d[0] | d[1] << 8 | d[2] << 16 | (uint32_t)d[3] << 24;
+    if(baud != line.baud || d[4] != line.stop || d[5] != line.parity || d[6] != line.data)
+        fail("GET_LINE_CODING %u %d %d %d, expected %u %d %d %d", baud, d[4], d[5], d[6],
+            line.baud, line.stop, line.parity, line.data);
+}
+
+static void setControlLineState(int dtr)
+{
+uint8_t     s[8];
+
+    setupPacket(s, 0x21, 0x22, dtr, 0, 0);
+    if(control(s, NULL) < 0)
+        fail("SET_CONTROL_LINE_STATE stalled");
+    if(!(regs[MOCK_PORTC] & (1 << UART_CTRL_DTR)) != !dtr)
+        fail("DTR not %s", dtr ? "set" : "cleared");
+}
+
+#ifdef ALT_PROFILES
+/* switches the buffering profile, GET_INTERFACE must return it */
+static void setInterface(int alt)
+{
+uint8_t     s[8], d[1];
+
+    setupPacket(s, 0x01, USBRQ_SET_INTERFACE, alt, 1, 0);
+    if(control(s, NULL) < 0)
+        fail("SET_INTERFACE stalled");
+    outToggle = inToggle1 = inToggle3 = 0;
+    setupPacket(s, 0x81, USBRQ_GET_INTERFACE, 0, 1, 1);
+    if(control(s, d) != 1 || d[0] != alt)
+        fail("GET_INTERFACE %d, expected %d", d[0], alt);
+    if(verbose)
+        printf("%10llu alternate setting %d\n", cycles, alt);
+}
+#endif
+
+#ifdef AUTO_BAUD
+static void bulkOut(int produce);
+
+/* Detection with the special line coding: the peer sends random 8N1 at a
+ * standard rate, now and then off by up to 2%. GET_LINE_CODING returns
+ * AUTOBAUD_SELECT until the rate is found, then the standard rate, and
+ * UBRR0 must follow it. OUT data at 1200 bps before each detection takes
+ * longer than the detection; it must leave at the rate it was sent for.
+ */
+static void autobaudCheck(void)
+{
+static const uint32_t   rates[] = { 1200, 2400, 4800, 9600, 19200, 38400 };
+uint8_t                 s[8], d[7];
+uint32_t                rate, baud;
+unsigned long long      timeout;
+int                     round, skew, i;
+
+    for(round = 0; round < 3; round++){
+        rate = rates[rnd() % (sizeof(rates) / sizeof(rates[0]))];
+        skew = rnd() % 2 ? rndRange(-20, 20) : 0;  /* per mille */
+        setLineCoding(1200, 0, 0, 8);
+        for(i = 0; i < 3; i++){
+            bulkOut(1);
+            while(outLen != 0){
+                run(rndRange(1, 2000));
+                bulkOut(0);
+            }
+        }
+        setLineCoding(AUTOBAUD_SELECT, 0, 0, 8);
+        line.baud = 1200;   /* main.c keeps the rate until one is detected */
+        peer.bitCycles = (F_CPU + rate / 2) / rate * (1000 + skew) / 1000;
+        peer.gap = rnd() % 4;
+        peer.on = 1;
+        timeout = cycles + F_CPU;
+        setupPacket(s, 0xa1, 0x21, 0, 0, 7);
+        do{
+            if(cycles > timeout)
+                fail("no rate detected for %u bps %+d/1000", rate, skew);
+            run(rndRange(2000, 20000));     /* a few ms */
+            if(control(s, d) != 7)
+                fail("GET_LINE_CODING failed");
+            baud = d[0] | d[1] << 8 | d[2] << 16 | (uint32_t)d[3] << 24;
+        }while(baud == AUTOBAUD_SELECT);
+        peer.on = 0;
+        while(peer.busy)
+            run(200);
+        peer.bitCycles = 0;
+        if(baud != rate)
+            fail("detected %u bps for %u bps %+d/1000", baud, rate, skew);
+        run(2000);
+        if(ubrr() != (int)(((F_CPU >> 3) + (rate >> 1)) / rate - 1))
+            fail("UBRR0 %d for the detected %u bps", ubrr(), rate);
+        if(verbose)
+            printf("%10llu detected %u bps %+d/1000 after %u edges\n", cycles, rate, skew, autobaudStats.edges);
+        setLineCoding(rate, 0, 0, 8);   /* the coding the model expects */
+    }
+}
+#endif
+
+#ifdef RS485_DE
+/* echo suppression on, the transceiver of the model echoes every frame */
+static void rs485Mode(int hold)
+{
+uint8_t     s[8];
+
+    setupPacket(s, 0x40, VENDOR_RQ_RS485, RS485_ECHO, hold, 0);
+    if(control(s, NULL) < 0)
+        fail("VENDOR_RQ_RS485 stalled");
+    deLateMin = ULLONG_MAX;
+    deLateMax = 0;
+    if(verbose)
+        printf("%10llu RS-485 hold %d ticks\n", cycles, hold);
+}
+
+static void rs485Report(void)
+{
+    printf("RS-485: %u turnarounds, DE released %.1f to %.1f us after the last stop bit (hold %.1f us),"
+        " %lu frames garbled by collisions\n", rs485Stats.turnarounds,
+        deLateMin == ULLONG_MAX ? 0.0 : deLateMin * 1e6 / F_CPU, deLateMax * 1e6 / F_CPU,
+        rs485Stats.hold * 8e6 / F_CPU, collisions);
+}
+#endif
+
+#ifdef MPCM_MODE
+extern vendorMpcm_t mpcmStats;
+
+/* 9 data bits, and if filter the address filter for 0x10 and maybe 0x12 */
+static void mpcmMode(int filter)
+{
+uint8_t     s[8];
+
+    mpcm.flags = MPCM_NINE_BITS | (filter ? MPCM_FILTER | (rnd() % 2 ? MPCM_ADDR2 : 0) : 0);
+    mpcm.address = 0x10;
+    mpcm.address2 = 0x12;
+    mpcm.addresses = mpcm.matched = mpcm.dropped = 0;
+    setupPacket(s, 0x40, VENDOR_RQ_MPCM, mpcm.flags, mpcm.address | mpcm.address2 << 8, 0);
+    if(control(s, NULL) < 0)
+        fail("VENDOR_RQ_MPCM stalled");
+    if(verbose)
+        printf("%10llu 9 bit mode, flags %d\n", cycles, mpcm.flags);
+}
+
+/* OUT data with the escapes of the 9 bit mode now and then */
+static uint8_t  outByte(void)
+{
+int     r;
+
+    if(mpcm.genEsc){
+        mpcm.genEsc = 0;
+        r = rnd() % 4;
+        return r < 2 ? MPCM_ESC_ADDR : r == 2 ? MPCM_ESC : rnd();
+    }
+    if(rnd() % 8 == 0){
+        mpcm.genEsc = 1;
+        return MPCM_ESC;
+    }
+    return rnd();
+}
+#else
+#define outByte()   rnd()
+#endif
+
+static int  fault(void)
+{
+    return faultRate > 0 && rnd() % 1000000 < faultRate * 1000000;
+}
+
+#ifdef COMP_MODE
+extern vendorComp_t compStats;
+
+static lzCodec_t        outEnc, outDec, inDec;
+static queue_t          outRaw;         /* text coded, not yet decoded */
+static queue_t          outCode;        /* code not yet in a packet */
+static unsigned long    outCodeTaken;   /* bytes of code taken from it */
+static unsigned long    outPktCode;     /* the first of them in outPkt */
+static text_t           outText;
+static unsigned long    inCoded, outCoded;
+static unsigned         inSyncs;        /* of inDec, the encoder followed */
+
+/* the encoder started over: the index of the sync in the code and
+ * outRaw.head, the text before it is lost where it was not delivered
+ */
+#define SYNC_RECORDS    16
+static struct {
+    unsigned long   code;
+    unsigned        raw;
+} syncRecord[SYNC_RECORDS];
+static unsigned         syncHead, syncTail;
+
+static void compMode(int on)
+{
+uint8_t     s[8];
+
+    setupPacket(s, 0x40, VENDOR_RQ_COMP, on, 0, 0);
+    if(control(s, NULL) < 0)
+        fail("VENDOR_RQ_COMP stalled");
+    lzInit(&outEnc);
+    lzInit(&outDec);
+    lzInit(&inDec);
+    inSyncs = 0;
+}
+
+/* Up to n bytes of code for a bulk OUT packet, codes more text if there
+ * is none left.
+ */
+static int  compPacket(uint8_t *pkt, int n)
+{
+uint8_t     raw[48], code[2 * sizeof(raw)];
+int         i, len;
+
+    if(qEmpty(&outCode)){
+        len = rndRange(1, sizeof(raw));
+        for(i = 0; i < len; i++){
+            raw[i] = textNext(&outText);
+            qPut(&outRaw, raw[i]);
+        }
+        len = lzEncode(&outEnc, raw, len, code);
+        for(i = 0; i < len; i++)
+            qPut(&outCode, code[i]);
+    }
+    outPktCode = outCodeTaken;
+    for(i = 0; i < n && !qEmpty(&outCode); i++)
+        pkt[i] = qGet(&outCode);
+    outCodeTaken += i;
+    return i;
+}
+
+/* The device sent a sync on bulk IN after it lost OUT code: the encoder
+ * starts over after the code not yet in a packet, which may end in the
+ * middle of a token for a device that has not lost any.
+ */
+static void compResync(void)
+{
+uint8_t     code[COMP_SYNC_OUT];
+int         i, n;
+
+    inSyncs = inDec.syncs;
+    if(syncHead - syncTail >= SYNC_RECORDS)
+        fail("host codec: %d syncs not delivered", SYNC_RECORDS);
+    syncRecord[syncHead % SYNC_RECORDS].code = outCodeTaken + (outCode.head - outCode.tail);
+    syncRecord[syncHead++ % SYNC_RECORDS].raw = outRaw.head;
+    n = lzSync(&outEnc, code);
+    for(i = 0; i < n; i++)
+        qPut(&outCode, code[i]);
+}
+
+/* A packet reached the device: its text goes to the USART. outDec drops
+ * the code as the device does after a lost packet; at a sync the text is
+ * the one coded after it.
+ */
+static void compDelivered(const uint8_t *pkt, int n)
+{
+uint8_t     raw[LZ_DECODE_MAX(1)];
+uint32_t    e = lineExpected();
+unsigned    syncs;
+int         i, k, m;
+
+    for(k = 0; k < n; k++){
+        syncs = outDec.syncs;
+        m = lzDecode(&outDec, pkt + k, 1, raw);
+        if(outDec.syncs != syncs){
+            while(syncHead != syncTail
+                    && syncRecord[syncTail % SYNC_RECORDS].code + COMP_SYNC_OUT <= outPktCode + k)
+                syncTail++;     /* missed in the lost code, or passed */
+            if(syncHead == syncTail || syncRecord[syncTail % SYNC_RECORDS].code > outPktCode + k)
+                fail("host codec: a sync at code byte %lu the host did not send", outPktCode + k);
+            outRaw.tail = syncRecord[syncTail % SYNC_RECORDS].raw;
+        }
+        for(i = 0; i < m; i++){
+            if(qEmpty(&outRaw) || qGet(&outRaw) != raw[i])
+                fail("host codec: decoded 0x%02x is not the text", raw[i]);
+            qPut(&txExpected, raw[i] | e);
+        }
+        outBytes += m;
+    }
+    if(n > 0)
+        outCoded += n;
+}
+#endif
+
+#ifdef MUX_CHANNELS
+/* The multi-channel mode on channel 0, the USART. Channel 1, the software
+ * UART of sw-uart.c, runs on Timer1 capture and compare, which the model
+ * does not have: it gets credit and must stay silent, its data is not
+ * checked.
+ */
+static struct {
+    int         on;
+    queue_t     out;            /* frames not yet in a packet */
+    int         txCredit;       /* channel 0 bytes the device granted */
+    int         rxCredit;       /* channel 0 bytes granted to the device, not received */
+    int         header, left, count;    /* OUT frame in progress at the device */
+    uint8_t     args[7];
+    unsigned long   codings;
+} mux;
+
+static void muxFrame(int header, const uint8_t *d, int n)
+{
+int     i;
+
+    qPut(&mux.out, header);
+    for(i = 0; i < n; i++)
+        qPut(&mux.out, d[i]);
+}
+
+static void muxMode(void)
+{
+uint8_t     s[8], d[7] = { MUX_BAUD_SELECT, 0, 0, 0, 0, 0, 8 }, credit = 64;
+
+    setupPacket(s, 0x21, 0x20, 0, 0, 7);
+    if(control(s, d) != 7)
+        fail("SET_LINE_CODING %d failed", MUX_BAUD_SELECT);
+    memset(&mux, 0, sizeof(mux));
+    mux.on = 1;
+    muxFrame(MUX_HDR(1, MUX_CMD_CREDIT), &credit, 1);
+    if(verbose)
+        printf("%10llu multi-channel mode\n", cycles);
+}
+
+/* MUX_CMD_CODING for channel 0, in place of SET_LINE_CODING */
+static void muxCoding(uint32_t baud, uint8_t stop, uint8_t parity, uint8_t data)
+{
+uint8_t     d[7];
+
+    d[0] = baud;
+    d[1] = baud >> 8;
+    d[2] = baud >> 16;
+    d[3] = baud >> 24;
+    d[4] = stop;
+    d[5] = parity;
+    d[6] = data;
+    muxFrame(MUX_HDR(0, MUX_CMD_CODING), d, 7);
+    mux.codings++;
+}
+
+/* credit for IN data while the device may run short of it */
+static int  muxCreditDue(void)
+{
+    return mux.on && qEmpty(&mux.out) && mux.rxCredit < 128;
+}
+
+/* Up to n bytes of frames for a bulk OUT packet: credit for IN first,
+ * then data within the credit of the device if produce.
+ */
+static int  muxPacket(uint8_t *pkt, int n, int produce)
+{
+uint8_t     d[MUX_DATA_MAX], credit = 64;
+int         i, len;
+
+    if(muxCreditDue()){
+        muxFrame(MUX_HDR(0, MUX_CMD_CREDIT), &credit, 1);
+        mux.rxCredit += credit;
+    }
+    if(qEmpty(&mux.out) && produce && mux.txCredit > 0){
+        len = rndRange(1, mux.txCredit < MUX_DATA_MAX ? mux.txCredit : MUX_DATA_MAX);
+        for(i = 0; i < len; i++)
+            d[i] = rnd();
+        muxFrame(MUX_HDR(0, len - 1), d, len);
+        mux.txCredit -= len;
+    }
+    for(i = 0; i < n && !qEmpty(&mux.out); i++)
+        pkt[i] = qGet(&mux.out);
+    return i;
+}
+
+/* A packet reached the device: frames apart as muxWriteOut() takes them,
+ * a coding applies to the data after it.
+ */
+static void muxDelivered(const uint8_t *pkt, int n)
+{
+uint32_t    e = lineExpected();
+int         i, type;
+
+    for(i = 0; i < n; i++){
+        type = MUX_HDR_TYPE(mux.header);
+        if(mux.left == 0){
+            mux.header = pkt[i];
+            mux.count = 0;
+            type = MUX_HDR_TYPE(mux.header);
+            mux.left = type == MUX_CMD_CREDIT ? 1 : type == MUX_CMD_CODING ? 7 : type + 1;
+            continue;
+        }
+        mux.left--;
+        if(!(mux.header & MUX_HDR_CMD)){
+            qPut(&txExpected, pkt[i] | e);
+            outBytes++;
+            continue;
+        }
+        mux.args[mux.count++] = pkt[i];
+        if(mux.left == 0 && type == MUX_CMD_CODING && MUX_HDR_CHANNEL(mux.header) == 0){
+            lineSet(mux.args[0] | mux.args[1] << 8 | mux.args[2] << 16 | (uint32_t)mux.args[3] << 24,
+                mux.args[4], mux.args[5], mux.args[6]);
+            e = lineExpected();
+        }
+    }
+}
+#endif
+
+static void bulkOut(int produce)
+{
+#ifndef COMP_MODE
+int         i;
+#endif
+int         r, corrupt;
+
+    if(outLen == 0){
+#ifdef MUX_CHANNELS
+        if(mux.on){
+            if(!produce && !muxCreditDue() && qEmpty(&mux.out))
+                return;
+            outLen = muxPacket(outPkt, rndRange(1, 8), produce);
+            goto packet;
+        }
+#endif
+        if(!produce)
+            return;
+        outLen = rndRange(0, 8);
+#ifdef COMP_MODE
+        outLen = compPacket(outPkt, outLen);
+#else
+        for(i = 0; i < outLen; i++)
+            outPkt[i] = outByte();
+#endif
+#ifdef MUX_CHANNELS
+packet:
+#endif
+        if(outLen == 0){
+            outLen = -1;    /* zero length packet */
+        }
+        outDelivered = 0;
+    }
+#ifdef MUX_CHANNELS
+    corrupt = corruptNext = 0;  /* or the frames */
+#else
+    corrupt = corruptNext = USB_CFG_CHECK_CRC_IN_POLL && outLen > 0 && fault();
+#endif
+    r = hostOut(1, outToggle, outPkt, outLen < 0 ? 0 : outLen);
+    corruptNext = 0;
+    if(r == USB_NAK){
+        naks++;
+        return;
+    }
+    if(r != USB_ACK)
+        fail("bulk OUT: no handshake");
+    if(corrupt){
+        outCorrupted++;
+        outDropped++;
+#ifdef COMP_MODE
+        if(!outDelivered){      /* else a duplicate to usbPoll() */
+            outDec.wait = LZ_ALIGN;
+            outDec.token = 0;
+        }
+#endif
+    }else if(outDelivered && USB_CFG_DROP_DUPLICATES){
+        outDropped += outLen > 0;
+    }else{
+#ifdef COMP_MODE
+        compDelivered(outPkt, outLen);
+#else
+#ifdef MUX_CHANNELS
+        if(mux.on){
+            muxDelivered(outPkt, outLen);
+        }else
+#endif
+        {
+            txQueue(outPkt, outLen);
+            if(outLen > 0)
+                outBytes += outLen;
+        }
+#endif
+        outDelivered = 1;
+    }
+    if(fault()){        /* the host misses the ACK and sends it again */
+        outResent++;
+        return;
+    }
+    outToggle ^= 1;
+    outLen = 0;
+}
+
+static void rxCheck(const char *path, const uint8_t *d, int n)
+{
+int         i;
+
+    for(i = 0; i < n; i++){
+        if(qEmpty(&rxExpected))
+            fail("%s: 0x%02x was not received by the USART", path, d[i]);
+        if(d[i] != qGet(&rxExpected))
+            fail("%s: wrong data 0x%02x at byte %lu", path, d[i], inBytes + i);
+    }
+    if(n > 0)
+        inBytes += n;
+}
+
+#ifdef CAPTURE_MODE
+static capDecoder_t     capDec;
+static unsigned long    capCoded;       /* record bytes on bulk IN */
+static long long        capSkewMin, capSkewMax; /* decoded time - arrival, ticks */
+
+/* capIrq() stamps a frame unless two full size OUT transactions keep it
+ * out, and capPoll() codes the time up to CAP_JITTER off either way
+ */
+#define CAP_LATE_MAX    ((2 * (3*8+3 + 11*8+3 + 8+3 + 8) * BIT_CYCLES + 63) / 64 + 2 * CAP_JITTER)
+
+static long long        capLateMax = CAP_LATE_MAX;
+
+static void capMode(int on)
+{
+uint8_t     s[8];
+
+    setupPacket(s, 0x40, VENDOR_RQ_CAPTURE, on, 0, 0);
+    if(control(s, NULL) < 0)
+        fail("VENDOR_RQ_CAPTURE stalled");
+    capDecInit(&capDec);
+    capSkewMin = LLONG_MAX;
+    capSkewMax = LLONG_MIN;
+}
+
+/* Records from bulk IN: the bytes must be the ones the USART received,
+ * the skew of their times against the arrival must stay within
+ * CAP_LATE_MAX ticks.
+ */
+static void capRecords(const uint8_t *d, int n)
+{
+capEvent_t  ev[8];
+long long   skew;
+int         i, m;
+
+    capCoded += n;
+    m = capDecode(&capDec, d, n, ev);
+    if(capDec.bad)
+        fail("bulk IN: %lu bytes are no capture record", capDec.bad);
+    for(i = 0; i < m; i++){
+        if(ev[i].flags & CAP_LOST)
+            fail("bulk IN: bytes lost before 0x%02x, rx_buf was full", ev[i].data);
+        if(ev[i].flags & ~CAP_OVERRUN)
+            fail("bulk IN: 0x%02x flagged 0x%02x", ev[i].data, ev[i].flags);
+        if(ev[i].flags & CAP_OVERRUN)
+            overrunSeen = 0;    /* the record reports it, not SERIAL_STATE */
+        if(qEmpty(&rxArrival))
+            fail("bulk IN: 0x%02x was not received by the USART", ev[i].data);
+        skew = (long long)(ev[i].time >> 8) - (long long)qGet(&rxArrival);
+        if(skew < capSkewMin)
+            capSkewMin = skew;
+        if(skew > capSkewMax)
+            capSkewMax = skew;
+        if(capSkewMax - capSkewMin > capLateMax)
+            fail("bulk IN: 0x%02x with a time %lld ticks off", ev[i].data, capSkewMax - capSkewMin);
+        rxCheck("bulk IN", &ev[i].data, 1);
+    }
+}
+#endif
+
+#ifdef MUX_CHANNELS
+/* IN frames: credit for channel 0 and its data within the credit granted.
+ * muxPoll() does not split a frame across packets.
+ */
+static void muxIn(const uint8_t *d, int n)
+{
+int     i, ch, len;
+
+    for(i = 0; i < n; i += len){
+        ch = MUX_HDR_CHANNEL(d[i]);
+        if(MUX_HDR_TYPE(d[i]) == MUX_CMD_CREDIT){
+            if(i + 2 > n)
+                fail("bulk IN: credit frame split");
+            if(ch == 0)
+                mux.txCredit += d[i + 1];
+            len = 2;
+            continue;
+        }
+        if(d[i] & MUX_HDR_CMD)
+            fail("bulk IN: command 0x%02x", d[i]);
+        len = MUX_HDR_TYPE(d[i]) + 1;
+        if(i + 1 + len > n)
+            fail("bulk IN: frame of %d bytes split", len);
+        if(ch != 0)
+            fail("bulk IN: %d bytes from channel %d, which receives nothing", len, ch);
+        mux.rxCredit -= len;
+        if(mux.rxCredit < 0)
+            fail("bulk IN: %d bytes beyond the credit", -mux.rxCredit);
+        rxCheck("bulk IN", d + i + 1, len);
+        len++;
+    }
+}
+#endif
+
+static int  bulkIn(void)
+{
+uint8_t     d[8];
+int         n;
+
+    n = hostIn(1, &inToggle1, d);
+#ifdef COMP_MODE
+    if(n > 0){
+        uint8_t raw[LZ_DECODE_MAX(8)];
+
+        inCoded += n;
+        rxCheck("bulk IN", raw, lzDecode(&inDec, d, n, raw));
+        if(inDec.syncs != inSyncs)
+            compResync();
+    }
+#elif defined CAPTURE_MODE
+    if(n > 0)
+        capRecords(d, n);
+#elif defined MUX_CHANNELS
+    if(mux.on && n > 0)
+        muxIn(d, n);
+    else
+        rxCheck("bulk IN", d, n);
+#else
+    rxCheck("bulk IN", d, n);
+#endif
+    return n;
+}
+
+#ifdef EP0_DATA
+static int          ep0Active, ep0Room;
+
+/* The bulk IN packet queued before the mode was turned on comes first. */
+static void ep0Mode(int on)
+{
+uint8_t     s[8];
+
+    setupPacket(s, 0x40, VENDOR_RQ_DATA, on, 0, 0);
+    if(control(s, NULL) < 0)
+        fail("VENDOR_RQ_DATA %d stalled", on);
+    ep0Active = on;
+    ep0Room = 0;
+    if(on)
+        while(bulkIn() != -USB_NAK)
+            run(rndRange(1, 200));
+    if(verbose)
+        printf("%10llu control transfer data %s\n", cycles, on ? "on" : "off");
+}
+
+#if !defined COMP_MODE && !defined CAPTURE_MODE  /* the modes exclude each other */
+static void ep0In(void)
+{
+uint8_t     s[8], d[254];
+int         n;
+
+    setupPacket(s, 0xc0, VENDOR_RQ_DATA, 0, 0, rndRange(1, 254));
+    n = control(s, d);
+    if(n < 1)
+        fail("VENDOR_RQ_DATA IN: %d bytes", n);
+    ep0Room = d[0];
+    rxCheck("control IN", d + 1, n - 1);
+}
+
+/* Sometimes 255 bytes, more than the room can be, which must be stalled.
+ * The USART may send the first bytes before the transfer ends.
+ */
+static void ep0Out(void)
+{
+uint8_t     s[8], d[255];
+int         i, n, r, over = rnd() % 8 == 0;
+
+    if(!over && ep0Room == 0)
+        return;
+    n = over ? 255 : rndRange(1, ep0Room);
+    for(i = 0; i < n; i++)
+        d[i] = outByte();
+    if(!over){
+        txQueue(d, n);
+        outBytes += n;
+        ep0Room -= n;
+    }
+    setupPacket(s, 0x40, VENDOR_RQ_DATA, 0, 0, n);
+    r = control(s, d);
+    if(over ? r >= 0 : r != n)
+        fail("VENDOR_RQ_DATA OUT: %d bytes, room %d, %s", n, ep0Room, r < 0 ? "stalled" : "taken");
+}
+#endif
+#else
+#define ep0Active   0
+#endif
+
+static void interruptIn(void)
+{
+uint8_t     d[8];
+int         n;
+
+    n = hostIn(USB_CFG_EP3_NUMBER, &inToggle3, d);
+    if(n < 0)
+        return;
+    if(notifyPos + n > 10 || (notifyPos == 0 && n != 8))
+        fail("SERIAL_STATE notification split %d + %d", notifyPos, n);
+    memcpy(notify + notifyPos, d, n);
+    notifyPos += n;
+    if(notifyPos == 10){
+        if(notify[0] != 0xa1 || notify[1] != 0x20 || notify[6] != 2)
+            fail("bad SERIAL_STATE notification");
+        serialState = notify[8];
+        if(serialState & UART_STATE_OVERRUN)
+            overrunSeen = 0;
+        notifications++;
+        notifyPos = 0;
+    }
+}
+
+/* one random host action */
+static void traffic(int produce)
+{
+int     r = rnd() % 100;
+
+    if(r < 35){
+        bulkOut(produce && !ep0Active);
+    }else if(r < 75){
+        bulkIn();
+    }else if(r < 85){
+        interruptIn();
+    }else if(!produce){
+        /* idle */
+    }else if(r < 87){
+#ifdef MUX_CHANNELS
+        if(mux.on){     /* SET_LINE_CODING would end the mode */
+            muxCoding(bauds[rnd() % (sizeof(bauds) / sizeof(bauds[0]))],
+                rnd() % 3, rnd() % 4, rndRange(7, 8));
+            return;
+        }
+#endif
+        setLineCoding(bauds[rnd() % (sizeof(bauds) / sizeof(bauds[0]))],
+            rnd() % 3, rnd() % 4, rndRange(7, 8));
+    }else if(r < 89){
+        getLineCoding();
+    }else if(r < 90){
+        setControlLineState(rnd() & 1);
+#ifdef ALT_PROFILES
+    }else if(r < 91 && outLen == 0){     /* not with an OUT packet in flight */
+        setInterface(rnd() % ALT_PROFILE_COUNT);
+#ifdef EP0_DATA
+        ep0Room = 0;    /* the profile may have less room */
+#endif
+#endif
+#if defined EP0_DATA && !defined COMP_MODE && !defined CAPTURE_MODE
+    }else if(r < 93){
+        if(ep0Active && outLen == 0)    /* the room counts all bulk OUT data */
+            ep0In();
+    }else if(r < 95){
+        if(ep0Active && outLen == 0)
+            ep0Out();
+    }else if(r < 96){
+        ep0Mode(!ep0Active);
+#endif
+    }
+}
+
+static void check(void)
+{
+unsigned long long  timeout;
+
+    peer.on = 0;
+#ifdef EP0_DATA
+    if(ep0Active)
+        ep0Mode(0);
+#endif
+    timeout = cycles + 10 * (unsigned long long)F_CPU;
+    while(outLen != 0 || !qEmpty(&txExpected) || !qEmpty(&rxExpected) || peer.busy || usart.fifoLen
+            || overrunSeen
+#ifdef COMP_MODE
+            || compStats.resyncs != (uint8_t)inSyncs
+#endif
+            ){
+        if(cycles > timeout)
+            fail("drain timeout: %u bytes not sent, %u bytes not received%s",
+                txExpected.head - txExpected.tail, rxExpected.head - rxExpected.tail,
+                overrunSeen ? ", overrun not reported" : "");
+        traffic(0);
+        run(rndRange(1, 2000));
+    }
+}
+
+#ifndef COMP_MODE
+/* Line codings queued behind data at slow rates, more of them than
+ * main.c keeps: each byte must leave with the coding set before it, and
+ * control requests are answered while the codings wait.
+ */
+static void codingCheck(void)
+{
+static const uint32_t   rates[] = { 2400, 4800, 1200, 9600, 2400, 19200 };
+unsigned                i;
+int                     on = peer.on;
+
+    for(i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+        bulkOut(1);
+        while(outLen != 0){
+            run(rndRange(1, 2000));
+            bulkOut(0);
+        }
+        setLineCoding(rates[i], 0, i & 1 ? 2 : 0, 8);
+        getLineCoding();
+    }
+    check();
+    peer.on = on;       /* check() stops it */
+}
+#endif
+
+static void randomRun(void)
+{
+#ifdef CAPTURE_MODE
+int         i;
+#endif
+
+    rngState = seed ? seed : 1;
+    peer.on = 1;
+    peer.gap = 2;
+#if defined COMP_MODE || defined CAPTURE_MODE
+    peer.on = 0;        /* no data before the mode is on */
+#endif
+    fwStart();
+    enumerate();
+#ifdef AUTO_BAUD
+    check();            /* autobaud.c drops what the USART has */
+    autobaudCheck();
+    peer.on = 1;
+    peer.gap = 2;
+#endif
+#ifdef RS485_DE
+    rs485Mode(rnd() % 2 ? rndRange(1, 255) : 0);
+#endif
+#if defined MPCM_MODE && defined RS485_DE
+    mpcmMode(0);        /* the filter drops the echoes of data to other nodes */
+#elif defined MPCM_MODE
+    mpcmMode(rnd() % 2);
+#endif
+#ifdef COMP_MODE
+    compMode(1);
+    peer.on = 1;
+#else
+    codingCheck();
+#endif
+#ifdef MUX_CHANNELS
+    muxMode();
+#endif
+#ifdef CAPTURE_MODE
+    capMode(1);
+    peer.on = 1;
+#endif
+    for(step = 0; step < steps; step++){
+        traffic(1);
+        if(step % 1000 == 0)
+            peer.gap = rnd() % 8;
+        run(rndRange(1, 2000));
+    }
+    check();
+#if USB_CFG_CHECK_CRC_IN_POLL || USB_CFG_DROP_DUPLICATES
+    if(usbCrcErrors + usbDuplicates != outDropped)
+        fail("usbPoll() dropped %u packets (%u CRC, %u duplicates), expected %lu",
+            usbCrcErrors + usbDuplicates, usbCrcErrors, usbDuplicates, outDropped);
+#endif
+    printf("seed %u: %ld steps, %lu transactions (%lu NAK), %.3f s model time\n",
+        seed, steps, transactions, naks, cycles / (double)F_CPU);
+    printf("OUT %lu bytes, USART sent %lu; USART received %lu, IN %lu bytes, %lu lost in overruns\n",
+        outBytes, txBytes, rxBytes, inBytes, peer.lost);
+    printf("%lu SERIAL_STATE notifications, %llu main loop iterations, %llu register accesses\n",
+        notifications, loops, accesses);
+    if(faultRate > 0)
+        printf("faults: %lu OUT packets corrupted, %lu sent again, %lu dropped by usbPoll()\n",
+            outCorrupted, outResent, outDropped);
+#ifdef COMP_MODE
+    if(compStats.rxRaw != inBytes || compStats.rxCoded != inCoded
+            || compStats.txCoded != outCoded || compStats.txRaw != outBytes)
+        fail("compression counters IN %u/%u OUT %u/%u, expected IN %lu/%lu OUT %lu/%lu",
+            compStats.rxRaw, compStats.rxCoded, compStats.txCoded, compStats.txRaw,
+            inBytes, inCoded, outCoded, outBytes);
+    if(compStats.resyncs != (uint8_t)inSyncs)
+        fail("%u syncs sent by the device, %u received", compStats.resyncs, inSyncs);
+    printf("compression: IN %lu bytes in %lu (%.2f:1), OUT %lu bytes in %lu (%.2f:1)\n",
+        inBytes, inCoded, inCoded ? (double)inBytes / inCoded : 0.0,
+        outBytes, outCoded, outCoded ? (double)outBytes / outCoded : 0.0);
+#endif
+#ifdef MUX_CHANNELS
+    printf("multi-channel: %lu codings in MUX_CMD_CODING, channel 0 credit %d OUT %d IN\n",
+        mux.codings, mux.txCredit, mux.rxCredit);
+#endif
+#ifdef CAPTURE_MODE
+    for(i = 0; capStats.coded != capCoded && i < 100; i++){ /* a start record without bytes */
+        bulkIn();
+        run(200);
+    }
+    if(capStats.bytes != rxBytes || capStats.coded != capCoded || capStats.lost || capStats.errors)
+        fail("capture counters %u bytes %u coded %u lost %u errors, expected %lu/%lu/0/0",
+            capStats.bytes, capStats.coded, capStats.lost, capStats.errors, rxBytes, capCoded);
+    printf("capture: %lu bytes in %lu (%.2f per byte), times %.2f ms apart at most\n",
+        inBytes, capCoded, inBytes ? (double)capCoded / inBytes : 0.0,
+        (capSkewMax - capSkewMin) * 64e3 / F_CPU);
+#endif
+#ifdef RS485_DE
+    if(rs485Stats.echoes != (uint16_t)echoBytes)
+        fail("%u echoes dropped, the USART received %lu", rs485Stats.echoes, echoBytes);
+    rs485Report();
+#endif
+#ifdef MPCM_MODE
+    if(mpcmStats.addresses != (uint16_t)mpcm.addresses || mpcmStats.matched != (uint16_t)mpcm.matched
+            || mpcmStats.dropped != (uint16_t)mpcm.dropped)
+        fail("9 bit mode counters %u addresses %u matched %u dropped, expected %lu/%lu/%lu",
+            mpcmStats.addresses, mpcmStats.matched, mpcmStats.dropped,
+            mpcm.addresses, mpcm.matched, mpcm.dropped);
+    printf("9 bit mode: %lu addresses, %lu matched, %lu data frames dropped by mpcmRx()%s\n",
+        mpcm.addresses, mpcm.matched, mpcm.dropped, mpcm.flags & MPCM_FILTER ? "" : " (no filter)");
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Benchmarks ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static double   now(void)
+{
+struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+#define BENCH_GAP   50
+#define FRAME       (F_CPU / 1000)          /* 1 ms */
+#define HOST_TIME   (1000 * FRAME)          /* per host schedule */
+#define HOST_GAP    (8 * BIT_CYCLES)        /* between back to back transactions */
+
+typedef struct snapshot {
+    double              t;
+    unsigned long long  loops, accesses, cycles;
+} snapshot_t;
+
+static void snap(snapshot_t *s)
+{
+    s->t = now();
+    s->loops = loops;
+    s->accesses = accesses;
+    s->cycles = cycles;
+}
+
+static void report(const char *name, snapshot_t *a, unsigned long n, const char *unit)
+{
+snapshot_t  b;
+
+    snap(&b);
+    printf("%-6s %9lu %-5s %8.1f ns %8.2f loops %8.1f accesses %9.1f cycles per %s\n", name, n, unit,
+        (b.t - a->t) * 1e9 / n, (double)(b.loops - a->loops) / n,
+        (double)(b.accesses - a->accesses) / n, (double)(b.cycles - a->cycles) / n, unit);
+}
+
+static void latencyReport(const char *name, latency_t *l)
+{
+double  mean = l->sum / l->n;
+
+    printf("%-6s %9lu bytes, latency %8.1f mean %8.1f sd %6llu max cycles\n", name, l->n,
+        mean, sqrt(l->squares / l->n - mean * mean), l->max);
+}
+
+/* Single bytes with idle time in between, at a random phase of the main
+ * loop: the time the firmware takes to see them, and its jitter.
+ */
+static void latency(long n)
+{
+unsigned long   sent;
+long            i;
+
+    latencyOn = 1;
+    for(i = 0; i < n; i++){
+        runCycles(FRAME / 4 + rnd() % FRAME);
+        sent = peer.sent;
+        peer.on = 1;
+        while(peer.sent == sent)
+            run(1);
+        peer.on = 0;
+        while(peer.busy || usart.fifoLen || !qEmpty(&rxExpected)){
+            bulkIn();
+            run(BENCH_GAP);
+        }
+    }
+    latencyOn = 0;
+    latencyReport("rx", &rxLatency);
+    for(i = 0; i < n; i++){
+        runCycles(FRAME / 4 + rnd() % FRAME);
+        outDelivered = 0;
+#ifdef COMP_MODE
+        outLen = compPacket(outPkt, 1);
+#else
+        outLen = 1;
+        outPkt[0] = rnd();
+#endif
+        txAckAt = 0;
+        while(outLen){
+            bulkOut(0);
+            if(outLen)
+                run(BENCH_GAP);
+        }
+        txAckAt = cycles;
+        while(!qEmpty(&txExpected))
+            run(200);
+    }
+    txAckAt = 0;
+    latencyReport("tx", &txLatency);
+}
+
+/* Both directions at once, in model time, when the host starts a
+ * transaction on each data endpoint every period cycles, or back to back
+ * with HOST_GAP in between for period 0. IN comes first: V-USB NAKs an IN
+ * token while an OUT packet waits for usbPoll(). Frame overhead (SOF,
+ * keep-alive) is not modelled, the back to back numbers are an upper bound.
+ */
+static void schedule(const char *name, unsigned long long period)
+{
+unsigned long long  start, next;
+unsigned long       in = inBytes, out = outBytes, tr = transactions, nak = naks;
+double              t;
+#ifndef COMP_MODE
+int                 i;
+#endif
+
+    peer.on = 1;
+    peer.gap = 0;
+    start = cycles;
+    while(cycles - start < HOST_TIME){
+        next = cycles + period;
+        if(outLen == 0){
+            outDelivered = 0;
+#ifdef COMP_MODE
+            outLen = compPacket(outPkt, 8);
+#else
+            outLen = 8;
+            for(i = 0; i < 8; i++)
+                outPkt[i] = rnd();
+#endif
+        }
+        bulkIn();
+        bulkOut(0);
+        runCycles(cycles < next ? next - cycles : HOST_GAP);
+    }
+    t = (cycles - start) / (double)F_CPU;
+    printf("%-20s OUT %6.0f B/s  IN %6.0f B/s  %5.2f transactions/ms, %4.1f%% NAK\n", name,
+        (outBytes - out) / t, (inBytes - in) / t, (transactions - tr) / (t * 1000),
+        100.0 * (naks - nak) / (transactions - tr));
+    peer.on = 0;
+    while(outLen || !qEmpty(&txExpected) || peer.busy || usart.fifoLen || !qEmpty(&rxExpected)){
+        bulkOut(0);
+        bulkIn();
+        run(200);
+    }
+}
+
+static void bench(void)
+{
+snapshot_t  s;
+long        i;
+
+    rngState = seed ? seed : 1;
+    fwStart();
+    enumerate();
+    printf("enumeration after %s reset: attached %.1f ms, configured %.1f ms\n",
+        resetFlags & (1 << PORF) ? "power-on" : "watchdog",
+        attachedAt * 1000.0 / F_CPU, configuredAt * 1000.0 / F_CPU);
+    setLineCoding(1000000, 0, 0, 8);
+    interruptIn();
+    interruptIn();
+#ifdef COMP_MODE
+    compMode(1);
+#endif
+#ifdef CAPTURE_MODE
+    capMode(1);
+    capLateMax = LLONG_MAX;     /* at 1 Mbps capPoll() falls behind the ring of
+                                   capIrq(), the frames after it are stamped late */
+#endif
+#ifdef RS485_DE
+    rs485Mode(0);
+#endif
+#ifdef MPCM_MODE
+    mpcmMode(0);
+#endif
+
+    /* idle main loop */
+    snap(&s);
+    for(i = 0; i < steps; i++)
+        run(100);
+    report("idle", &s, loops - s.loops, "loop");
+
+    /* USB -> USART, one transaction per BENCH_GAP accesses, which is
+     * about the time of a packet on the bus
+     */
+    snap(&s);
+    outBytes = 0;
+    while(outBytes < (unsigned long)steps){
+        outLen = 8;
+        outDelivered = 0;
+#ifdef COMP_MODE
+        outLen = compPacket(outPkt, 8);
+#else
+        for(i = 0; i < 8; i++)
+            outPkt[i] = rnd();
+#endif
+        while(outLen){
+            bulkOut(0);
+            run(BENCH_GAP);
+        }
+    }
+    while(!qEmpty(&txExpected))
+        run(200);
+    report("tx", &s, outBytes, "byte");
+
+    /* USART -> USB, peer sending back to back */
+    peer.on = 1;
+    peer.gap = 0;
+    snap(&s);
+    inBytes = 0;
+    while(inBytes < (unsigned long)steps){
+        bulkIn();
+        run(BENCH_GAP);
+    }
+    report("rx", &s, inBytes, "byte");
+    peer.on = 0;
+    while(peer.busy || usart.fifoLen || !qEmpty(&rxExpected)){
+        bulkIn();
+        run(200);
+    }
+
+    latency(steps / 10);
+
+    /* host schedules, both directions at once, USART at 1 Mbps */
+    if(dataEpType == 3){
+        char    name[32];
+
+        snprintf(name, sizeof(name), "interrupt, %d ms", dataEpInterval);
+        schedule(name, dataEpInterval * FRAME);
+    }else{
+        schedule("bulk, 1 per frame", FRAME);
+        schedule("bulk, back to back", 0);
+    }
+#ifdef RS485_DE
+    rs485Report();
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s seed] [-n steps] [-f rate] [-b] [-w] [-v]\n", name);
+    fprintf(stderr, "  -s seed   random seed, default 1\n");
+    fprintf(stderr, "  -f rate   bulk OUT packets corrupted and ACKs lost, e.g. 0.01\n");
+    fprintf(stderr, "  -n steps  host transactions, or bytes with -b (default 100000)\n");
+    fprintf(stderr, "  -b        benchmarks instead of the random run\n");
+    fprintf(stderr, "  -w        start after a watchdog reset, not a power-on reset\n");
+    fprintf(stderr, "  -v        verbose\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+int     opt, benchmark = 0;
+
+    while((opt = getopt(argc, argv, "s:n:f:bwv")) != -1){
+        switch(opt){
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'f': faultRate = atof(optarg); break;
+        case 'n': steps = strtol(optarg, NULL, 0); break;
+        case 'b': benchmark = 1; break;
+        case 'w': resetFlags = 1 << WDRF; break;
+        case 'v': verbose++; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(optind != argc)
+        usage(argv[0]);
+    if(benchmark)
+        bench();
+    else
+        randomRun();
+    return 0;
+}
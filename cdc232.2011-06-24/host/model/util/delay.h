@@ -0,0 +1,18 @@
+/* Name: delay.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+/* Host replacement of <util/delay.h> for cdcmodel: model time passes. */
+
+#ifndef __mock_delay_h_included__
+#define __mock_delay_h_included__
+
+extern void mockDelayUs(double us);
+
+#define _delay_ms(ms)   mockDelayUs((ms) * 1000.0)
+#define _delay_us(us)   mockDelayUs(us)
+
+#endif
@@ -0,0 +1,340 @@
+# Name: timing.awk
+# Project: AVR USB driver for CDC interface on Low-Speed USB
+# Creation Date: 2026-10-19
+# Tabsize: 4
+# License: Proprietary, free under certain conditions. See Documentation.
+#
+# General Description:
+#   Worst case cycles with interrupts disabled, from "avr-objdump -d" of the
+#   firmware. The USB interrupt must not wait longer than V-USB allows
+#   (usbdrv.h, "Interrupt latency"), so every other interrupt routine counts
+#   from the interrupt response to its sei or reti, and every cli counts to
+#   the following sei or SREG restore, plus the one instruction the AVR
+#   still executes after them. Calls are followed, both ways of branches and
+#   skips are taken, loops and indirect jumps cannot be bounded and fail the
+#   check. Used by "make timing-check" in the firmware directories:
+#
+#   avr-objdump -d cdcmega.elf | awk -f timing.awk -v usb="__vector_1 (12000000UL/1000)"
+#
+#   usb is USB_INTR_VECTOR and USB_CFG_CLOCK_KHZ after the preprocessor,
+#   an undefined USB_INTR_VECTOR is INT0 (__vector_1) as in usbdrvasm.S.
+#   budget overrides the allowed cycles, ignore lists functions whose calls
+#   in a cli section are accepted (e.g. calibrateOscillator, which must run
+#   with interrupts disabled). The exit code is 1 if a check fails.
+#
+#   So far this has only been run on hand-written disassembly, not on the
+#   avr-objdump output of a firmware build; check its first reports on a
+#   real build against the listing (.lss).
+
+function hex(s,    i, v) {
+    s = tolower(s)
+    sub(/^ *(0x)?/, "", s)
+    sub(/[^0-9a-f].*$/, "", s)
+    v = 0
+    for(i = 1; i <= length(s); i++)
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return v
+}
+
+# cycles of the classic AVR core, branches and skips are handled in walk()
+function cycles(m) {
+    if(m == "call" || m == "ret" || m == "reti")
+        return 4
+    if(m == "rcall" || m == "icall" || m == "eicall" || m == "jmp" || m == "lpm" || m == "elpm")
+        return 3
+    if(m ~ /^(rjmp|ijmp|eijmp|ld|ldd|st|std|lds|sts|push|pop|sbi|cbi|adiw|sbiw|mul|muls|mulsu|fmul|fmuls|fmulsu)$/)
+        return 2
+    return 1
+}
+
+function isBranch(m) {
+    return m ~ /^br/ && m != "break"
+}
+
+function isSkip(m) {
+    return m == "cpse" || m == "sbrc" || m == "sbrs" || m == "sbic" || m == "sbis"
+}
+
+# the interrupt flag is set again: sei, reti, and in cli sections a write
+# to SREG, which restores the state from before the cli. A function called
+# from the section is walked as "nest": its SREG restore returns to the
+# state of the caller, which has interrupts disabled.
+function isEnd(mode, a,    m) {
+    m = mn[a]
+    if(m == "sei" || m == "reti")
+        return 1
+    return mode == "cli" && m == "out" && ops[a] ~ /^0x3f,/
+}
+
+# the AVR executes one more instruction after sei, reti or the SREG write
+# before it serves a pending interrupt; after reti that is any instruction
+# of the interrupted code, at most 4 cycles (call, ret)
+function after(a,    n, m) {
+    if(mn[a] == "reti")
+        return 4
+    n = nxt[a]
+    if(!(n in mn))
+        return 0
+    m = mn[n]
+    if(isBranch(m))
+        return 2
+    if(isSkip(m))
+        return 1 + size[nxt[n]] / 2
+    return cycles(m)
+}
+
+function addc(c, v) {
+    if(v == NEG)
+        return NEG
+    if(v >= INF)
+        return INF
+    return c + v
+}
+
+function maxc(x, y) {
+    return x > y ? x : y
+}
+
+# longest path from a to the end (S) and to a ret with interrupts still
+# disabled (R), without recursion (mawk has a small stack)
+function walk(mode, root,    sp, md, cm, a, k, m, n, t, s, r, c, u, v, st, i) {
+    sp = 0
+    stack[++sp] = root
+    smode[sp] = mode
+    while(sp > 0){
+        a = stack[sp]
+        md = smode[sp]
+        cm = md == "cli" ? "nest" : md
+        k = md SUBSEP a
+        if(state[k] == 2){
+            sp--
+            continue
+        }
+        m = mn[a]
+        n = nxt[a]
+        t = tgt[a]
+        if(state[k] == 0){
+            state[k] = 1
+            if(!(a in mn) || isEnd(md, a) || m == "ret" || m ~ /^e?i(jmp|call)$/)
+                continue
+            if(m == "rcall" || m == "call"){
+                todo[1] = n
+                if(!(fn[t] in ignored)){
+                    todo[2] = t
+                    tmode[2] = cm
+                }
+            }else if(m == "rjmp" || m == "jmp"){
+                todo[1] = t
+            }else if(isBranch(m)){
+                todo[1] = n
+                todo[2] = t
+            }else if(isSkip(m)){
+                todo[1] = n
+                todo[2] = nxt[n]
+            }else{
+                todo[1] = n
+            }
+            for(i = 1; i in todo; i++){
+                u = (i in tmode) ? tmode[i] : md
+                st = state[u SUBSEP todo[i]]
+                if(st == 0){
+                    stack[++sp] = todo[i]
+                    smode[sp] = u
+                }else if(st == 1 && !(k in why))
+                    why[k] = "loop at " fn[todo[i]] "+0x" sprintf("%x", todo[i] - start[fn[todo[i]]])
+                delete todo[i]
+                delete tmode[i]
+            }
+            continue
+        }
+        # all successors are done or on the stack (loop)
+        state[k] = 2
+        sp--
+        c = cycles(m)
+        s = NEG
+        r = NEG
+        if(!(a in mn)){
+            s = INF
+            why[k] = sprintf("jump to 0x%x outside the code", a)
+        }else if(isEnd(md, a)){
+            s = c + after(a)
+        }else if(m == "ret"){
+            r = c
+        }else if(m ~ /^e?i(jmp|call)$/){
+            s = INF
+            why[k] = "indirect " m " at " fn[a] "+0x" sprintf("%x", a - start[fn[a]])
+        }else if(m == "rcall" || m == "call"){
+            if(fn[t] in ignored){
+                u = NEG
+                v = 0
+                skip[k] = fn[t]
+            }else{
+                u = val(cm, t, "S", k)
+                v = val(cm, t, "R", k)
+            }
+            s = maxc(addc(c, u), addc(c, addc(v, val(md, n, "S", k))))
+            r = addc(c, addc(v, val(md, n, "R", k)))
+        }else if(m == "rjmp" || m == "jmp"){
+            s = addc(c, val(md, t, "S", k))
+            r = addc(c, val(md, t, "R", k))
+        }else if(isBranch(m)){
+            s = maxc(addc(1, val(md, n, "S", k)), addc(2, val(md, t, "S", k)))
+            r = maxc(addc(1, val(md, n, "R", k)), addc(2, val(md, t, "R", k)))
+        }else if(isSkip(m)){
+            c = 1 + size[n] / 2
+            s = maxc(addc(1, val(md, n, "S", k)), addc(c, val(md, nxt[n], "S", k)))
+            r = maxc(addc(1, val(md, n, "R", k)), addc(c, val(md, nxt[n], "R", k)))
+        }else{
+            s = addc(c, val(md, n, "S", k))
+            r = addc(c, val(md, n, "R", k))
+        }
+        if(k in why)
+            s = INF
+        S[k] = s
+        R[k] = r
+    }
+}
+
+# value of a successor; one still in progress is a loop. Notes and skipped
+# calls are passed on to the predecessor k.
+function val(mode, a, which, k,    j) {
+    j = mode SUBSEP a
+    if(state[j] != 2)
+        return INF
+    if((j in why) && !(k in why))
+        why[k] = why[j]
+    if((j in skip) && !(k in skip))
+        skip[k] = skip[j]
+    return which == "S" ? S[j] : R[j]
+}
+
+function check(name, c, k,    verdict) {
+    if(c >= INF)
+        verdict = "unbounded, " why[k]
+    else if(c > budget)
+        verdict = "exceeds the budget"
+    else if(k in skip)
+        verdict = "ok (calls " skip[k] ")"
+    else
+        verdict = "ok"
+    if(c >= INF || c > budget)
+        failed++
+    if(c >= INF)
+        printf("  %-28s %6s  %s\n", name, "-", verdict)
+    else
+        printf("  %-28s %6d  %s\n", name, c, verdict)
+}
+
+BEGIN {
+    NEG = -1
+    INF = 1000000000
+    split(ignore, list, /[ ,]+/)
+    for(i in list)
+        if(list[i] != "")
+            ignored[list[i]] = 1
+}
+
+/^[0-9a-f]+ <[^>]+>:$/ {
+    cur = $2
+    gsub(/[<>:]/, "", cur)
+    start[cur] = hex($1)
+    next
+}
+
+/^ *[0-9a-f]+:\t/ {
+    nf = split($0, fld, "\t")
+    a = hex(fld[1])
+    if(nf < 3)
+        next
+    m = fld[3]
+    gsub(/ /, "", m)
+    if(m == "")
+        next
+    n = split(fld[2], bytes, " ")
+    mn[a] = m
+    ops[a] = nf >= 4 ? fld[4] : ""
+    size[a] = n
+    fn[a] = cur
+    order[++na] = a
+    if(na > 1)
+        nxt[order[na - 1]] = a
+    if(match($0, /; 0x[0-9a-f]+/))
+        tgt[a] = hex(substr($0, RSTART + 2, RLENGTH - 2))
+    else if(m == "jmp" || m == "call")
+        tgt[a] = hex(ops[a])
+    if(cur == "__vectors" && (m == "jmp" || m == "rjmp") && !(tgt[a] in vector))
+        vector[tgt[a]] = cycles(m)
+}
+
+END {
+    split(usb, u, " ")
+    usbVector = u[1]
+    if(usbVector == "USB_INTR_VECTOR")  # default of usbdrvasm.S
+        usbVector = "__vector_1"
+    clock = u[2]
+    gsub(/[()UL]/, "", clock)
+    if(split(clock, q, "/") == 2)
+        clock = int(q[1] / q[2])
+    clock += 0
+    # usbdrvasm12.inc and usbdrvasm165.inc allow 25 and 52 cycles; in
+    # between the budget grows with the bit time, above 16.5 MHz it stays
+    if(budget == ""){
+        if(clock <= 12000)
+            budget = 25
+        else if(clock >= 16500)
+            budget = 52
+        else
+            budget = int(25 + (clock - 12000) * 27 / 4500)
+    }
+    if(clock == 0 || na == 0){
+        print "timing: no USB_CFG_CLOCK_KHZ or no disassembly"
+        exit 1
+    }
+    printf("timing: USB_CFG_CLOCK_KHZ %d, at most %d cycles with interrupts disabled\n", clock, budget)
+    found = 0
+    for(i = 0; i < 128; i++){
+        f = "__vector_" i
+        if(!(f in start))
+            continue
+        if(f == usbVector){
+            found = 1
+            printf("  %-28s %6s  USB interrupt\n", f, "")
+            continue
+        }
+        a = start[f]
+        walk("isr", a)
+        k = "isr" SUBSEP a
+        # interrupt response and the jump in the vector table
+        c = addc(4 + ((a in vector) ? vector[a] : 3), S[k])
+        if(R[k] != NEG){
+            c = INF
+            if(!(k in why))
+                why[k] = "returns with ret"
+        }
+        check(f, c, k)
+    }
+    if(!found)
+        printf("  USB interrupt %s not found, all vectors checked\n", usbVector)
+    # PROGMEM data sits between the vectors and __ctors_end and can decode
+    # as cli
+    dataEnd = ("__ctors_end" in start) ? start["__ctors_end"] : 0
+    for(i = 1; i <= na; i++){
+        a = order[i]
+        if(mn[a] != "cli" || a < dataEnd)
+            continue
+        n = nxt[a]
+        walk("cli", n)
+        k = "cli" SUBSEP n
+        c = addc(1, S[k])
+        if(R[k] != NEG){
+            c = INF
+            if(!(k in why))
+                why[k] = "returns with interrupts disabled"
+        }
+        check("cli in " fn[a] "+0x" sprintf("%x", a - start[fn[a]]), c, k)
+    }
+    if(failed){
+        printf("timing: %d failed\n", failed)
+        exit 1
+    }
+}
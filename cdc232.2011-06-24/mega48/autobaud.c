@@ -0,0 +1,191 @@
+/* Name: autobaud.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the baud rate detection, see autobaud.h.
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "mux.h"
+#include "capture.h"
+#include "autobaud.h"
+
+#ifdef AUTO_BAUD
+
+#define AB_MAX_BITS     10      /* a longer interval is idle line */
+#define AB_IDLE         0x8000  /* Timer1 ticks without an edge end a measurement */
+#define AB_GUESSES      4       /* shortest intervals tried per measurement */
+
+uchar               autobaudActive;
+ulong               autobaudRate;
+vendorAutobaud_t    autobaudStats;
+
+static unsigned short   abStamp[AUTOBAUD_EDGES];
+static volatile uchar   abEdges;
+static uchar            abTimer;    /* TCCR1B before */
+
+static const ulong  abRates[] PROGMEM = {
+    300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600,
+    76800, 115200, 230400, 250000, 460800, 500000, 1000000
+};
+
+
+/*  Any edge on RXD (PCINT16 is PD0).  */
+ISR( PCINT2_vect, ISR_NOBLOCK )
+{
+unsigned short  t = TCNT1;
+uchar           n = abEdges;
+
+    if( n<AUTOBAUD_EDGES ) {
+        abStamp[n]  = t;
+        abEdges = n + 1;
+    }
+}
+
+void autobaudStart(uchar on)
+{
+
+    on  = on && !muxActive && !capActive;
+    if( on && !autobaudActive ) {
+        abTimer = TCCR1B;
+        TCCR1B  = (abTimer & ~7) | (1<<CS11);   /* F_CPU/8 */
+        autobaudStats.tries = 0;
+        autobaudStats.edges = 0;
+    }
+    if( !on && autobaudActive )
+        TCCR1B  = abTimer;
+    PCMSK2  = on? (1<<UART_CFG_RXD) : 0;
+    PCIFR   = (1<<PCIF2);
+    PCICR   = on? PCICR | (1<<PCIE2) : PCICR & ~(1<<PCIE2);
+    abEdges = 0;
+    autobaudActive  = on;
+    autobaudRate    = 0;
+    autobaudStats.active    = on;
+}
+
+void autobaudApplied(void)
+{
+
+    autobaudStats.baud  = autobaudRate;
+    autobaudStart(0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*  Fits a bit time bt (CPU cycles times 16, a tick is 128) to the
+    intervals of up to maxBits bits between the n edges, and returns its
+    new value, or 0 if more than 1 in 4 intervals are off the bit grid by
+    more than a quarter bit. An interval shorter than half a bit (an edge
+    that was stamped late) is joined with the next, and all intervals
+    count in the result: the error of a late stamp cancels out with the
+    next interval.  */
+static ulong abFit(ulong bt, uchar n, uchar maxBits)
+{
+ulong           d, k, m, sum = 0, carry = 0;
+unsigned short  bits = 0;
+uchar           i, good = 0, bad = 0;
+
+    for( i=1; i<n; i++ ) {
+        d   = carry + (unsigned short)(abStamp[i] - abStamp[i-1]) * 128UL;
+        k   = (d + (bt>>1)) / bt;
+        if( k==0 ) {
+            carry   = d;
+            bad++;
+            continue;
+        }
+        carry   = 0;
+        if( k>maxBits )
+            continue;       /* the line was idle */
+        m   = k * bt;
+        if( (d>m? d-m : m-d)>(bt>>2) ) {
+            bad++;
+        }
+        else {
+            sum     += d;
+            bits    += k;
+            good++;
+        }
+    }
+    if( bad*4>n || good<AUTOBAUD_MIN_EDGES-1 )
+        return 0;
+    return sum / bits;
+}
+
+/*  The bit time from the edges: the shortest intervals are the guesses,
+    the intervals of up to 3 bits refine the guess, then all of up to
+    AB_MAX_BITS bits fit it. A half or a third of the bit time fits as
+    well as the bit time (the guess is short when an edge was stamped
+    late), so the largest multiple that fits is the result.  */
+static ulong abMeasure(uchar n)
+{
+unsigned short  t, d, prev = 0;
+ulong           bt, multiple;
+uchar           guess, i;
+
+    for( guess=0; guess<AB_GUESSES; guess++ ) {
+        t   = 0xffff;
+        for( i=1; i<n; i++ ) {
+            d   = abStamp[i] - abStamp[i-1];
+            if( d>prev && d<t )
+                t   = d;
+        }
+        if( t==0xffff )
+            break;
+        if( (bt = abFit(t * 128UL, n, 3)) && (bt = abFit(bt, n, AB_MAX_BITS)) ) {
+            for( i=4; i>=2; i-- ) {
+                if( (multiple = abFit(bt * i, n, AB_MAX_BITS)) )
+                    return multiple;
+            }
+            return bt;
+        }
+        prev    = t;
+    }
+    return 0;
+}
+
+void autobaudPoll(void)
+{
+ulong   bt, rate, r;
+uchar   n, i;
+
+    while( UCSR0A&(1<<RXC0) )
+        (void)UDR0;         /* at the old rate */
+    n   = abEdges;
+    autobaudStats.edges = n;
+    if( autobaudRate || n==0 )
+        return;
+    if( n<AUTOBAUD_EDGES && (unsigned short)(TCNT1-abStamp[n-1])<AB_IDLE )
+        return;
+
+    if( n<AUTOBAUD_MIN_EDGES || (bt = abMeasure(n))==0 ) {
+        if( n>=AUTOBAUD_MIN_EDGES )
+            autobaudStats.tries++;
+        cli();
+        if( abEdges==n )    /* not if an edge came just now */
+            abEdges = 0;
+        sei();
+        return;
+    }
+
+    autobaudStats.bitTime   = bt;
+    rate    = (F_CPU*16UL + (bt>>1)) / bt;
+    autobaudStats.measured  = rate;
+    for( i=0; i<sizeof(abRates)/sizeof(abRates[0]); i++ ) {
+        r   = pgm_read_dword(&abRates[i]);
+        if( (rate>r? rate-r : r-rate)<r/32 ) {
+            rate    = r;
+            break;
+        }
+    }
+    autobaudRate    = rate;
+}
+
+#endif  /* AUTO_BAUD */
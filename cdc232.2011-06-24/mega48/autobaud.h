@@ -0,0 +1,79 @@
+/* Name: autobaud.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __autobaud_h_included__
+#define __autobaud_h_included__
+
+/*
+General Description:
+    Baud rate detection of the ATmega firmware (-DAUTO_BAUD), started with
+    VENDOR_RQ_AUTOBAUD or SET_LINE_CODING with AUTOBAUD_SELECT. The pin
+    change interrupt of RXD (PCINT16) stamps the edges with Timer1 at
+    F_CPU/8, which stats.c and capture.c run at F_CPU/64 otherwise. The
+    interrupt enables interrupts at once (ISR_NOBLOCK), so the USB
+    interrupt may delay a stamp; such an edge gives one short and one long
+    interval.
+
+    autobaudPoll(), called by uartPoll() instead of its receive loop,
+    drops what the USART receives and fits a bit time to AUTOBAUD_EDGES
+    edges, or to fewer after 20ms without one: the shortest interval is the
+    first guess (the start bit of a 0x55 or any lone bit), 3 in 4 of the
+    intervals up to 10 bits must be multiples of it within a quarter bit,
+    and the rate is their total length over their total bits, so the 8
+    cycle ticks matter little. Twice to four times the result is tried as
+    well, since a late stamp may make the guess a fraction of a bit. If
+    too many intervals do not fit, the next longer one is tried, then the
+    measurement starts over. A rate within 3% of a standard rate becomes
+    that rate, and main.c queues it like a line coding: uartConfigure(),
+    which picks the closest UBRR0, applies it after the data sent before
+    it has left, and the detection drops what is received until then.
+
+    The bytes of the measurement are lost. 300 bps and 8 edges (a single
+    0x55) are the least it can measure; the model checks rates up to
+    38400 with stamps late by up to a few register accesses, faster ones
+    need an interrupt latency of a few cycles.
+    ATmega48/88/168/328p (pin change interrupts), not with the
+    multi-channel or the capture mode.
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+#ifndef ulong
+#define ulong   unsigned long
+#endif
+
+#ifdef AUTO_BAUD
+
+#ifndef PCICR
+#   error "AUTO_BAUD needs pin change interrupts (ATmega48/88/168/328p)"
+#endif
+
+#define AUTOBAUD_EDGES      40
+#define AUTOBAUD_MIN_EDGES  8
+
+extern uchar            autobaudActive;
+extern ulong            autobaudRate;       /* detected, not yet applied */
+extern vendorAutobaud_t autobaudStats;
+
+extern void autobaudStart(uchar on);
+extern void autobaudApplied(void);
+extern void autobaudPoll(void);
+
+#else
+
+#define autobaudActive      0
+#define autobaudRate        0
+#define autobaudStart(on)
+#define autobaudApplied()
+#define autobaudPoll()
+
+#endif  /* AUTO_BAUD */
+
+#endif  /*  __autobaud_h_included__  */
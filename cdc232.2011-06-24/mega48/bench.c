@@ -0,0 +1,207 @@
+/* Name: bench.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the benchmark modes, see bench.h.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "stats.h"
+#include "bench.h"
+
+#ifdef BENCH_MODES
+
+uchar           benchMode;
+vendorBench_t   benchStats;
+
+/*  PRBS-7 (x^7+x^6+1) or PRBS-15 (x^15+x^14+1). The state holds the last
+    7 or 15 bits of the sequence, the newest in bit 0. Bytes are packed LSB
+    first, the order in which the UART sends them.
+*/
+static unsigned short   prbsMask, prbsTapA, prbsTapB;
+static unsigned short   genState, chkState, chkHist;
+
+
+static inline uchar rxBytesFree(void)
+{
+    return (urptr - iwptr - 1) & RX_MASK;
+}
+
+static uchar prbsNext(void)
+{
+unsigned short  s = genState;
+uchar           b = 0, i;
+
+    for( i=0; i<8; i++ ) {
+        b   >>= 1;
+        s   <<= 1;
+        if( (s & prbsTapA)? !(s & prbsTapB) : (s & prbsTapB) ) {
+            s   |= 1;
+            b   |= 0x80;
+        }
+    }
+    genState    = s & prbsMask;
+    return b;
+}
+
+/*  Runs a local generator from the received bits. A byte with more than
+    two wrong bits means lost sync (e.g. a dropped byte), the generator is
+    then reloaded from the last received bits.
+*/
+static void prbsCheck(uchar b)
+{
+unsigned short  s = chkState, h = chkHist;
+uchar           i, err = 0;
+
+    for( i=0; i<8; i++ ) {
+        s   <<= 1;
+        h   <<= 1;
+        if( (s & prbsTapA)? !(s & prbsTapB) : (s & prbsTapB) )
+            s   |= 1;
+        if( b & 1 )
+            h   |= 1;
+        if( (s ^ h) & 1 )
+            err++;
+        b   >>= 1;
+    }
+    chkHist = h;
+
+    if( ++benchStats.checkedBytes<=2 ) {    /* collecting the first 16 bits */
+        s   = h;
+        benchStats.synced   = benchStats.checkedBytes==2;
+    }
+    else if( err>2 ) {
+        s   = h;
+        benchStats.resyncs++;
+    }
+    else
+        benchStats.errorBits    += err;
+    chkState    = s & prbsMask;
+}
+
+void benchSetMode(uchar mode, uchar order)
+{
+
+    if( mode>BENCH_PRBS_UART )
+        return;     /* unknown, nothing changes */
+    memset(&benchStats, 0, sizeof(benchStats));
+    benchStats.mode = mode;
+    if( order==7 ) {
+        prbsMask    = 0x7f;
+        prbsTapA    = 1<<7;
+        prbsTapB    = 1<<6;
+    }
+    else {
+        order       = 15;
+        prbsMask    = 0x7fff;
+        prbsTapA    = 1<<15;
+        prbsTapB    = 1<<14;
+    }
+    benchStats.order    = order;
+    genState    = prbsMask;
+    if( mode==benchMode )
+        return;
+
+    if( benchMode==BENCH_PRBS_UART )
+        uwptr   = irptr;    /* drop the generated data */
+    benchMode   = mode;
+
+    /*  drop what the previous mode left in rx_buf  */
+    urptr   = iwptr;
+    if( benchRxOff() ) {    /* uartConfigure() and the RX interrupt keep it */
+        uartUcsrb   &= ~(1<<RXEN0);
+        UCSR0B  &= ~(1<<RXEN0);
+    }
+    else {
+        uartUcsrb   |= (1<<RXEN0);
+        UCSR0B  |= (1<<RXEN0);
+    }
+    if( usbAllRequestsAreDisabled() && uartTxBytesFree()>HW_CDC_BULK_OUT_SIZE ) {
+        usbEnableAllRequests();
+        perfRequestsEnabled();
+    }
+}
+
+void benchWriteOut(uchar *data, uchar len)
+{
+
+    benchStats.outPackets++;
+    if( benchMode==BENCH_PRBS_OUT ) {
+        benchStats.outBytes += len;
+        for( ; len; len-- )
+            prbsCheck(*data++);
+        return;
+    }
+    if( benchMode!=BENCH_LOOPBACK ) {
+        benchStats.dropped  += len;
+        return;
+    }
+
+    /*  loopback: usb -> rx_buf -> usb  */
+    for( ; len; len-- ) {
+        uchar   next;
+
+        next = (iwptr+1) & RX_MASK;
+        if( next==urptr ) {
+            benchStats.dropped++;
+            continue;
+        }
+        rx_buf[iwptr] = *data++;
+        iwptr = next;
+        benchStats.outBytes++;
+    }
+
+    /*  postpone receiving next data    */
+    if( rxBytesFree()<=HW_CDC_BULK_OUT_SIZE ) {
+        usbDisableAllRequests();
+        perfRequestsDisabled();
+    }
+}
+
+/*  BENCH_PRBS_UART: check and consume what the UART received  */
+void benchUartRx(void)
+{
+
+    while( urptr!=iwptr ) {
+        prbsCheck(rx_buf[urptr]);
+        urptr   = (urptr+1) & RX_MASK;
+    }
+    UART_CTRL_PORT  |= (1<<UART_CTRL_RTS);
+}
+
+void benchPoll(void)
+{
+uchar   n;
+
+    switch( benchMode ) {
+    case BENCH_LOOPBACK:
+        if( usbAllRequestsAreDisabled() && rxBytesFree()>HW_CDC_BULK_OUT_SIZE ) {
+            usbEnableAllRequests();
+            perfRequestsEnabled();
+        }
+        break;
+    case BENCH_PRBS_IN:     /* keep rx_buf full, uartPoll() sends it */
+        for( n=HW_CDC_BULK_IN_SIZE; n && rxBytesFree(); n-- ) {
+            rx_buf[iwptr] = prbsNext();
+            iwptr = (iwptr+1) & RX_MASK;
+        }
+        break;
+    case BENCH_PRBS_UART:   /* keep tx_buf full */
+        for( n=HW_CDC_BULK_OUT_SIZE; n && uartTxBytesFree(); n-- ) {
+            tx_buf[uwptr] = prbsNext();
+            uwptr = (uwptr+1) & TX_MASK;
+            benchStats.uartBytes++;
+        }
+        break;
+    }
+}
+
+#endif  /* BENCH_MODES */
@@ -0,0 +1,62 @@
+/* Name: bench.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __bench_h_included__
+#define __bench_h_included__
+
+/*
+General Description:
+    Optional benchmark modes of the ATmega firmware (-DBENCH_MODES), which
+    measure the USB side without the UART. The mode is selected by a vendor
+    request (see vendor.h) or by SET_LINE_CODING with a magic baud rate.
+
+    BENCH_LOOPBACK
+    Data from usbFunctionWriteOut() is put into rx_buf instead of tx_buf and
+    goes straight back on the bulk-IN endpoint. The USART receiver is off
+    in this mode and in the PRBS modes except BENCH_PRBS_UART, also after
+    a line coding (uartUcsrb, uart.h).
+
+    BENCH_PRBS_IN, BENCH_PRBS_OUT, BENCH_PRBS_UART
+    A PRBS-7 or PRBS-15 pattern is generated on bulk-IN as fast as the host
+    polls, checked on bulk-OUT, or sent on the UART TX and checked on the
+    UART RX (wire TXD to RXD). Bit errors, resyncs and byte counts are read
+    with the bench counters. Data from the host is dropped in the modes that
+    do not check it.
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+#ifdef BENCH_MODES
+
+extern uchar            benchMode;
+extern vendorBench_t    benchStats;
+
+extern void benchSetMode(uchar mode, uchar order);
+extern void benchWriteOut(uchar *data, uchar len);
+extern void benchUartRx(void);
+extern void benchPoll(void);
+
+#define benchInPacket(len)  benchStats.inBytes += (len)
+#define benchRxOff()        (benchMode!=BENCH_OFF && benchMode!=BENCH_PRBS_UART)
+
+#else
+
+#define benchMode           BENCH_OFF
+#define benchSetMode(mode, order)
+#define benchWriteOut(data, len)
+#define benchUartRx()
+#define benchPoll()
+#define benchInPacket(len)
+#define benchRxOff()        0
+
+#endif  /* BENCH_MODES */
+
+#endif  /*  __bench_h_included__  */
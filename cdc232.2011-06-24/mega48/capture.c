@@ -0,0 +1,246 @@
+/* Name: capture.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the capture mode, see capture.h.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "mux.h"
+#include "comp.h"
+#include "capture.h"
+#include "autobaud.h"
+
+#ifdef CAPTURE_MODE
+
+#ifndef EVENT_FLAGS
+#   error "CAPTURE_MODE needs an ATmega48/88/168/328p"
+#endif
+
+#define CAP_RECORD_MAX  7       /* flagged record with a 5 byte varint */
+
+uchar           capActive;
+vendorCapture_t capStats;
+
+static uchar    capHead;        /* rx_buf index of the code of the open run */
+static uchar    capOpen;        /* capHead may take more bytes */
+static uchar    capStart;       /* the start record is due */
+static uchar    capFlags;       /* CAP_LOST for the next record */
+static unsigned short  capHigh, capPrev;   /* Timer1 extended to 32 bits */
+static ulong    capLast;        /* time of the last byte as the host has it */
+static uchar    capLastFrac;    /* and 1/256 ticks */
+static ulong    capChar;        /* ticks per character times 256 */
+static volatile uchar   ringIn; /* frames capIrq() took */
+static uchar    ringOut;        /* frames capPoll() took from it */
+static uchar    ringStatus[CAP_RING], ringData[CAP_RING];
+static unsigned short   ringTime[CAP_RING];     /* TCNT1 at the interrupt */
+
+
+static ulong capNow(void)
+{
+unsigned short  t = TCNT1;
+
+    if( t<capPrev )
+        capHigh++;
+    capPrev = t;
+    return (ulong)capHigh<<16 | t;
+}
+
+void capSetMode(uchar on)
+{
+
+    memset(&capStats, 0, sizeof(capStats));
+    capActive   = on && !muxActive && !compActive && !autobaudActive;
+    capStats.active = capActive;
+    if( !capActive )
+        return;
+    TCCR1B  = (TCCR1B & ~7) | (1<<CS11)|(1<<CS10);  /* F_CPU/64 as in stats.c */
+    iwptr   = urptr;
+    capLast     = capNow();     /* times count from here */
+    capLastFrac = 0;
+    ringOut     = ringIn;       /* capPoll() turns capIrq() on */
+    capOpen     = 0;
+    capFlags    = 0;
+    capStart    = 1;
+}
+
+/*  bits of a frame times (UBRR0+1), U2X0 is set: 8 clocks per UBRR0 step  */
+void capSetFrame(ulong frame)
+{
+
+    capChar     = frame << 5;
+    capStart    = capActive;
+}
+
+/*  The wake interrupt of uart.c jumps here while the capture mode is on,
+    with RXCIE0 turned off, so interrupts are enabled at once: no vector,
+    so not ISR() but the interrupt attribute, whose prologue does that. A
+    frame is stamped with TCNT1 and left in the ring with its status; the
+    interrupt stays on for the next one unless the ring is full. A USB
+    interrupt before the stamp makes it late by up to its transaction.  */
+#ifdef __AVR__
+void capIrq(void) __attribute__((interrupt));
+#endif
+void capIrq(void)
+{
+unsigned short  t = TCNT1;
+uchar   in = ringIn, status;
+
+    if( (uchar)(in-ringOut)>=CAP_RING )
+        return;                 /* capPoll() turns it on again */
+    status  = UCSR0A;
+    if( status & (1<<RXC0) ) {  /* not UDRE0, the main loop is awake */
+        in  &= CAP_RING-1;
+        ringStatus[in]  = status;
+        ringData[in]    = UDR0;
+        ringTime[in]    = t;
+        ringIn++;
+        EVENT_FLAGS |= (1<<EVENT_CAPTURE);
+        if( (uchar)(ringIn-ringOut)>=CAP_RING )
+            return;
+    }
+    cli();
+    UCSR0B  = UART_UCSRB_NOW | (1<<RXCIE0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void capPut(uchar c)
+{
+
+    rx_buf[iwptr]   = c;
+    iwptr   = (iwptr+1) & RX_MASK;
+    capStats.coded++;
+}
+
+static void capPutLong(ulong v)
+{
+uchar   i;
+
+    for( i=0; i<4; i++ ) {
+        capPut(v);
+        v   >>= 8;
+    }
+}
+
+static void capVarint(ulong v)
+{
+
+    while( v>=0x80 ) {
+        capPut(v | 0x80);
+        v   >>= 7;
+    }
+    capPut(v);
+}
+
+/*  The time of the next byte if it comes one character after the last.  */
+static void capStep(void)
+{
+unsigned short  frac = capLastFrac + (uchar)capChar;
+
+    capLastFrac = frac;
+    capLast     += (capChar>>8) + (frac>>8);
+}
+
+void capPoll(void)
+{
+uchar   status, data, flags, room, out, gap;
+ulong   now, delta;
+
+    EVENT_FLAGS &= ~(1<<EVENT_CAPTURE);
+    capNow();   /* at least once per Timer1 period */
+    if( capStart ) {
+        if( ((urptr-iwptr-1) & RX_MASK)<CAP_ROOM ) {
+            UART_CTRL_PORT  &= ~(1<<UART_CTRL_RTS);
+            return;
+        }
+        capPut(CAP_START);
+        capPutLong(F_CPU/64);
+        capPutLong(capChar);
+        capOpen     = 0;
+        capStart    = 0;
+    }
+
+    while( (out = ringOut)!=ringIn ) {
+        out     &= CAP_RING-1;
+        status  = ringStatus[out];
+        data    = ringData[out];
+        now     = capNow();
+        now     -= (unsigned short)((unsigned short)now - ringTime[out]);
+        ringOut++;
+        room    = (urptr-iwptr-1) & RX_MASK;
+        capStats.bytes++;
+        if( room<CAP_ROOM )     /* now, the loop may take a while at high rates */
+            UART_CTRL_PORT  &= ~(1<<UART_CTRL_RTS);
+        if( room<CAP_RECORD_MAX ) {
+            capFlags    = CAP_LOST;
+            capStats.lost++;
+            break;  /* for usbPoll(), the sender may ignore RTS */
+        }
+        flags   = capFlags;
+        if( status&(1<<DOR0) )
+            flags   |= CAP_OVERRUN;
+        if( status&(1<<UPE0) )
+            flags   |= CAP_PARITY;
+        if( status&(1<<FE0) )
+            flags   |= data? CAP_FRAMING : CAP_BREAK;
+        if( flags&(CAP_PARITY|CAP_FRAMING|CAP_BREAK) )
+            capStats.errors++;
+        capFlags    = 0;
+
+        /*  one character after the last byte within CAP_JITTER ticks, or
+            a delta of its own; capStep() may have put the last byte up to
+            CAP_JITTER late, a byte stamped right after it is then before  */
+        delta   = now - capLast;
+        gap     = delta + CAP_JITTER - ((capChar + capLastFrac) >> 8) > 2*CAP_JITTER;
+        if( gap ) {
+            if( delta>=(ulong)-CAP_JITTER )
+                delta   = 0;
+            else
+                capLast = now;
+            capLastFrac = 0;
+        }
+        else
+            capStep();
+
+        if( flags ) {
+            capPut(CAP_FLAGGED | flags | (gap? CAP_DELTA : 0));
+            if( gap )
+                capVarint(delta);
+            capOpen = 0;
+        }
+        else if( !gap && capOpen && ((capHead-urptr) & RX_MASK)<((iwptr-urptr) & RX_MASK)
+                && (rx_buf[capHead] & (CAP_MAX_RUN-1))!=CAP_MAX_RUN-1 ) {
+            rx_buf[capHead]++;  /* not sent yet: one more byte in the run */
+        }
+        else {
+            capHead = iwptr;
+            capOpen = 1;
+            capPut(gap? CAP_RUN_DELTA : CAP_RUN);
+            if( gap )
+                capVarint(delta);
+        }
+        capPut(data);
+    }
+    if( (uchar)(ringIn-ringOut)<CAP_RING ) {    /* capIrq() stops when it is full */
+        cli();
+        UCSR0B  = UART_UCSRB_NOW | (1<<RXCIE0);
+        sei();
+    }
+    /*  RTS is up to capPoll(), uartPoll() does not raise it after sending  */
+    if( ((urptr-iwptr-1) & RX_MASK)<CAP_ROOM )
+        UART_CTRL_PORT  &= ~(1<<UART_CTRL_RTS);
+    else
+        UART_CTRL_PORT  |= (1<<UART_CTRL_RTS);
+}
+
+#endif  /* CAPTURE_MODE */
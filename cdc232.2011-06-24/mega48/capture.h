@@ -0,0 +1,74 @@
+/* Name: capture.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __capture_h_included__
+#define __capture_h_included__
+
+/*
+General Description:
+    Capture mode of the ATmega firmware (-DCAPTURE_MODE), for the adapter
+    as a serial sniffer. VENDOR_RQ_CAPTURE turns it on, then uartPoll()
+    calls capPoll() instead of its receive loop: every byte goes into
+    rx_buf as a record of vendor.h with its time and the USART errors,
+    which the normal mode drops. rx_buf is sent on bulk-IN as before (or
+    on VENDOR_RQ_DATA with EP0_DATA), host/cdccap turns the records into
+    pcap.
+
+    Time is Timer1 at F_CPU/64 (5.3us at 12MHz), free running as for
+    stats.c and extended to 32 bits in software, so uartPoll() must run
+    at least every 65536 ticks (the 1ms tick does it while the main loop
+    sleeps). The RX interrupt stamps each frame (capIrq()) and keeps up
+    to CAP_RING of them for capPoll(); it is late by the USB interrupt
+    at most, about two transactions or 200us. Beyond the ring the frames
+    wait in the USART and are stamped when capPoll() has made room.
+    Bytes in a row cost one byte each: a record holds up to CAP_MAX_RUN
+    of them. A byte within CAP_JITTER ticks of one character after the
+    byte before is coded as that, any other gap costs a varint of its
+    ticks, so a stream at 115200 bps is not much more than the data and
+    a gap of a bit still shows. RTS drops while rx_buf has less than
+    CAP_ROOM free; bytes that find no room are counted and flag the next
+    record with CAP_LOST.
+    Not with the multi-channel or the compressed mode. Needs GPIOR0 for
+    EVENT_FLAGS, an ATmega48/88/168/328p.
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+#ifndef ulong
+#define ulong   unsigned long
+#endif
+
+#ifdef CAPTURE_MODE
+
+#define CAP_ROOM            40      /* bytes free in rx_buf for RTS: a start
+                                       record and 7 bytes in the ring and the
+                                       USART, with a delta each */
+#define CAP_JITTER          2       /* ticks off the character grid that are
+                                       coded as on it */
+#define CAP_RING            4       /* frames capIrq() holds, 2^n */
+
+extern uchar            capActive;
+extern vendorCapture_t  capStats;
+
+extern void capSetMode(uchar on);
+extern void capSetFrame(ulong frame);
+extern void capIrq(void);
+extern void capPoll(void);
+
+#else
+
+#define capActive           0
+#define capSetMode(on)
+#define capSetFrame(frame)
+#define capPoll()
+
+#endif  /* CAPTURE_MODE */
+
+#endif  /*  __capture_h_included__  */
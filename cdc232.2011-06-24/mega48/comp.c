@@ -0,0 +1,265 @@
+/* Name: comp.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the compressed mode, see comp.h.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "stats.h"
+#include "mux.h"
+#include "ep0.h"
+#include "comp.h"
+#include "capture.h"
+
+#ifdef COMP_MODE
+
+#define WINDOW_MASK     (COMP_WINDOW-1)
+#define HASH(a, b)      (((a) ^ (b)<<2) & (COMP_HASH_SIZE-1))
+
+extern uchar    sendEmptyFrame;
+
+uchar           compActive, compOutPending;
+vendorComp_t    compStats;
+
+/*  rx_buf -> bulk-IN: the last COMP_WINDOW bytes, and for each hash of 2
+    bytes the position where they were last seen  */
+static uchar    rxHist[COMP_WINDOW], rxHead[COMP_HASH_SIZE], rxPos;
+
+/*  bulk-OUT -> tx_buf  */
+static uchar    txHist[COMP_WINDOW], txPos;
+static uchar    outBuf[HW_CDC_BULK_OUT_SIZE], outLen, outIdx;
+static uchar    outToken;       /* 0, or the first byte of a 2 byte token */
+static uchar    copyLeft, copyDist;
+
+/*  after an OUT packet lost for its CRC the code is dropped up to the
+    sync of the host, first up to a byte < COMP_MATCH, which ends any
+    token  */
+#define SYNC_ALIGN      1
+#define SYNC_WAIT       2
+
+static uchar    outSync;
+uchar           compSync;       /* the sync is due on bulk-IN */
+#if USB_CFG_CHECK_CRC_IN_POLL
+static unsigned crcErrors;      /* usbCrcErrors seen */
+#endif
+
+
+void compSetMode(uchar on)
+{
+
+    memset(rxHist, 0, sizeof(rxHist));
+    memset(rxHead, 0, sizeof(rxHead));
+    memset(txHist, 0, sizeof(txHist));
+    memset(&compStats, 0, sizeof(compStats));
+    rxPos       = 0;
+    txPos       = 0;
+    outToken    = 0;
+    copyLeft    = 0;
+    outSync     = 0;
+    compSync    = 0;
+#if USB_CFG_CHECK_CRC_IN_POLL
+    crcErrors   = usbCrcErrors;
+#endif
+    compActive  = on && !muxActive && !ep0Active && !capActive;
+    compStats.active    = compActive;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void txPut(uchar c)
+{
+
+    tx_buf[uwptr]   = c;
+    latTxStamp(uwptr);
+    uwptr   = (uwptr+1) & TX_MASK;
+    txHist[txPos++ & WINDOW_MASK]   = c;
+    compStats.txRaw++;
+}
+
+/*  Decodes outBuf as far as tx_buf has room, returns nonzero if not all of
+    it fitted.  */
+static uchar decode(void)
+{
+uchar   c;
+
+    for( ;; ) {
+        if( copyLeft==0 && outIdx==outLen )
+            return 0;
+        if( uartTxBytesFree()==0 )
+            return 1;
+        if( copyLeft ) {
+            txPut(txHist[(uchar)(txPos-copyDist) & WINDOW_MASK]);
+            copyLeft--;
+            continue;
+        }
+        c   = outBuf[outIdx++];
+        if( outSync==SYNC_ALIGN ) {
+            if( c<COMP_MATCH )
+                outSync = SYNC_WAIT;
+            continue;
+        }
+        if( outSync && outToken!=COMP_ESCAPE ) {
+            outToken    = outToken || c<COMP_MATCH? 0 : c;
+            continue;
+        }
+        if( outToken==COMP_ESCAPE ) {
+            if( c==COMP_SYNC ) {
+                memset(txHist, 0, sizeof(txHist));
+                txPos   = 0;
+                outSync = 0;
+            }
+            else if( !outSync )
+                txPut(c);
+            outToken    = 0;
+        }
+        else if( outToken ) {
+            copyLeft    = outToken - COMP_MATCH + COMP_MIN_MATCH;
+            copyDist    = c + 1;
+            outToken    = 0;
+        }
+        else if( c<COMP_MATCH )
+            txPut(c);
+        else
+            outToken    = c;
+    }
+}
+
+void compWriteOut(uchar *data, uchar len)
+{
+
+    memcpy(outBuf, data, len);
+    outLen  = len;
+    outIdx  = 0;
+    compStats.txCoded   += len;
+    compOutPending  = decode();
+    perfOutPacket();
+    perfTxLevel(TX_MASK - uartTxBytesFree());
+
+    /*  postpone receiving next data    */
+    if( compOutPending || uartTxBytesFree()<=UART_TX_STOP ) {
+        usbDisableAllRequests();
+        perfRequestsDisabled();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void rxPush(uchar c)
+{
+uchar   prev = rxHist[(uchar)(rxPos-1) & WINDOW_MASK];
+
+    rxHist[rxPos & WINDOW_MASK] = c;
+    rxHead[HASH(prev, c)]   = rxPos - 1;
+    rxPos++;
+}
+
+/*  Longest match for the bytes at urptr, of which avail are in rx_buf.
+    Returns its length (< COMP_MIN_MATCH for none) and the distance in
+    *dist. Bytes up to dist back are in rxHist, beyond that the match
+    copies itself and is compared with rx_buf.  */
+static uchar findMatch(uchar avail, uchar *dist)
+{
+uchar   pos, d, len, h;
+
+    pos = rxHead[HASH(rx_buf[urptr], rx_buf[(urptr+1) & RX_MASK])];
+    d   = rxPos - pos;
+    if( d==0 || d>COMP_WINDOW )
+        return 0;
+    if( avail>COMP_MAX_MATCH )
+        avail   = COMP_MAX_MATCH;
+    for( len=0; len<avail; len++ ) {
+        h   = len<d? rxHist[(uchar)(pos+len) & WINDOW_MASK] : rx_buf[(urptr+len-d) & RX_MASK];
+        if( h!=rx_buf[(urptr+len) & RX_MASK] )
+            break;
+    }
+    *dist   = d;
+    return len;
+}
+
+/*  Finishes the OUT packet, and codes rx_buf into an IN packet if send is
+    nonzero. After a packet that usbPoll() dropped for its CRC, both
+    histories start over: the IN packet starts with the sync, and the OUT
+    code is dropped up to the sync of the host.  */
+void compPoll(uchar send)
+{
+uchar   buf[HW_CDC_BULK_IN_SIZE], n, avail, len, dist, c, taken;
+
+    if( compOutPending ) {
+        compOutPending  = decode();
+        if( !compOutPending && usbAllRequestsAreDisabled() && !codingsFull && uartTxBytesFree()>UART_TX_STOP ) {
+            usbEnableAllRequests();
+            perfRequestsEnabled();
+        }
+    }
+#if USB_CFG_CHECK_CRC_IN_POLL
+    if( !compOutPending && usbCrcErrors!=crcErrors ) {
+        crcErrors   = usbCrcErrors;
+        outSync     = SYNC_ALIGN;
+        outToken    = 0;
+        compSync    = 1;
+    }
+#endif
+    if( !send )
+        return;
+
+    n       = 0;
+    taken   = 0;
+    if( compSync ) {
+        buf[n++]    = COMP_ESCAPE;
+        buf[n++]    = COMP_SYNC;
+        memset(rxHist, 0, sizeof(rxHist));
+        memset(rxHead, 0, sizeof(rxHead));
+        rxPos       = 0;
+        compSync    = 0;
+        compStats.resyncs++;
+    }
+    avail   = (iwptr-urptr) & RX_MASK;
+    while( avail && n<HW_CDC_BULK_IN_SIZE ) {
+        c   = rx_buf[urptr];
+        len = 0;
+        if( avail>=COMP_MIN_MATCH && n<=HW_CDC_BULK_IN_SIZE-2 )
+            len = findMatch(avail, &dist);
+        if( len>=COMP_MIN_MATCH ) {
+            buf[n++]    = COMP_MATCH + len - COMP_MIN_MATCH;
+            buf[n++]    = dist - 1;
+        }
+        else {
+            if( c>=COMP_MATCH ) {
+                if( n>HW_CDC_BULK_IN_SIZE-2 )
+                    break;
+                buf[n++]    = COMP_ESCAPE;
+            }
+            buf[n++]    = c;
+            len = 1;
+        }
+        avail   -= len;
+        taken   += len;
+        latRxSend(urptr, len);
+        do {
+            rxPush(rx_buf[urptr]);
+            urptr   = (urptr+1) & RX_MASK;
+        } while( --len );
+    }
+    if( taken )
+        UART_CTRL_PORT  |= (1<<UART_CTRL_RTS);
+
+    if( n || sendEmptyFrame ) {
+        usbSetInterrupt(buf, n);
+        perfInPacket();
+        compStats.rxRaw     += taken;
+        compStats.rxCoded   += n;
+        /* an empty packet after a full one ends the transfer */
+        sendEmptyFrame  = n==HW_CDC_BULK_IN_SIZE && iwptr==urptr;
+    }
+}
+
+#endif  /* COMP_MODE */
@@ -0,0 +1,70 @@
+/* Name: comp.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __comp_h_included__
+#define __comp_h_included__
+
+/*
+General Description:
+    Compressed mode of the ATmega firmware (-DCOMP_MODE). VENDOR_RQ_COMP
+    turns it on, then both bulk endpoints carry the LZ code of vendor.h:
+    ASCII bytes stand for themselves, a repeat within the last COMP_WINDOW
+    bytes is a match of 2 bytes. Text such as logs and telemetry shrinks,
+    binary data may grow up to twice its size.
+
+    uartPoll() calls compPoll() instead of sending rx_buf. It codes rx_buf
+    into the IN packet; the match is looked up in a hash of the next 2
+    bytes, one candidate, so each byte costs a few compares. The packet
+    is sent when uartPoll() would send one.
+    usbFunctionWriteOut() hands the OUT data to compWriteOut(), which
+    decodes it into tx_buf. A packet may expand to more than the room in
+    tx_buf; the rest waits in the decoder and OUT is NAKed until compPoll()
+    has finished it (compOutPending).
+
+    An OUT packet that usbPoll() drops for its CRC (usbCrcErrors, see
+    USB_CFG_CHECK_CRC_IN_POLL) breaks the code after it. compPoll() then
+    starts both histories over: it sends COMP_SYNC on bulk-IN and drops
+    the OUT code up to the sync the host sends back when it has started
+    its encoder over. Not with the multi-channel mode or EP0_DATA.
+    host/lzcomp.h is the codec of the host tools. Needs 1KB SRAM
+    (ATmega8/88/168/328p).
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+#ifdef COMP_MODE
+
+#if RAMEND < 0x400
+#   error "COMP_MODE needs 1KB SRAM"
+#endif
+
+#define COMP_HASH_SIZE      64      /* 2^n */
+
+extern uchar            compActive;
+extern uchar            compOutPending; /* OUT data waits for room in tx_buf */
+extern uchar            compSync;       /* the sync is due on bulk-IN */
+extern vendorComp_t     compStats;
+
+extern void compSetMode(uchar on);
+extern void compWriteOut(uchar *data, uchar len);
+extern void compPoll(uchar send);
+
+#else
+
+#define compActive          0
+#define compOutPending      0
+#define compSetMode(on)
+#define compWriteOut(data, len)
+#define compPoll(send)
+
+#endif  /* COMP_MODE */
+
+#endif  /*  __comp_h_included__  */
@@ -0,0 +1,108 @@
+/* Name: ep0.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the data path on control transfers, see ep0.h.
+*/
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "bench.h"
+#include "mux.h"
+#include "comp.h"
+#include "ep0.h"
+
+#ifdef EP0_DATA
+
+uchar           ep0Active, ep0Transfer;
+
+static uchar    ep0First;   /* the next usbFunctionRead() starts the reply */
+static uchar    ep0Left;    /* bytes of the OUT transfer, 0 if refused */
+
+
+/*
+    Room for the next OUT transfer. It stops short of the level at which
+    usbFunctionWriteOut() disables requests, which would NAK the SETUP of
+    the next transfer too.
+*/
+static uchar ep0Room(void)
+{
+uchar   room, stop;
+
+    if( benchMode==BENCH_LOOPBACK ) {
+        room    = (urptr-iwptr-1) & RX_MASK;
+        stop    = HW_CDC_BULK_OUT_SIZE;
+    }
+    else {
+        room    = uartTxBytesFree();
+        stop    = UART_TX_STOP;
+    }
+    return room>stop? room-stop-1 : 0;
+}
+
+uchar ep0Setup(usbRequest_t *rq)
+{
+
+    if( muxActive || compActive )
+        return 0;
+    if( (rq->bmRequestType & USBRQ_DIR_MASK)==USBRQ_DIR_DEVICE_TO_HOST ) {
+        if( rq->wLength.word>254 )  /* 255 is USB_NO_MSG for the driver */
+            return 0;
+        ep0First    = 1;
+        ep0Transfer = 1;
+        return USB_NO_MSG;
+    }
+    if( rq->wLength.word==0 ) {
+        ep0Active   = rq->wValue.bytes[0]!=0;
+        return 0;
+    }
+    ep0Left     = rq->wLength.word>ep0Room()? 0 : rq->wLength.bytes[0];
+    ep0Transfer = 1;
+    return USB_NO_MSG;
+}
+
+/*
+    The room, then rx_buf. A reply shorter than the host asked for ends
+    the transfer.
+*/
+uchar ep0Read(uchar *data, uchar len)
+{
+uchar   n = 0, taken;
+
+    if( ep0First ) {
+        ep0First    = 0;
+        data[n++]   = ep0Room();
+    }
+    taken   = n;
+    for( ; n<len && urptr!=iwptr; n++ ) {
+        data[n] = rx_buf[urptr];
+        urptr   = (urptr+1) & RX_MASK;
+    }
+    taken   = n - taken;
+    benchInPacket(taken);
+#ifdef ALT_PROFILES
+    if( taken && ((iwptr-urptr) & RX_MASK)<uartProfile.rxLimit )
+#else
+    if( taken )
+#endif
+        UART_CTRL_PORT  |= (1<<UART_CTRL_RTS);
+    return n;
+}
+
+uchar ep0Write(uchar *data, uchar len)
+{
+
+    if( len>ep0Left )   /* more than the room: stall */
+        return 0xff;
+    usbFunctionWriteOut(data, len);
+    ep0Left -= len;
+    return ep0Left==0;
+}
+
+#endif  /* EP0_DATA */
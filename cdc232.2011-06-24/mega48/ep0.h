@@ -0,0 +1,57 @@
+/* Name: ep0.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __ep0_h_included__
+#define __ep0_h_included__
+
+/*
+General Description:
+    Serial data on control transfers (-DEP0_DATA). A low-speed device may
+    only have interrupt endpoints, which the host polls once per interval,
+    while it schedules control transfers as often as the bus allows. The
+    vendor request VENDOR_RQ_DATA (see vendor.h) moves the data of the CDC
+    interface on the default pipe instead: an IN transfer returns the room
+    in tx_buf and the bytes in rx_buf, an OUT transfer fills tx_buf. The
+    host must not send more than the room it was told, a longer transfer
+    is stalled before it writes anything.
+
+    While the mode is on, uartPoll() does not send rx_buf on bulk-IN. Bulk
+    OUT still works, but the room does not count its data. In BENCH_MODES
+    the data goes where usbFunctionWriteOut() puts it, so the loopback
+    returns it on the next IN transfer. Not available in the
+    multi-channel and the compressed mode.
+
+    IN transfers are at most 254 bytes, OUT transfers no longer than the
+    room. USB_CFG_LONG_TRANSFERS is not needed, the buffers are smaller.
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+#ifdef EP0_DATA
+
+extern uchar    ep0Active;      /* rx_buf is read by VENDOR_RQ_DATA only */
+extern uchar    ep0Transfer;    /* usbFunctionRead/Write() belong to us */
+
+extern uchar ep0Setup(usbRequest_t *rq);
+extern uchar ep0Read(uchar *data, uchar len);
+extern uchar ep0Write(uchar *data, uchar len);
+
+#else
+
+#define ep0Active           0
+#define ep0Transfer         0
+#define ep0Setup(rq)        0
+#define ep0Read(data, len)  0
+#define ep0Write(data, len) 0xff
+
+#endif  /* EP0_DATA */
+
+#endif  /*  __ep0_h_included__  */
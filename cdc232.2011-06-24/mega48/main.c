@@ -16,13 +16,27 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
 #include <avr/wdt.h>
+#include <avr/eeprom.h>
 #include <util/delay.h>
 
 #include "oddebug.h"
 #include "usbdrv.h"
 #include "uart.h"
-
+#include "stats.h"
+#include "bench.h"
+#include "mux.h"
+#include "ep0.h"
+#include "comp.h"
+#include "capture.h"
+#include "autobaud.h"
+#include "rs485.h"
+#include "mpcm.h"
+
+#ifndef MCUSR
+#define MCUSR   MCUCSR  /* ATmega8/16 */
+#endif
 
 enum {
     SEND_ENCAPSULATED_COMMAND = 0,
@@ -37,10 +51,55 @@ enum {
 };
 
 
+#ifdef ALT_PROFILES
+#define CONFIG_DESCR_LENGTH     (67 + (ALT_PROFILE_COUNT-1)*23)
+#else
+#define CONFIG_DESCR_LENGTH     67
+#endif
+
+/*  Transfer type of the data endpoints: bulk, or interrupt polled every
+    DATA_EP_INTERVAL ms (see Makefile). Low-speed devices may not have bulk
+    endpoints, and hosts schedule them in different ways.  */
+#ifdef DATA_EP_INTERVAL
+#define DATA_EP_TYPE        0x03    /* Interrupt */
+#else
+#define DATA_EP_TYPE        0x02    /* Bulk */
+#define DATA_EP_INTERVAL    0
+#endif
+
+/*  The data interface and its endpoints, once for each alternate setting  */
+#define DATA_INTERFACE(alt) \
+    /* Interface Descriptor  */ \
+    9,           /* sizeof(usbDescrInterface): length of descriptor in bytes */ \
+    USBDESCR_INTERFACE,           /* descriptor type */ \
+    1,           /* index of this interface */ \
+    alt,         /* alternate setting for this interface */ \
+    2,           /* endpoints excl 0: number of endpoint descriptors to follow */ \
+    0x0A,        /* Data Interface Class Codes */ \
+    0, \
+    0,           /* Data Interface Class Protocol Codes */ \
+    0,           /* string index for interface */ \
+ \
+    /* Endpoint Descriptor */ \
+    7,           /* sizeof(usbDescrEndpoint) */ \
+    USBDESCR_ENDPOINT,  /* descriptor type = endpoint */ \
+    0x01,        /* OUT endpoint number 1 */ \
+    DATA_EP_TYPE,        /* attrib: Bulk or Interrupt endpoint */ \
+    8, 0,        /* maximum packet size */ \
+    DATA_EP_INTERVAL,  /* in ms */ \
+ \
+    /* Endpoint Descriptor */ \
+    7,           /* sizeof(usbDescrEndpoint) */ \
+    USBDESCR_ENDPOINT,  /* descriptor type = endpoint */ \
+    0x81,        /* IN endpoint number 1 */ \
+    DATA_EP_TYPE,        /* attrib: Bulk or Interrupt endpoint */ \
+    8, 0,        /* maximum packet size */ \
+    DATA_EP_INTERVAL   /* in ms */
+
 static PROGMEM char configDescrCDC[] = {   /* USB configuration descriptor */
     9,          /* sizeof(usbDescrConfig): length of descriptor in bytes */
     USBDESCR_CONFIG,    /* descriptor type */
-    67,
+    CONFIG_DESCR_LENGTH,
     0,          /* total length of data returned (including inlined descriptors) */
     2,          /* number of interfaces in this configuration */
     1,          /* index of this configuration */
@@ -94,32 +153,11 @@ static PROGMEM char configDescrCDC[] = {   /* USB configuration descriptor */
     8, 0,        /* maximum packet size */
     USB_CFG_INTR_POLL_INTERVAL,        /* in ms */
 
-    /* Interface Descriptor  */
-    9,           /* sizeof(usbDescrInterface): length of descriptor in bytes */
-    USBDESCR_INTERFACE,           /* descriptor type */
-    1,           /* index of this interface */
-    0,           /* alternate setting for this interface */
-    2,           /* endpoints excl 0: number of endpoint descriptors to follow */
-    0x0A,        /* Data Interface Class Codes */
-    0,
-    0,           /* Data Interface Class Protocol Codes */
-    0,           /* string index for interface */
-
-    /* Endpoint Descriptor */
-    7,           /* sizeof(usbDescrEndpoint) */
-    USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
-    0x01,        /* OUT endpoint number 1 */
-    0x02,        /* attrib: Bulk endpoint */
-    8, 0,        /* maximum packet size */
-    0,           /* in ms */
-
-    /* Endpoint Descriptor */
-    7,           /* sizeof(usbDescrEndpoint) */
-    USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
-    0x81,        /* IN endpoint number 1 */
-    0x02,        /* attrib: Bulk endpoint */
-    8, 0,        /* maximum packet size */
-    0,           /* in ms */
+    DATA_INTERFACE(0),
+#ifdef ALT_PROFILES
+    DATA_INTERFACE(ALT_PROFILE_LATENCY),
+    DATA_INTERFACE(ALT_PROFILE_THROUGHPUT),
+#endif
 };
 
 
@@ -136,12 +174,116 @@ uchar usbFunctionDescriptor(usbRequest_t *rq)
 }
 
 
+#ifdef ALT_PROFILES
+#define ALT_PROFILE_EEPROM  ((uint8_t *)0)  /* ALT_PROFILES_EEPROM */
+
+static uchar        altSetting;     /* of the data interface */
+
+/*  SET_INTERFACE and GET_INTERFACE (usbconfig.h). The alternate setting of
+    the data interface selects the buffering profile of uart.c.  */
+void usbSetInterface(uchar iface, uchar alt)
+{
+
+    /*  usbResetDataToggling() made a queued IN packet DATA1, but it is the
+        first after the reset for the host  */
+    if( !usbInterruptIsReady() )
+        usbTxBuf1[0]    = USBPID_DATA0;
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+    if( !usbInterruptIsReady3() )
+        usbTxBuf3[0]    = USBPID_DATA0;
+#endif
+    if( iface!=1 || alt>=ALT_PROFILE_COUNT )
+        return;
+    altSetting  = alt;
+    uartSetProfile(alt);
+#ifdef ALT_PROFILES_EEPROM
+    eeprom_update_byte(ALT_PROFILE_EEPROM, alt);
+#endif
+}
+
+uchar usbGetInterface(uchar iface)
+{
+    return iface==1? altSetting : 0;
+}
+
+/*  The stored profile survives a reset, the host may not know it.  */
+static void profileInit(void)
+{
+
+#ifdef ALT_PROFILES_EEPROM
+    altSetting  = eeprom_read_byte(ALT_PROFILE_EEPROM);
+    if( altSetting>=ALT_PROFILE_COUNT )     /* erased */
+#endif
+        altSetting  = 0;
+    uartSetProfile(altSetting);
+}
+#else
+#define profileInit()
+#endif
+
 uchar               sendEmptyFrame;
 static uchar        intr3Status;    /* used to control interrupt endpoint transmissions */
+static uchar        serialState;    /* SERIAL_STATE bitmap last reported */
+static uchar        serialStateNotification[10] = {0xa1, 0x20, 0, 0, 0, 0, 2, 0, 0, 0};
 
 static uchar        stopbit, parity, databit;
 static usbDWord_t   baud;
 
+/*
+    Line codings, and the 9 bit mode that VENDOR_RQ_MPCM sets with one,
+    wait here for the data queued before them. Each one takes
+    effect at its mark in tx_buf, the transmitter is held there until the
+    coding before it has drained. When the queue is full, requests are
+    disabled until the first one is applied, like for a full tx_buf.
+*/
+#define CODING_QUEUE    4       /* power of 2 */
+
+typedef struct pendingCoding {
+    usbDWord_t  baud;
+    uchar       stopbit, parity, databit;
+    uchar       mark;           /* uwptr when it was set */
+    uchar       flags;
+#ifdef MPCM_MODE
+    uchar       mpcmFlags, address, address2;   /* of VENDOR_RQ_MPCM */
+#endif
+} pendingCoding_t;
+
+#define CODING_AUTOBAUD 1       /* the detected rate, see autobaud.h */
+#define CODING_MPCM     2       /* the 9 bit mode changes, see mpcm.h */
+
+static pendingCoding_t  codings[CODING_QUEUE];
+static uchar            codingHead, codingTail;
+uchar                   codingsFull;
+static ulong            autobaudQueued; /* autobaudRate, in the queue */
+
+#define codingPending()     (codingHead!=codingTail)
+
+static pendingCoding_t *queueCoding(uchar flags)
+{
+pendingCoding_t *c = &codings[(codingHead-1) & (CODING_QUEUE-1)];
+
+    /*  no data for the last one yet: that one is replaced  */
+    if( !codingPending() || c->mark!=uwptr ){
+        c   = &codings[codingHead];
+        c->mark = uwptr;
+        c->flags    = 0;
+        if( !codingPending() )
+            uartHoldTx(uwptr);
+        codingHead  = (codingHead+1) & (CODING_QUEUE-1);
+        if( ((codingHead+1) & (CODING_QUEUE-1))==codingTail ){
+            codingsFull = 1;
+            usbDisableAllRequests();
+            perfRequestsDisabled();
+        }
+    }
+    c->baud.dword   = baud.dword;
+    c->stopbit  = stopbit;
+    c->parity   = parity;
+    c->databit  = databit;
+    c->flags    |= flags;
+    return c;
+}
+
 static void resetUart(void)
 {
 
@@ -156,10 +298,132 @@ static void resetUart(void)
 /* ----------------------------- USB interface ----------------------------- */
 /* ------------------------------------------------------------------------- */
 
+/*  vendor requests, see vendor.h   */
+#define requestIn(rq)   (((rq)->bmRequestType & USBRQ_DIR_MASK) == USBRQ_DIR_DEVICE_TO_HOST)
+
+static uchar vendorSetup(usbRequest_t *rq)
+{
+#ifdef LATENCY_STATS
+    if(rq->bRequest == VENDOR_RQ_LATENCY){
+        if(!requestIn(rq)){
+            latClear();
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&latStats;
+        return sizeof(latStats);
+    }
+#endif
+#ifdef PERF_COUNTERS
+    if(rq->bRequest == VENDOR_RQ_PERF){
+        if(!requestIn(rq)){
+            perfClear();
+#if USB_CFG_CHECK_CRC_IN_POLL
+            usbCrcErrors = 0;
+#endif
+#if USB_CFG_DROP_DUPLICATES
+            usbDuplicates = 0;
+#endif
+            return 0;
+        }
+#if USB_CFG_CHECK_CRC_IN_POLL
+        perfStats.usbCrcErrors = usbCrcErrors;
+#endif
+#if USB_CFG_DROP_DUPLICATES
+        perfStats.usbDuplicates = usbDuplicates;
+#endif
+        usbMsgPtr = (uchar *)&perfStats;
+        return sizeof(perfStats);
+    }
+#endif
+#if DEBUG_LEVEL > 0 && defined DEBUG_TRACE
+    if(rq->bRequest == VENDOR_RQ_TRACE){
+        if(!requestIn(rq)){
+            odTraceClear();
+            return 0;
+        }
+        odTraceStop();
+        usbMsgPtr = (uchar *)&odTrace;
+        return sizeof(odTrace);
+    }
+#endif
+#ifdef BENCH_MODES
+    if(rq->bRequest == VENDOR_RQ_BENCH){
+        if(!requestIn(rq)){
+            benchSetMode(rq->wValue.bytes[0], rq->wValue.bytes[1]);
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&benchStats;
+        return sizeof(benchStats);
+    }
+#endif
+#ifdef EP0_DATA
+    if(rq->bRequest == VENDOR_RQ_DATA)
+        return ep0Setup(rq);
+#endif
+#ifdef COMP_MODE
+    if(rq->bRequest == VENDOR_RQ_COMP){
+        if(!requestIn(rq)){
+            compSetMode(rq->wValue.bytes[0]);
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&compStats;
+        return sizeof(compStats);
+    }
+#endif
+#ifdef CAPTURE_MODE
+    if(rq->bRequest == VENDOR_RQ_CAPTURE){
+        if(!requestIn(rq)){
+            capSetMode(rq->wValue.bytes[0]);
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&capStats;
+        return sizeof(capStats);
+    }
+#endif
+#ifdef AUTO_BAUD
+    if(rq->bRequest == VENDOR_RQ_AUTOBAUD){
+        if(!requestIn(rq)){
+            autobaudStart(rq->wValue.bytes[0]);
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&autobaudStats;
+        return sizeof(autobaudStats);
+    }
+#endif
+#ifdef RS485_DE
+    if(rq->bRequest == VENDOR_RQ_RS485){
+        if(!requestIn(rq)){
+            rs485Config(rq->wValue.bytes[0], rq->wIndex.bytes[1]? 255 : rq->wIndex.bytes[0]);
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&rs485Stats;
+        return sizeof(rs485Stats);
+    }
+#endif
+#ifdef MPCM_MODE
+    if(rq->bRequest == VENDOR_RQ_MPCM){
+        if(!requestIn(rq)){
+            pendingCoding_t *c = queueCoding(CODING_MPCM);  /* applied with a line coding */
+
+            c->mpcmFlags    = rq->wValue.bytes[0];
+            c->address      = rq->wIndex.bytes[0];
+            c->address2     = rq->wIndex.bytes[1];
+            return 0;
+        }
+        usbMsgPtr = (uchar *)&mpcmStats;
+        return sizeof(mpcmStats);
+    }
+#endif
+    return 0;
+}
+
 uchar usbFunctionSetup(uchar data[8])
 {
 usbRequest_t    *rq = (void *)data;
 
+#ifdef EP0_DATA
+    ep0Transfer = 0;
+#endif
     if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
 
         if( rq->bRequest==GET_LINE_CODING || rq->bRequest==SET_LINE_CODING ){
@@ -168,14 +432,18 @@ usbRequest_t    *rq = (void *)data;
         /*    SET_LINE_CODING -> usbFunctionWrite()    */
         }
         if(rq->bRequest == SET_CONTROL_LINE_STATE){
-            UART_CTRL_PORT	= (UART_CTRL_PORT&~(1<<UART_CTRL_DTR))|((rq->wValue.word&1)<<UART_CTRL_DTR);
+            /* sbi/cbi, RS485_DE changes the port in an interrupt */
+            if( rq->wValue.word&1 )
+                UART_CTRL_PORT  |= (1<<UART_CTRL_DTR);
+            else
+                UART_CTRL_PORT  &= ~(1<<UART_CTRL_DTR);
 
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3
             /* Report serial state (carrier detect). On several Unix platforms,
              * tty devices can only be opened when carrier detect is set.
              */
             if( intr3Status==0 )
-                intr3Status = 2;
+                serialState = 0xff;
 #endif
         }
 #if 1
@@ -184,6 +452,9 @@ usbRequest_t    *rq = (void *)data;
             sendEmptyFrame  = 1;
 #endif
     }
+    else if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_VENDOR){
+        return vendorSetup(rq);
+    }
 
     return 0;
 }
@@ -195,11 +466,17 @@ usbRequest_t    *rq = (void *)data;
 
 uchar usbFunctionRead( uchar *data, uchar len )
 {
+usbDWord_t  br;
+
+    if( ep0Transfer )
+        return ep0Read(data, len);
 
-    data[0] = baud.bytes[0];
-    data[1] = baud.bytes[1];
-    data[2] = baud.bytes[2];
-    data[3] = baud.bytes[3];
+    /*    GET_LINE_CODING, AUTOBAUD_SELECT until a rate is detected    */
+    br.dword    = autobaudActive? AUTOBAUD_SELECT : baud.dword;
+    data[0] = br.bytes[0];
+    data[1] = br.bytes[1];
+    data[2] = br.bytes[2];
+    data[3] = br.bytes[3];
     data[4] = stopbit;
     data[5] = parity;
     data[6] = databit;
@@ -212,26 +489,89 @@ uchar usbFunctionRead( uchar *data, uchar len )
 /* usbFunctionWrite                                                          */
 /*---------------------------------------------------------------------------*/
 
-uchar usbFunctionWrite( uchar *data, uchar len )
+/*
+    Takes a line coding for the USART. It is applied in the main loop after
+    the queued data is sent, the data that follows is for the new coding.
+*/
+uchar setLineCoding( uchar *data )
 {
+usbDWord_t  br;
+uchar       sb, pt;
+
+    br.bytes[0] = data[0];
+    br.bytes[1] = data[1];
+    br.bytes[2] = data[2];
+    br.bytes[3] = data[3];
+
+    sb  = data[4];
+    pt  = data[5];
+
+    if( pt>2 )
+        pt  = 0;
+    if( sb==1 )
+        sb  = 0;
 
-    /*    SET_LINE_CODING    */
-    baud.bytes[0] = data[0];
-    baud.bytes[1] = data[1];
-    baud.bytes[2] = data[2];
-    baud.bytes[3] = data[3];
+    /*  drivers repeat the current coding on open and on each tcsetattr()  */
+    if( br.dword==baud.dword && sb==stopbit && pt==parity && data[6]==databit )
+        return 0;
 
-    stopbit    = data[4];
-    parity     = data[5];
+    baud.dword = br.dword;
+    stopbit    = sb;
+    parity     = pt;
     databit    = data[6];
 
-    if( parity>2 )
-        parity    = 0;
-    if( stopbit==1 )
-        stopbit    = 0;
+    queueCoding(0);
+    return 1;
+}
 
-    resetUart();
+uchar usbFunctionWrite( uchar *data, uchar len )
+{
+#if defined(BENCH_MODES) || defined(MUX_CHANNELS) || defined(AUTO_BAUD)
+usbDWord_t  br;
+#endif
+
+    if( ep0Transfer )
+        return ep0Write(data, len);
+
+#if defined(BENCH_MODES) || defined(MUX_CHANNELS) || defined(AUTO_BAUD)
+
+    /*    SET_LINE_CODING, baud rates that select a mode    */
+    br.bytes[0] = data[0];
+    br.bytes[1] = data[1];
+    br.bytes[2] = data[2];
+    br.bytes[3] = data[3];
 
+#ifdef BENCH_MODES
+    if( br.dword==BENCH_BAUD_LOOPBACK ){
+        benchSetMode(BENCH_LOOPBACK, 0);
+        return 1;
+    }
+    if( benchMode!=BENCH_OFF )
+        benchSetMode(BENCH_OFF, 0);
+#endif
+#ifdef MUX_CHANNELS
+    if( br.dword==MUX_BAUD_SELECT ){
+        muxStart();
+        return 1;
+    }
+    if( muxActive )
+        muxStop();
+#endif
+#ifdef AUTO_BAUD
+    if( br.dword==AUTOBAUD_SELECT ){
+        /*  the format applies now, the rate when it is detected  */
+        data[0] = baud.bytes[0];
+        data[1] = baud.bytes[1];
+        data[2] = baud.bytes[2];
+        data[3] = baud.bytes[3];
+        autobaudStart(1);
+    }
+    else if( autobaudActive )
+        autobaudStart(0);
+#endif
+#endif
+
+    setLineCoding(data);
     return 1;
 }
 
@@ -239,6 +579,19 @@ uchar usbFunctionWrite( uchar *data, uchar len )
 void usbFunctionWriteOut( uchar *data, uchar len )
 {
 
+    if( benchMode!=BENCH_OFF ){
+        benchWriteOut(data, len);
+        return;
+    }
+    if( muxActive ){
+        muxWriteOut(data, len);
+        return;
+    }
+    if( compActive ){
+        compWriteOut(data, len);
+        return;
+    }
+
     /*  usb -> rs232c:  transmit char    */
     for( ; len; len-- ) {
         uchar   uwnxt;
@@ -246,18 +599,84 @@ void usbFunctionWriteOut( uchar *data, uchar len )
         uwnxt = (uwptr+1) & TX_MASK;
         if( uwnxt!=irptr ) {
             tx_buf[uwptr] = *data++;
+            latTxStamp(uwptr);
             uwptr = uwnxt;
         }
+        else
+            perfTxDropped();
     }
+    perfOutPacket();
+    perfTxLevel(TX_MASK - uartTxBytesFree());
 
     /*  postpone receiving next data    */
-    if( uartTxBytesFree()<=HW_CDC_BULK_OUT_SIZE )
+    if( uartTxBytesFree()<=UART_TX_STOP ){
         usbDisableAllRequests();
+        perfRequestsDisabled();
+        DBG2(0x30, 0, 0);
+    }
+}
+
+
+#ifdef EVENT_FLAGS
+
+#if USB_CFG_RESET_IN_POLL
+#error "the event loop needs USB_CFG_RESET_IN_POLL 0 in usbconfig.h"
+#endif
+
+#define TICK_PRESCALER  256
+#define TICK_TOP        (F_CPU/TICK_PRESCALER/1000 - 1)    /* 1 ms */
+
+/*  sbi changes neither registers nor flags  */
+ISR( TIMER0_COMPA_vect, ISR_NAKED )
+{
+    EVENT_FLAGS |= (1<<EVENT_TICK);
+    reti();
+}
+
+/*
+    Sleeps until the next interrupt if nothing is left to do. A tick sets
+    EVENT_FLAGS, a USART interrupt clears RXCIE0; both are checked with
+    interrupts disabled. The USB side is checked before; a USB interrupt
+    after the main loop cleared EVENT_USB sets it again with USB_TX_HOOK,
+    so that none is left for the next tick. Waking up from idle sleep adds
+    4 cycles to the interrupt response, nothing else delays the USB
+    interrupt then.
+*/
+static void idleSleep(void)
+{
+
+    if( benchMode!=BENCH_OFF || usbPending() )
+        return;
+    if( codingPending() && uartTxDrained() )
+        return;
+    if( autobaudRate && autobaudRate!=autobaudQueued && !codingsFull )
+        return;
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+    if( intr3Status!=0 && usbInterruptIsReady3() )
+        return;
+#endif
+    if( !uartIdle() )
+        return;
+    cli();
+    if( EVENT_FLAGS==0 && (UCSR0B&(1<<RXCIE0)) ){
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }else{
+        sei();
+    }
 }
 
+#endif  /* EVENT_FLAGS */
+
 
 static void hardwareInit(void)
 {
+uchar   resetFlags;
+
+    resetFlags  = MCUSR;
+    MCUSR       = 0;
 
     /* activate pull-ups except on USB lines */
     USB_CFG_IOPORT   = (uchar)~((1<<USB_CFG_DMINUS_BIT)|(1<<USB_CFG_DPLUS_BIT));
@@ -269,9 +688,13 @@ static void hardwareInit(void)
     USBDDR    = (1<<USB_CFG_DMINUS_BIT)|(1<<USB_CFG_DPLUS_BIT);
 #endif
 
-    /* 250 ms disconnect */
-    wdt_reset();
-    _delay_ms(250);
+    /* 250 ms disconnect, only if the host may still know us from before
+     * the reset. After power-on there is nothing to disconnect from.
+     */
+    if( !(resetFlags & (1<<PORF)) ){
+        wdt_reset();
+        _delay_ms(250);
+    }
 
 #ifdef USB_CFG_PULLUP_IOPORT
     usbDeviceConnect();
@@ -285,6 +708,15 @@ static void hardwareInit(void)
     parity  = 0;
     databit = 8;
     resetUart();
+    profileInit();
+
+#ifdef EVENT_FLAGS
+    TCCR0A  = (1<<WGM01);           /* CTC */
+    OCR0A   = TICK_TOP;
+    TCCR0B  = (1<<CS02);            /* F_CPU/256 */
+    TIMSK0  = (1<<OCIE0A);
+    set_sleep_mode(SLEEP_MODE_IDLE);
+#endif
 }
 
 
@@ -295,21 +727,77 @@ int main(void)
     odDebugInit();
     hardwareInit();
     usbInit();
+    statsInit();
 
     intr3Status = 0;
     sendEmptyFrame  = 0;
+    codingHead  = 0;
+    codingTail  = 0;
+    codingsFull = 0;
+    autobaudQueued  = 0;
 
     sei();
     for(;;){    /* main event loop */
         wdt_reset();
+        perfLoopBegin();
+#ifdef EVENT_FLAGS
+        EVENT_FLAGS &= ~(1<<EVENT_USB);
+        if( EVENT_FLAGS&(1<<EVENT_TICK) ){
+            EVENT_FLAGS &= ~(1<<EVENT_TICK);
+            usbCheckReset();
+#ifdef ALT_PROFILES
+            uartTick();
+#endif
+        }
+#endif
         usbPoll();
+        perfUsbPollDone();
         uartPoll();
+        perfUartPollDone();
+        benchPoll();
+
+        if( codingPending() && uartTxDrained() && mpcmIdle() ){
+            pendingCoding_t *c = &codings[codingTail];
+
+            codingTail  = (codingTail+1) & (CODING_QUEUE-1);
+            if( c->flags & CODING_MPCM )
+                mpcmConfig(c->mpcmFlags, c->address, c->address2);
+            uartConfigure(c->baud.dword, c->parity, c->stopbit, c->databit);
+            if( c->flags & CODING_AUTOBAUD ){
+                autobaudQueued  = 0;
+                if( autobaudRate==c->baud.dword )   /* not restarted since */
+                    autobaudApplied();
+            }
+            if( codingPending() )
+                uartHoldTx(codings[codingTail].mark);
+            if( codingsFull ){
+                codingsFull = 0;
+                if( !compOutPending && uartTxBytesFree()>UART_TX_STOP ){
+                    usbEnableAllRequests();
+                    perfRequestsEnabled();
+                }
+            }
+        }
+        /*  the detected rate waits for the data before it like a line
+            coding, the detection goes on dropping what is received  */
+        if( autobaudRate && autobaudRate!=autobaudQueued && !codingsFull ){
+            autobaudQueued  = autobaudRate;
+            baud.dword  = autobaudRate;
+            queueCoding(CODING_AUTOBAUD);
+        }
 
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3
-        /* We need to report rx and tx carrier after open attempt */
-        if(intr3Status != 0 && usbInterruptIsReady3()){
-            static uchar serialStateNotification[10] = {0xa1, 0x20, 0, 0, 0, 0, 2, 0, 3, 0};
+        /* Report modem lines and receiver errors when they change */
+        if(intr3Status == 0){
+            uchar   state = uartLineState();
 
+            if(state != serialState){
+                serialState = state;
+                serialStateNotification[8] = state;
+                intr3Status = 2;
+            }
+        }
+        if(intr3Status != 0 && usbInterruptIsReady3()){
             if(intr3Status == 2){
                 usbSetInterrupt3(serialStateNotification, 8);
             }else{
@@ -317,6 +805,9 @@ int main(void)
             }
             intr3Status--;
         }
+#endif
+#ifdef EVENT_FLAGS
+        idleSleep();
 #endif
     }
 
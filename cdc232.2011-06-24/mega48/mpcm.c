@@ -0,0 +1,233 @@
+/* Name: mpcm.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the 9 bit mode, see mpcm.h.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "mux.h"
+#include "comp.h"
+#include "capture.h"
+#include "autobaud.h"
+#include "mpcm.h"
+
+#ifdef MPCM_MODE
+
+#define TX_DATA     0           /* mpcmTxState: the next byte is a frame */
+#define TX_ESC      1           /* after MPCM_ESC */
+#define TX_ADDR     2           /* after MPCM_ESC_ADDR, the next is an address */
+
+uchar           mpcmActive;
+uchar           mpcmWait;       /* the RX interrupt goes to mpcmIrq() */
+uchar           mpcmLatched;    /* a frame mpcmIrq() took for uartPoll() */
+vendorMpcm_t    mpcmStats;
+
+static uchar    mpcmTxState;
+static uchar    mpcmBit9;       /* RXB80 of the frame uartPoll() read */
+static uchar    latchStatus, latchBit9, latchData;
+
+
+void mpcmConfig(uchar flags, uchar address, uchar address2)
+{
+
+    memset(&mpcmStats, 0, sizeof(mpcmStats));
+    if( muxActive || compActive || capActive )
+        flags   = 0;
+    mpcmStats.flags     = flags & (MPCM_NINE_BITS|MPCM_FILTER|MPCM_ADDR2);
+    mpcmStats.address   = address;
+    mpcmStats.address2  = address2;
+}
+
+/*  From uartConfigure(), returns nonzero for 9 data bits.  */
+uchar mpcmApply(void)
+{
+uchar   filter;
+
+    mpcmActive  = (mpcmStats.flags & MPCM_NINE_BITS) && !autobaudActive;
+    filter      = mpcmActive && (mpcmStats.flags & MPCM_FILTER);
+    if( !mpcmActive )
+        mpcmTxState = TX_DATA;
+    mpcmStats.selected  = !filter;
+    mpcmWait    = 0;            /* uartConfigure() turns the interrupt off */
+    mpcmLatched = 0;
+    UCSR0A  = (UCSR0A & (1<<U2X0)) | (filter? (1<<MPCM0) : 0);
+    return mpcmActive;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*  Returns nonzero if c of tx_buf is an escape, which is no frame. A byte
+    that is one stays as it is until mpcmTxSent(), the caller may try it
+    again.  */
+uchar mpcmTx(uchar c)
+{
+
+    if( mpcmTxState==TX_ESC ) {
+        if( c==MPCM_ESC )
+            return 0;
+        mpcmTxState = c==MPCM_ESC_ADDR? TX_ADDR : TX_DATA;  /* others reserved */
+        return 1;
+    }
+    if( mpcmTxState==TX_DATA && c==MPCM_ESC ) {
+        mpcmTxState = TX_ESC;
+        return 1;
+    }
+    return 0;
+}
+
+/*  The UCSR0B of the next frame but RXCIE0, which the cli() section of
+    uartPoll() that writes the frame keeps as mpcmIrq() left it.  */
+uchar mpcmTxFrame(void)
+{
+
+    return uartUcsrb | (mpcmTxState==TX_ADDR? (1<<TXB80) : 0);
+}
+
+/*  After the frame is written to UDR0.  */
+void mpcmTxSent(void)
+{
+
+    mpcmTxState = TX_DATA;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*  A data frame right after a matching address is received only if MPCM0
+    is clear by its stop bit, a frame time after the address. The main
+    loop may take longer, so while MPCM0 is set the RX interrupt of uart.c
+    jumps here: a matching address clears MPCM0 at once and is left for
+    uartPoll() with the status it was read with, as is any frame with an
+    error or without RXB80 (received before MPCM0 was set). The address
+    of another node and a data frame received before MPCM0 was set are
+    counted and dropped here, and the interrupt stays on for the next one.
+    The wake interrupt has turned RXCIE0 off before the jump, so the
+    prologue enables interrupts at once: no vector, so not ISR() but the
+    interrupt attribute, which also saves what it uses and ends in reti.  */
+#ifdef __AVR__
+void mpcmIrq(void) __attribute__((interrupt));
+#endif
+void mpcmIrq(void)
+{
+uchar   status, bit9, data, match, flags = mpcmStats.flags;
+
+    status  = UCSR0A;
+    if( !(status & (1<<RXC0)) )
+        return;                 /* UDRE0, the main loop is awake */
+    bit9    = UCSR0B & (1<<RXB80);
+    data    = UDR0;
+    status  &= (1<<FE0) | (1<<DOR0) | (1<<UPE0);
+    match   = bit9 && (data==mpcmStats.address || ((flags & MPCM_ADDR2) && data==mpcmStats.address2));
+    if( status || match ) {
+        if( match && !(status & ((1<<FE0) | (1<<UPE0))) )
+            UCSR0A  = UCSR0A & (1<<U2X0);   /* DOR0 is about the frames before */
+        latchStatus = status;
+        latchBit9   = bit9;
+        latchData   = data;
+        mpcmLatched = 1;
+        mpcmWait    = 0;
+        return;
+    }
+    if( bit9 )
+        mpcmStats.addresses++;
+    else
+        mpcmStats.dropped++;    /* received before MPCM0 was set */
+    cli();
+    UCSR0B  = uartUcsrb | (1<<RXCIE0);
+}
+
+/*  Arms the interrupt above while MPCM0 is set, from uartPoll() after its
+    receive loop.  */
+void mpcmRxWait(void)
+{
+
+    if( mpcmWait || mpcmLatched || !(UCSR0A & (1<<MPCM0)) )
+        return;
+    cli();
+    mpcmWait    = 1;
+    UCSR0B  = uartUcsrb | (1<<RXCIE0);
+    sei();
+}
+
+/*  Returns nonzero when a line coding may turn the receiver off: the frame
+    mpcmIrq() took is in rx_buf, and the interrupt is off so that it takes
+    no other.  */
+uchar mpcmIdle(void)
+{
+uchar   idle;
+
+    cli();
+    idle    = !mpcmLatched;
+    if( idle && mpcmWait ) {
+        mpcmWait    = 0;
+        UCSR0B  = uartUcsrb;
+    }
+    sei();
+    return idle;
+}
+
+/*  The next frame for uartPoll(): the one mpcmIrq() took, or the one in
+    UDR0 with RXB80 read before it. Returns the data and the status bits
+    of UCSR0A.  */
+uchar mpcmRxFrame(uchar *status)
+{
+
+    if( mpcmLatched ) {
+        mpcmLatched = 0;
+        mpcmBit9    = latchBit9;
+        *status     = latchStatus;
+        return latchData;
+    }
+    *status     = UCSR0A;
+    mpcmBit9    = UCSR0B & (1<<RXB80);
+    return UDR0;
+}
+
+static void mpcmPut(uchar c)
+{
+
+    rx_buf[iwptr]   = c;
+    iwptr   = (iwptr+1) & RX_MASK;
+}
+
+/*  data was read with mpcmBit9; returns nonzero if it goes to rx_buf,
+    after the escape that comes before it.  */
+uchar mpcmRx(uchar data)
+{
+uchar   flags = mpcmStats.flags, match;
+
+    if( !mpcmActive )
+        return 1;
+    if( !mpcmBit9 ) {
+        if( !mpcmStats.selected ) {
+            mpcmStats.dropped++;
+            return 0;
+        }
+        if( data==MPCM_ESC )
+            mpcmPut(MPCM_ESC);
+        return 1;
+    }
+    mpcmStats.addresses++;
+    if( flags & MPCM_FILTER ) {
+        match   = data==mpcmStats.address || ((flags & MPCM_ADDR2) && data==mpcmStats.address2);
+        mpcmStats.selected  = match;
+        UCSR0A  = (UCSR0A & (1<<U2X0)) | (match? 0 : (1<<MPCM0));
+        if( !match )
+            return 0;
+        mpcmStats.matched++;
+    }
+    mpcmPut(MPCM_ESC);
+    mpcmPut(MPCM_ESC_ADDR);
+    return 1;
+}
+
+#endif  /* MPCM_MODE */
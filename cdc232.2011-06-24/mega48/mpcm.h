@@ -0,0 +1,88 @@
+/* Name: mpcm.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __mpcm_h_included__
+#define __mpcm_h_included__
+
+/*
+General Description:
+    9 bit mode of the ATmega firmware (-DMPCM_MODE) for multi-drop buses
+    where the 9th bit marks an address frame. VENDOR_RQ_MPCM sets it up
+    and uartConfigure() applies it with the line coding: UCSZ 7, UCSZ02
+    in UCSR0B, which the wake interrupt of uart.c keeps with uartUcsrb.
+    CDC has no 9 bit coding, both bulk endpoints carry the frames escaped
+    as in vendor.h: uartPoll() takes the escapes out of tx_buf (mpcmTx())
+    and sets TXB80 in the cli() section that writes UDR0 (mpcmTxFrame()),
+    and puts them into rx_buf before a byte read with RXB80 (mpcmRx()),
+    for which MPCM_ROOM bytes must be free.
+
+    With MPCM_FILTER only the address frames that match and the data
+    frames after them reach rx_buf. The address of another node sets
+    MPCM0, and the USART drops the data frames up to the next address, so
+    they cost neither the main loop nor USB packets; those it received
+    before uartPoll() read the address are dropped here and counted.
+    While MPCM0 is set, the RX interrupt reads the address frames
+    (mpcmIrq()) and clears MPCM0 on a match before the next frame ends,
+    so data may follow an address without a gap up to 57600 baud; at
+    higher rates a frame is shorter than the USB transactions that keep
+    the interrupt waiting. A line coding waits for the frame mpcmIrq()
+    took (mpcmIdle()) and starts with no address matched.
+    Not with the multi-channel, the compressed or the capture mode, nor
+    during the baud rate detection. RS485_ECHO expects the echo of every
+    frame sent, the filter drops those of data for another node.
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+#ifdef MPCM_MODE
+
+#ifdef URSEL
+#   error "MPCM_MODE needs an ATmega48/88/168/328p"
+#endif
+
+#define MPCM_ROOM           3       /* rx_buf bytes of an address frame */
+
+extern uchar            mpcmActive;     /* 9 data bits */
+extern uchar            mpcmWait;       /* the RX interrupt takes the frames */
+extern uchar            mpcmLatched;    /* it took one for uartPoll() */
+extern vendorMpcm_t     mpcmStats;
+
+extern void mpcmConfig(uchar flags, uchar address, uchar address2);
+extern uchar mpcmApply(void);
+extern uchar mpcmTx(uchar c);
+extern uchar mpcmTxFrame(void);
+extern void mpcmTxSent(void);
+extern void mpcmIrq(void);
+extern void mpcmRxWait(void);
+extern uchar mpcmIdle(void);
+extern uchar mpcmRxFrame(uchar *status);
+extern uchar mpcmRx(uchar data);
+
+#define mpcmRxReady()       (mpcmLatched || (!mpcmWait && (UCSR0A&(1<<RXC0))))
+#define mpcmRoom()          (!mpcmActive || ((urptr-iwptr-1) & RX_MASK)>=MPCM_ROOM)
+
+#else
+
+#define mpcmActive          0
+#define mpcmConfig(flags, address, address2)
+#define mpcmApply()         0
+#define mpcmTx(c)           0
+#define mpcmTxFrame()       0
+#define mpcmTxSent()
+#define mpcmRxWait()
+#define mpcmIdle()          1
+#define mpcmRx(data)        1
+#define mpcmRxReady()       (UCSR0A&(1<<RXC0))
+#define mpcmRoom()          1
+
+#endif  /* MPCM_MODE */
+
+#endif  /*  __mpcm_h_included__  */
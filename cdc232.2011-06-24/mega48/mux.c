@@ -0,0 +1,226 @@
+/* Name: mux.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the multi-channel mode, see mux.h.
+*/
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>   /* needed by usbdrv.h */
+#include "usbdrv.h"
+#include "uart.h"
+#include "mux.h"
+#include "stats.h"
+
+#ifdef MUX_CHANNELS
+
+extern uchar    sendEmptyFrame;
+
+uchar           muxActive;
+
+static uchar    outHeader, outLeft, outCount;   /* OUT frame in progress */
+static uchar    outArgs[7];
+static uchar    txCredit[MUX_CHANNEL_COUNT];    /* granted to the host, not used yet */
+static uchar    rxCredit[MUX_CHANNEL_COUNT];    /* granted by the host */
+static uchar    nextChannel;                    /* first channel of the next IN packet */
+
+
+void muxStart(void)
+{
+uchar   ch;
+
+    outLeft = 0;
+    for( ch=0; ch<MUX_CHANNEL_COUNT; ch++ ) {
+        txCredit[ch]    = 0;
+        rxCredit[ch]    = 0;
+    }
+    nextChannel = 0;
+    swuartInit();
+    muxActive   = 1;
+}
+
+void muxStop(void)
+{
+
+    muxActive   = 0;
+    swuartOff();
+}
+
+static uchar txBytesFree(uchar ch)
+{
+    return ch==0? uartTxBytesFree() : swuartTxBytesFree();
+}
+
+static uchar rxBytes(uchar ch)
+{
+    return ch==0? (iwptr-urptr) & RX_MASK : swuartRxBytes();
+}
+
+/*  Credit that is due for the host: the free room that is not granted yet,
+    in steps of MUX_CREDIT_STEP while the host still has some.  */
+static uchar creditDue(uchar ch)
+{
+uchar   n;
+
+    n   = txBytesFree(ch);
+    if( n<=txCredit[ch] )
+        return 0;
+    n   -= txCredit[ch];
+    if( n<MUX_CREDIT_STEP && txCredit[ch]!=0 )
+        return 0;
+    return n;
+}
+
+static void muxPut(uchar ch, uchar c)
+{
+
+    if( txCredit[ch] )
+        txCredit[ch]--;
+    if( ch==0 ) {
+        uchar   uwnxt;
+
+        uwnxt = (uwptr+1) & TX_MASK;
+        if( uwnxt!=irptr ) {
+            tx_buf[uwptr] = c;
+            latTxStamp(uwptr);
+            uwptr = uwnxt;
+            return;
+        }
+    }
+    else if( swuartPut(c) )
+        return;
+    perfTxDropped();    /* the host sent more than its credit */
+}
+
+static void muxCommand(uchar ch)
+{
+uchar   n;
+
+    switch( MUX_HDR_TYPE(outHeader) ) {
+    case MUX_CMD_CREDIT:
+        n   = rxCredit[ch] + outArgs[0];
+        rxCredit[ch]    = n<rxCredit[ch]? 0xff : n;
+        break;
+    case MUX_CMD_CODING:
+        if( ch==0 )
+            setLineCoding(outArgs);
+        else
+            swuartSetCoding(outArgs);
+        break;
+    }
+}
+
+void muxWriteOut(uchar *data, uchar len)
+{
+uchar   ch;
+
+    for( ; len; len--, data++ ) {
+        if( outLeft==0 ) {      /* header */
+            outHeader   = *data;
+            outCount    = 0;
+            switch( MUX_HDR_TYPE(outHeader) ) {
+            case MUX_CMD_CREDIT:
+                outLeft = 1;
+                break;
+            case MUX_CMD_CODING:
+                outLeft = 7;
+                break;
+            default:
+                outLeft = outHeader & MUX_HDR_CMD? 0 : MUX_HDR_TYPE(outHeader)+1;
+            }
+            continue;
+        }
+        outLeft--;
+        ch  = MUX_HDR_CHANNEL(outHeader);
+        if( ch>=MUX_CHANNEL_COUNT )
+            continue;
+        if( !(outHeader & MUX_HDR_CMD) )
+            muxPut(ch, *data);
+        else {
+            outArgs[outCount++] = *data;
+            if( outLeft==0 )
+                muxCommand(ch);
+        }
+    }
+    perfOutPacket();
+    perfTxLevel(TX_MASK - uartTxBytesFree());
+}
+
+/*  Returns nonzero if muxPoll() has something for the interrupt-in
+    endpoint.  */
+uchar muxPending(void)
+{
+uchar   ch;
+
+    if( sendEmptyFrame )
+        return 1;
+    for( ch=0; ch<MUX_CHANNEL_COUNT; ch++ ) {
+        if( creditDue(ch) || (rxCredit[ch] && rxBytes(ch)) )
+            return 1;
+    }
+    return 0;
+}
+
+void muxPoll(void)
+{
+uchar   buf[HW_CDC_BULK_IN_SIZE], n, ch, i, len;
+
+    EVENT_FLAGS &= ~(1<<EVENT_SWUART);
+    swuartPoll();
+    if( !usbInterruptIsReady() )
+        return;
+
+    /*  credit first, the host holds back data without it  */
+    n   = 0;
+    for( ch=0; ch<MUX_CHANNEL_COUNT; ch++ ) {
+        len = creditDue(ch);
+        if( len ) {
+            buf[n++]    = MUX_HDR(ch, MUX_CMD_CREDIT);
+            buf[n++]    = len;
+            txCredit[ch]    += len;
+        }
+    }
+
+    ch  = nextChannel;
+    for( i=0; i<MUX_CHANNEL_COUNT && n<HW_CDC_BULK_IN_SIZE-1; i++ ) {
+        len = rxBytes(ch);
+        if( len>rxCredit[ch] )
+            len = rxCredit[ch];
+        if( len>HW_CDC_BULK_IN_SIZE-1-n )
+            len = HW_CDC_BULK_IN_SIZE-1-n;
+        if( len ) {
+            rxCredit[ch]    -= len;
+            buf[n++]    = MUX_HDR(ch, len-1);
+            if( ch==0 ) {
+                latRxSend(urptr, len);
+                do {
+                    buf[n++]    = rx_buf[urptr];
+                    urptr   = (urptr+1) & RX_MASK;
+                } while( --len );
+                UART_CTRL_PORT  |= (1<<UART_CTRL_RTS);
+            }
+            else {
+                do {
+                    buf[n++]    = swRxBuf[swRxR];
+                    swRxR   = (swRxR+1) & SW_RX_MASK;
+                } while( --len );
+            }
+        }
+        if( ++ch==MUX_CHANNEL_COUNT )
+            ch  = 0;
+    }
+    nextChannel = nextChannel+1==MUX_CHANNEL_COUNT? 0 : nextChannel+1;
+
+    if( n || sendEmptyFrame ) {
+        usbSetInterrupt(buf, n);
+        perfInPacket();
+        /* an empty packet after a full one ends the transfer */
+        sendEmptyFrame  = n==HW_CDC_BULK_IN_SIZE;
+    }
+}
+
+#endif  /* MUX_CHANNELS */
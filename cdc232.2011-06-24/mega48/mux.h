@@ -0,0 +1,67 @@
+/* Name: mux.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __mux_h_included__
+#define __mux_h_included__
+
+/*
+General Description:
+    Multi-channel mode of the ATmega firmware (-DMUX_CHANNELS). Channel 0
+    is the USART with tx_buf and rx_buf, channel 1 the software UART of
+    sw-uart.c. Both share the bulk endpoints in the framing of vendor.h.
+    SET_LINE_CODING with MUX_BAUD_SELECT selects the mode, and host/cdcmux
+    makes a pty of each channel.
+
+    usbFunctionWriteOut() hands the OUT data to muxWriteOut(), which takes
+    the frames apart. uartPoll() calls muxPoll() instead of sending rx_buf;
+    it builds the IN packets from credit for the host first, then data of
+    the channels in turn as far as the host's credit reaches. A channel
+    that is full only holds back its own credit, the OUT endpoint is not
+    NAKed for it. MUX_CMD_CODING sets the line coding of a channel, which
+    is applied after the data queued before it is sent.
+    Needs 1KB SRAM (ATmega88/168/328p).
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+/* main.c: a line coding for the USART as sent with SET_LINE_CODING,
+   returns 0 if it is the current one */
+extern uchar setLineCoding(uchar *data);
+
+#ifdef MUX_CHANNELS
+
+#if RAMEND < 0x400
+#   error "MUX_CHANNELS needs 1KB SRAM"
+#endif
+
+#define MUX_CHANNEL_COUNT   2
+#define MUX_CREDIT_STEP     8   /* smallest grant while the host has credit */
+
+extern uchar    muxActive;
+
+extern void muxStart(void);
+extern void muxStop(void);
+extern void muxWriteOut(uchar *data, uchar len);
+extern void muxPoll(void);
+extern uchar muxPending(void);
+
+#else
+
+#define muxActive           0
+#define muxStart()
+#define muxStop()
+#define muxWriteOut(data, len)
+#define muxPoll()
+#define muxPending()        0
+
+#endif  /* MUX_CHANNELS */
+
+#endif  /*  __mux_h_included__  */
@@ -0,0 +1,177 @@
+/* Name: rs485.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module implements the RS-485 driver enable, see rs485.h.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "uart.h"
+#include "rs485.h"
+
+#ifdef RS485_DE
+
+#define ECHO_MASK   (RS485_ECHO_MAX-1)
+
+volatile uchar  rs485Sending;
+volatile uchar  rs485Reading;
+vendorRs485_t   rs485Stats;
+
+static uchar    echoBuf[RS485_ECHO_MAX], echoHead, echoTail;
+static volatile uchar   echoLeft;   /* frames after DE that can be echoes */
+static uchar    echoMask;       /* the data bits, UDR0 reads the others as 0 */
+
+
+void rs485Init(void)
+{
+
+    UART_CTRL_PORT  &= ~(1<<UART_CTRL_DE);
+    UART_CTRL_DDR   |= (1<<UART_CTRL_DE);
+    TCCR2A  = (1<<WGM21);       /* CTC, OCR2A+1 ticks are the hold time */
+    TIMSK2  = (1<<OCIE2A);
+}
+
+/*  The USART is off: DE low, no hold, no echo expected.  */
+void rs485Reset(uchar databits)
+{
+
+    TCCR2B  = 0;
+    TIFR2   = (1<<OCF2A);
+    UART_CTRL_PORT  &= ~(1<<UART_CTRL_DE);
+    rs485Sending    = 0;
+    echoTail    = echoHead;
+    echoLeft    = 0;
+    echoMask    = databits<8? 0xff >> (8-databits) : 0xff;  /* RXB80 is not compared */
+}
+
+void rs485Config(uchar flags, uchar hold)
+{
+
+    memset(&rs485Stats, 0, sizeof(rs485Stats));
+    rs485Stats.flags    = flags & RS485_ECHO;
+    rs485Stats.hold     = hold;
+    echoTail    = echoHead;
+    echoLeft    = 0;
+    OCR2A   = hold - 1;
+}
+
+/*  Called before the cli() section that writes a byte to UDR0, which
+    checks with rs485Begin() that DE was not released meanwhile. Returns 0
+    if the byte has to wait: with RS485_ECHO no more bytes are in the USART
+    than echoBuf takes, they are not read while rx_buf is full, and a turn
+    starts once the bytes received before it are read, which could pass
+    for echoes; rs485Begin() gives way to one that came in as DE went up.  */
+uchar rs485Send(void)
+{
+uchar   echo = rs485Stats.flags & RS485_ECHO;
+
+    if( echo && (uchar)(echoHead-echoTail)>=RS485_ECHO_MAX )
+        return 0;
+    if( !rs485Sending ) {
+        if( echo ) {
+            if( UCSR0A&(1<<RXC0) )
+                return 0;
+            echoTail    = echoHead; /* of the last turn, lost or garbled */
+            echoLeft    = 0;
+        }
+        rs485Sending    = 1;    /* DE not yet, no interrupt releases it */
+    }
+    return 1;
+}
+
+/*  After c was written to UDR0: its echo is read by uartPoll() later on,
+    a byte that rs485Begin() held back leaves none behind.  */
+void rs485Sent(uchar c)
+{
+
+    if( rs485Stats.flags & RS485_ECHO ) {
+        echoBuf[echoHead & ECHO_MASK]   = c & echoMask;
+        echoHead++;
+    }
+}
+
+/*  No echo comes after TXC0: only the frames in the receiver and the one
+    uartPoll() may have read can be echoes, a later byte of the peer must
+    not be taken for one that was lost or garbled.  */
+static void release(void)
+{
+
+    UART_CTRL_PORT  &= ~(1<<UART_CTRL_DE);
+    rs485Sending    = 0;
+    rs485Stats.turnarounds++;
+    echoLeft    = rs485Reading;
+    if( UCSR0A&(1<<RXC0) )
+        echoLeft    += RS485_RX_FRAMES;
+    if( !echoLeft )
+        echoTail    = echoHead;
+}
+
+/*  The last stop bit has left and UDR0 is empty.  */
+ISR( USART_TX_vect, ISR_NOBLOCK )
+{
+
+    if( rs485Stats.hold ) {
+        TCNT2   = 0;
+        TCCR2B  = (1<<CS21);    /* F_CPU/8 */
+    }
+    else
+        release();
+}
+
+/*  The hold time is over; TCNT2 counts from 0 again since then.  */
+ISR( TIMER2_COMPA_vect, ISR_NOBLOCK )
+{
+uchar   late = TCNT2;
+
+    TCCR2B  = 0;
+    TIFR2   = (1<<OCF2A);   /* matched again if this came a hold time late */
+    if( late>rs485Stats.lateMax )
+        rs485Stats.lateMax  = late;
+    release();
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*  Returns nonzero if data is the echo of a byte sent, which drops it.  */
+uchar rs485Echo(uchar data)
+{
+uchar   i, n = echoHead - echoTail;
+
+    for( i=0; i<n; i++ ) {
+        if( echoBuf[(uchar)(echoTail+i) & ECHO_MASK]==data ) {
+            echoTail    += i + 1;   /* and the echoes the USART lost */
+            rs485Stats.echoes++;
+            return 1;
+        }
+    }
+    if( n )
+        rs485Stats.collisions++;
+    return 0;
+}
+
+/*  After each frame uartPoll() has read.  */
+void rs485RxDone(void)
+{
+
+    cli();
+    rs485Reading    = 0;
+    if( echoLeft && !--echoLeft )
+        echoTail    = echoHead;
+    sei();
+}
+
+/*  After the receive loop of uartPoll().  */
+void rs485Poll(void)
+{
+
+    if( echoTail!=echoHead && !rs485Sending && !(UCSR0A&(1<<RXC0)) )
+        echoTail    = echoHead;     /* garbled or not received at all */
+}
+
+#endif  /* RS485_DE */
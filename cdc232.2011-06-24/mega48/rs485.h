@@ -0,0 +1,119 @@
+/* Name: rs485.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __rs485_h_included__
+#define __rs485_h_included__
+
+/*
+General Description:
+    Driver enable of an RS-485 transceiver for the ATmega firmware
+    (-DRS485_DE) on UART_CTRL_DE (PC2), high while the device sends.
+    uartPoll() raises it in the same cli() section that writes the first
+    byte to UDR0, so the start bit follows within a bit; rs485Send() does
+    the bookkeeping before and rs485Sent() after, rs485Begin() in the
+    section raises DE unless it was released meanwhile. The USART
+    transmit complete interrupt, which is on with UART_UCSRB, drops it
+    when the last stop bit has left and UDR0 is empty: at once, or after
+    a hold time timed by Timer2 (CTC, F_CPU/8) for transceivers and buses
+    that need the line driven a little longer. The interrupt comes as
+    late as the USB interrupt is long, and V-USB takes a packet that
+    starts before it returns in the same one: two full size transactions,
+    about 200us at 12 MHz. With a hold time TIMER2_COMPA_vect can come as
+    late again, so DE drops within 400us after the hold time; TCNT2 at its
+    start, which counts from 0 after each hold time, is kept in the stats
+    as lateMax. Waiting out the hold in USART_TX_vect would not be sooner,
+    the USB interrupt stops it the same way, and would stop the main loop.
+
+    With RS485_ECHO (VENDOR_RQ_RS485) the receive loop of uartPoll() drops
+    the echo of what the device sent, for transceivers whose receiver
+    stays on: the bytes sent are expected back in order, a byte that is
+    not the next one is kept and counted as a collision, one that is a
+    later one skips the echoes the USART lost. The device starts sending
+    when the bytes received before are read, and sends no more than
+    RS485_ECHO_MAX bytes ahead of their echoes: the transmitter waits
+    while rx_buf is full.
+    The echo of the last stop bit comes before TXC0, so once DE is
+    released only the frames the receiver has (RS485_RX_FRAMES if RXC0 is
+    set) and the one uartPoll() may be holding can be echoes. The echoes
+    still expected after them, or when the next turn starts, were lost
+    or garbled and are forgotten: a byte of the peer is not taken for one.
+    ATmega48/88/168/328p (Timer2 with CTC).
+*/
+
+#include <avr/io.h>
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+#ifdef RS485_DE
+
+#ifndef TCCR2A
+#   error "RS485_DE needs Timer2 with CTC (ATmega48/88/168/328p)"
+#endif
+
+#define RS485_ECHO_MAX      4       /* bytes sent, echo not yet read: the
+                                       shift register, UDR0 and the 2 byte
+                                       receive FIFO; must be 2^n */
+#define RS485_RX_FRAMES     3       /* frames the receiver keeps unread: the
+                                       FIFO and the receive shift register */
+
+extern volatile uchar   rs485Sending;   /* DE is high */
+extern volatile uchar   rs485Reading;   /* uartPoll() has a frame from UDR0 */
+extern vendorRs485_t    rs485Stats;
+
+extern void rs485Init(void);
+extern void rs485Reset(uchar databits);
+extern void rs485Config(uchar flags, uchar hold);
+extern uchar rs485Send(void);
+extern void rs485Sent(uchar c);
+extern uchar rs485Echo(uchar data);
+extern void rs485RxDone(void);
+extern void rs485Poll(void);
+
+#define rs485RxStart()      (rs485Reading = 1)
+
+/*  In the cli() section that writes UDR0 after rs485Send(): stops a hold
+    in progress or raises DE. Returns 0 if DE was released since, or with
+    RS485_ECHO if a frame came in as DE went up, which has to be read
+    first.  */
+static inline uchar rs485Begin(void)
+{
+
+    if( !rs485Sending )
+        return 0;
+    if( UART_CTRL_PORT&(1<<UART_CTRL_DE) ) {
+        TCCR2B  = 0;            /* a hold in progress goes on with this byte */
+        TIFR2   = (1<<OCF2A);
+        return 1;
+    }
+    UART_CTRL_PORT  |= (1<<UART_CTRL_DE);
+    if( (rs485Stats.flags&RS485_ECHO) && (UCSR0A&(1<<RXC0)) ) {
+        UART_CTRL_PORT  &= ~(1<<UART_CTRL_DE);
+        rs485Sending    = 0;
+        return 0;
+    }
+    return 1;
+}
+
+#else
+
+#define rs485Sending        0
+#define rs485Init()
+#define rs485Reset(databits)
+#define rs485Send()         1
+#define rs485Sent(c)
+#define rs485Echo(data)     0
+#define rs485Begin()        1
+#define rs485Poll()
+#define rs485RxStart()
+#define rs485RxDone()
+
+#endif  /* RS485_DE */
+
+#endif  /*  __rs485_h_included__  */
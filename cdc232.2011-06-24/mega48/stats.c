@@ -0,0 +1,212 @@
+/* Name: stats.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    This module collects the optional run time statistics, see stats.h.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include "stats.h"
+#include "uart.h"
+
+#if defined LATENCY_STATS || defined PERF_COUNTERS
+
+void statsInit(void)
+{
+
+    TCCR1A  = 0;
+    TCCR1B  = (1<<CS11)|(1<<CS10);  /* free running, F_CPU/64 */
+    latClear();
+    perfClear();
+}
+
+#endif
+
+#ifdef LATENCY_STATS
+
+vendorLatency_t     latStats;
+
+typedef struct latQueue {
+    uchar   head, sent, tail;   /* head..sent: in an IN packet, sent..tail: buffered */
+    uchar   index[LAT_QUEUE];
+    unsigned short  stamp[LAT_QUEUE];
+} latQueue_t;
+
+static latQueue_t   rxq, txq;
+
+
+void latClear(void)
+{
+
+    memset(&latStats, 0, sizeof(latStats));
+    latStats.tickShift  = STATS_TICK_SHIFT;
+    latStats.cpuKHz     = F_CPU/1000;
+}
+
+static void latRecord(unsigned short *hist, unsigned short stamp)
+{
+unsigned short  t;
+uchar           n;
+
+    t   = TCNT1 - stamp;
+    for( n=0; t && n<VENDOR_LAT_BUCKETS-1; n++ )
+        t   >>= 1;
+    if( hist[n]!=0xffff )
+        hist[n]++;
+}
+
+static void latPush(latQueue_t *q, uchar index)
+{
+uchar   next;
+
+    next    = (q->tail+1) & (LAT_QUEUE-1);
+    if( next!=q->head ) {
+        q->index[q->tail]   = index;
+        q->stamp[q->tail]   = TCNT1;
+        q->tail = next;
+    }
+}
+
+/*  A byte was stored in rx_buf[index].  */
+void latRxStamp(uchar index)
+{
+    latPush(&rxq, index);
+}
+
+/*  rx_buf[index..index+len-1] was handed to usbSetInterrupt().  */
+void latRxSend(uchar index, uchar len)
+{
+
+    while( rxq.sent!=rxq.tail && ((rxq.index[rxq.sent]-index)&RX_MASK)<len )
+        rxq.sent    = (rxq.sent+1) & (LAT_QUEUE-1);
+}
+
+/*  The interrupt endpoint is free again: the last IN packet was taken.  */
+void latRxDone(void)
+{
+
+    while( rxq.head!=rxq.sent ) {
+        latRecord(latStats.rx, rxq.stamp[rxq.head]);
+        rxq.head    = (rxq.head+1) & (LAT_QUEUE-1);
+    }
+}
+
+/*  A byte from an OUT packet was stored in tx_buf[index].  */
+void latTxStamp(uchar index)
+{
+    latPush(&txq, index);
+}
+
+/*  tx_buf[index] was written to UDR0.  */
+void latTxDone(uchar index)
+{
+
+    if( txq.head!=txq.tail && txq.index[txq.head]==index ) {
+        latRecord(latStats.tx, txq.stamp[txq.head]);
+        txq.head    = (txq.head+1) & (LAT_QUEUE-1);
+    }
+}
+
+#endif  /* LATENCY_STATS */
+
+#ifdef PERF_COUNTERS
+
+#define PERF_WINDOW     (F_CPU/64/8)    /* 1/8 s in ticks */
+
+vendorPerf_t        perfStats;
+
+static unsigned short   loopStart, usbDone, windowStart, disabledSince;
+static unsigned long    loops;
+static uchar            disabledOn;
+
+
+void perfClear(void)
+{
+
+    memset(&perfStats, 0, sizeof(perfStats));
+    perfStats.tickShift = STATS_TICK_SHIFT;
+    perfStats.cpuKHz    = F_CPU/1000;
+}
+
+void perfLoopBegin(void)
+{
+
+    loopStart   = TCNT1;
+    loops++;
+    if( disabledOn ) {      /* in steps shorter than a Timer1 period */
+        perfStats.disabledTicks += (unsigned short)(loopStart-disabledSince);
+        disabledSince   = loopStart;
+    }
+    if( (unsigned short)(loopStart-windowStart)>=PERF_WINDOW ) {
+        perfStats.loopsPerSec   = loops<<3;
+        loops       = 0;
+        windowStart = loopStart;
+    }
+}
+
+void perfUsbPollDone(void)
+{
+unsigned short  t;
+
+    usbDone = TCNT1;
+    t   = usbDone - loopStart;
+    if( t>perfStats.maxUsbPoll )
+        perfStats.maxUsbPoll    = t;
+}
+
+void perfUartPollDone(void)
+{
+unsigned short  now, t;
+
+    now = TCNT1;
+    t   = now - usbDone;
+    if( t>perfStats.maxUartPoll )
+        perfStats.maxUartPoll   = t;
+    t   = now - loopStart;
+    if( t>perfStats.maxLoop )
+        perfStats.maxLoop   = t;
+}
+
+/*  Counts the edges only, the OUT endpoint may be held off again while it
+    is. The main loop adds the time up every iteration, which the 1 ms tick
+    keeps far below the 350 ms (at 12 MHz) Timer1 takes to wrap, so that
+    the 32 bit sum holds any length.  */
+void perfRequestsDisabled(void)
+{
+
+    if( disabledOn )
+        return;
+    disabledOn  = 1;
+    disabledSince   = TCNT1;
+    perfStats.disabledCount++;
+}
+
+void perfRequestsEnabled(void)
+{
+
+    if( !disabledOn )
+        return;
+    disabledOn  = 0;
+    perfStats.disabledTicks += (unsigned short)(TCNT1-disabledSince);
+}
+
+/*  A received byte was dropped, state holds its UART_STATE_* error bits.  */
+void perfRxErrors(uchar state)
+{
+
+    if( state&UART_STATE_FRAMING )
+        perfStats.rxFraming++;
+    if( state&UART_STATE_PARITY )
+        perfStats.rxParity++;
+    if( state&UART_STATE_OVERRUN )
+        perfStats.rxOverrun++;
+    if( state&UART_STATE_BREAK )
+        perfStats.rxBreak++;
+}
+
+#endif  /* PERF_COUNTERS */
@@ -0,0 +1,110 @@
+/* Name: stats.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __stats_h_included__
+#define __stats_h_included__
+
+/*
+General Description:
+    Optional run time statistics of the ATmega firmware, read by vendor
+    requests (see vendor.h). Each feature is enabled by a -D option in the
+    Makefile. The hooks compile to nothing when the feature is disabled.
+    Both features let Timer1 run free at F_CPU/64.
+
+    LATENCY_STATS
+    A byte is stamped when uartPoll() stores it in rx_buf (or
+    usbFunctionWriteOut() in tx_buf), and its latency is added to a log2
+    histogram when the IN packet carrying it was taken by the host (or when
+    it is written to UDR0). Up to LAT_QUEUE-1 bytes per direction are in
+    flight at a time; further bytes are not stamped. At low rates every
+    byte is measured, at high rates a sample.
+    Needs 1KB SRAM (ATmega8/88/168/328p).
+
+    PERF_COUNTERS
+    Main loop rate and worst case iteration times, peak buffer occupancy,
+    packet counts, dropped bytes per cause and the time the OUT endpoint
+    was held off by usbDisableAllRequests().
+*/
+
+#include "vendor.h"
+
+#ifndef uchar
+#define uchar   unsigned char
+#endif
+
+#define STATS_TICK_SHIFT    6           /* Timer1 prescaler 64 */
+
+#if defined LATENCY_STATS || defined PERF_COUNTERS
+extern void statsInit(void);
+#else
+#define statsInit()
+#endif
+
+#ifdef LATENCY_STATS
+
+#if RAMEND < 0x400
+#   error "LATENCY_STATS needs 1KB SRAM"
+#endif
+
+#define LAT_QUEUE           8           /* stamps per direction (2^n) */
+
+extern vendorLatency_t  latStats;
+
+extern void latClear(void);
+extern void latRxStamp(uchar index);
+extern void latRxSend(uchar index, uchar len);
+extern void latRxDone(void);
+extern void latTxStamp(uchar index);
+extern void latTxDone(uchar index);
+
+#else
+
+#define latClear()
+#define latRxStamp(index)
+#define latRxSend(index, len)
+#define latRxDone()
+#define latTxStamp(index)
+#define latTxDone(index)
+
+#endif  /* LATENCY_STATS */
+
+#ifdef PERF_COUNTERS
+
+extern vendorPerf_t     perfStats;
+
+extern void perfClear(void);
+extern void perfLoopBegin(void);
+extern void perfUsbPollDone(void);
+extern void perfUartPollDone(void);
+extern void perfRequestsDisabled(void);
+extern void perfRequestsEnabled(void);
+extern void perfRxErrors(uchar state);
+
+#define perfRxLevel(n)      do{ if( (n)>perfStats.rxPeak ) perfStats.rxPeak = (n); }while(0)
+#define perfTxLevel(n)      do{ if( (n)>perfStats.txPeak ) perfStats.txPeak = (n); }while(0)
+#define perfInPacket()      perfStats.inPackets++
+#define perfOutPacket()     perfStats.outPackets++
+#define perfTxDropped()     perfStats.txDropped++
+
+#else
+
+#define perfClear()
+#define perfLoopBegin()
+#define perfUsbPollDone()
+#define perfUartPollDone()
+#define perfRequestsDisabled()
+#define perfRequestsEnabled()
+#define perfRxErrors(state)
+#define perfRxLevel(n)
+#define perfTxLevel(n)
+#define perfInPacket()
+#define perfOutPacket()
+#define perfTxDropped()
+
+#endif  /* PERF_COUNTERS */
+
+#endif  /*  __stats_h_included__  */
@@ -0,0 +1,385 @@
+/* Name: sw-uart.c
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+/*
+General Description:
+    Software UART of the multi-channel mode (mux.h) on Timer1, which runs
+    free at F_CPU/64 as for the statistics (stats.c).
+
+    TXD is OC1A (PB1). Every level change of a frame is a compare match
+    that sets or clears the pin, so the bit times do not depend on the
+    interrupt latency; the interrupt only has to program the next change
+    within a bit time. RXD is ICP1 (PB0). The input capture stamps every
+    edge and the bits are decoded from the stamps, compare B ends a frame
+    in the middle of its stop bit. Both need the interrupt within half a
+    bit time; the USB interrupt delays the others by up to about 100us,
+    which limits the rate to 4800 bps.
+
+    The Timer1 interrupts enable interrupts at once (ISR_NOBLOCK), so they
+    do not delay the USB interrupt and may interrupt each other. 16 bit
+    registers share the TEMP register and are only accessed with
+    interrupts disabled; PERF_COUNTERS and LATENCY_STATS read TCNT1 without
+    that and may see a wrong high byte now and then. The receiver takes
+    the edges and timeouts from a queue, one at a time.
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "uart.h"
+#include "mux.h"
+
+#ifdef MUX_CHANNELS
+
+#ifdef URSEL
+#   error "MUX_CHANNELS needs an ATmega48/88/168/328p"
+#endif
+#ifdef UART_INVERT
+#   error "UART_INVERT uses PB0 and PB1, the pins of the software UART"
+#endif
+
+#define SW_TCCR1B       ((1<<ICNC1)|(1<<CS11)|(1<<CS10))    /* F_CPU/64 */
+#define SW_MIN_BPS      300
+#define SW_MAX_BPS      4800
+#define SW_DEFAULT_BPS  2400
+#define EDGE_QUEUE      4       /* 2^n */
+
+uchar           swRxBuf[SW_RX_SIZE], swTxBuf[SW_TX_SIZE];
+uchar           swRxR, swTxW;
+volatile uchar  swRxW, swTxR;
+
+/*  line coding: bit time in Timer1 ticks, frame length with start bit and
+    stop bits (the receiver checks the first one), and the coding waiting
+    for the transmitter to drain  */
+static unsigned short   bitTicks;
+static uchar            dataBits, parity, frameBits, rxBits;
+static unsigned short   newTicks;
+static uchar            newData, newParity, newStop, txMark;
+static volatile uchar   codingPending;
+
+/*  transmitter: bits from the one started at the last match on  */
+static unsigned short   txFrame, txAt;
+static uchar            txLeft;
+static volatile uchar   txBusy;
+
+/*  receiver  */
+static unsigned short   edgeAt[EDGE_QUEUE];
+static uchar            edgeLevel[EDGE_QUEUE];
+static volatile uchar   edgeW, rxTimeout, rxLock;
+static uchar            edgeR, rxBusy, rxBit, rxLevel;
+static unsigned short   rxData, rxMid, rxEnd;   /* rxMid: middle of bit rxBit */
+
+
+static void applyCoding(void)
+{
+
+    cli();
+    bitTicks    = newTicks;
+    sei();
+    dataBits    = newData;
+    parity      = newParity;
+    rxBits      = 1 + dataBits + (parity? 1:0) + 1;
+    frameBits   = rxBits - 1 + newStop;
+    codingPending   = 0;
+}
+
+/*  1 for an odd number of ones  */
+static uchar parityOf(unsigned short v)
+{
+uchar   p = 0;
+
+    for( ; v; v>>=1 )
+        p   ^= v & 1;
+    return p;
+}
+
+/*  A line coding as sent with SET_LINE_CODING. It applies to the data that
+    is put after it.  */
+void swuartSetCoding(uchar *data)
+{
+usbDWord_t  br;
+
+    br.bytes[0] = data[0];
+    br.bytes[1] = data[1];
+    br.bytes[2] = data[2];
+    br.bytes[3] = data[3];
+    if( br.dword<SW_MIN_BPS )
+        br.dword    = SW_MIN_BPS;
+    if( br.dword>SW_MAX_BPS )
+        br.dword    = SW_MAX_BPS;
+
+    newTicks    = ((F_CPU>>6)+(br.dword>>1)) / br.dword;
+    newStop     = data[4]? 2:1;     /* 1.5 is sent as 2 */
+    newParity   = data[5]<=2? data[5] : 0;
+    newData     = data[6]>=5 && data[6]<=8? data[6] : 8;
+    txMark      = swTxW;
+    codingPending   = 1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- transmitter ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/*  Takes the next byte of swTxBuf into txFrame, LSB first with start bit,
+    parity and stop bits. Returns 0 if there is none or it waits for a new
+    coding.  */
+static uchar txLoad(void)
+{
+uchar           r = swTxR, c, i;
+unsigned short  f;
+
+    if( r==swTxW || (codingPending && r==txMark) )
+        return 0;
+    c   = swTxBuf[r] & (uchar)((1<<dataBits)-1);
+    f   = (unsigned short)c << 1;
+    i   = dataBits + 1;
+    if( parity )    /* 1 odd, 2 even */
+        f   |= (unsigned short)(parityOf(c) ^ (parity==1)) << i++;
+    f   |= 3u << i;
+    txFrame = f;
+    txLeft  = frameBits;
+    swTxR   = (r+1) & SW_TX_MASK;
+    EVENT_FLAGS |= (1<<EVENT_SWUART);   /* room for more credit */
+    return 1;
+}
+
+/*  Starts txFrame with its start bit 2 ticks from now.  */
+static void txStart(void)
+{
+unsigned short  t;
+
+    cli();
+    t   = TCNT1 + 2;
+    OCR1A   = t;
+    TCCR1A  = (1<<COM1A1);              /* clear on match */
+    TIFR1   = (1<<OCF1A);
+    sei();
+    txAt    = t;
+    cli();
+    TIMSK1  |= (1<<OCIE1A);
+    sei();
+}
+
+static void txKick(void)
+{
+
+    if( !txBusy && txLoad() ) {
+        txBusy  = 1;
+        txStart();
+    }
+}
+
+ISR( TIMER1_COMPA_vect, ISR_NOBLOCK )
+{
+uchar   n, level;
+
+    if( txLeft==0 ) {       /* stop bit done, nothing was queued */
+        if( txLoad() ) {
+            txStart();
+            return;
+        }
+        cli();
+        TIMSK1  &= ~(1<<OCIE1A);
+        sei();
+        txBusy  = 0;
+        EVENT_FLAGS |= (1<<EVENT_SWUART);   /* drained */
+        return;
+    }
+
+    /*  the pin has the level of bit 0 now, the next match is where it
+        changes or where the frame ends  */
+    level   = txFrame & 1;
+    for( n=1; n<txLeft && ((txFrame>>n) & 1)==level; n++ )
+        ;
+    txFrame >>= n;
+    txLeft  -= n;
+    txAt    += n * bitTicks;
+    if( txLeft==0 )
+        txLoad();           /* its start bit follows the stop bit */
+    TCCR1A  = txLeft==0 || (txFrame & 1)? (1<<COM1A1)|(1<<COM1A0) : (1<<COM1A1);
+    cli();
+    OCR1A   = txAt;
+    sei();
+}
+
+uchar swuartPut(uchar c)
+{
+uchar   next;
+
+    next    = (swTxW+1) & SW_TX_MASK;
+    if( next==swTxR )
+        return 0;
+    swTxBuf[swTxW]  = c;
+    swTxW   = next;
+    txKick();
+    return 1;
+}
+
+/*  Applies a new coding once the data before it is sent.  */
+void swuartPoll(void)
+{
+
+    if( codingPending && !txBusy && swTxR==txMark ) {
+        applyCoding();
+        txKick();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- receiver -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void rxDone(void)
+{
+uchar   c, w, next;
+
+    rxBusy  = 0;
+    cli();
+    TIMSK1  &= ~(1<<OCIE1B);
+    sei();
+    if( (rxData & 1) || !(rxData & (1u<<(rxBits-1))) )
+        return;             /* no start bit (glitch) or no stop bit */
+    if( parity && parityOf((rxData>>1) & ((2u<<dataBits)-1))!=(parity==1) )
+        return;
+    c   = (rxData >> 1) & (uchar)((1<<dataBits)-1);
+    w   = swRxW;
+    next    = (w+1) & SW_RX_MASK;
+    if( next!=swRxR ) {
+        swRxBuf[w]  = c;
+        swRxW   = next;
+    }
+    EVENT_FLAGS |= (1<<EVENT_SWUART);
+}
+
+static void rxEdge(unsigned short t, uchar level)
+{
+unsigned short  end;
+
+    if( rxBusy ) {
+        /*  the bits whose middle is before the edge have the old level  */
+        while( rxBit<rxBits && (short)(t-rxMid) > 0 ) {
+            if( rxLevel )
+                rxData  |= 1u << rxBit;
+            rxBit++;
+            rxMid   += bitTicks;
+        }
+        rxLevel = level;
+        if( rxBit<rxBits )
+            return;
+        rxDone();
+    }
+    if( level )
+        return;
+    /*  start bit  */
+    rxBusy  = 1;
+    rxBit   = 0;
+    rxData  = 0;
+    rxLevel = 0;
+    rxMid   = t + (bitTicks>>1);
+    end = rxMid + (rxBits-1) * bitTicks;
+    rxEnd   = end;
+    cli();
+    OCR1B   = end;
+    TIFR1   = (1<<OCF1B);
+    sei();
+    cli();
+    TIMSK1  |= (1<<OCIE1B);
+    sei();
+}
+
+/*  Compare B: the middle of the stop bit. Edges queued before may belong
+    to a later frame already, the timeout is then for that one's end.  */
+static void rxTimeoutRun(void)
+{
+unsigned short  now;
+
+    if( !rxBusy )
+        return;
+    cli();
+    now = TCNT1;
+    sei();
+    if( (short)(now-rxEnd) < 0 )
+        return;
+    for( ; rxBit<rxBits; rxBit++ ) {
+        if( rxLevel )
+            rxData  |= 1u << rxBit;
+    }
+    rxDone();
+}
+
+/*  Runs the queued edges and the timeout. A call from an interrupt that
+    came while another one runs the queue returns at once; the running
+    one sees what was queued before it gives up the lock.  */
+static void rxRun(void)
+{
+
+    if( rxLock )
+        return;
+    do {
+        rxLock  = 1;
+        while( edgeR!=edgeW ) {
+            rxEdge(edgeAt[edgeR], edgeLevel[edgeR]);
+            edgeR   = (edgeR+1) & (EDGE_QUEUE-1);
+        }
+        if( rxTimeout ) {
+            rxTimeout   = 0;
+            rxTimeoutRun();
+        }
+        rxLock  = 0;
+    } while( edgeR!=edgeW || rxTimeout );
+}
+
+ISR( TIMER1_CAPT_vect, ISR_NOBLOCK )
+{
+uchar   w = edgeW;
+
+    cli();
+    edgeAt[w]   = ICR1;
+    sei();
+    edgeLevel[w]    = (TCCR1B >> ICES1) & 1;    /* a rising edge leaves the line high */
+    TCCR1B  = (PINB & (1<<PB0))? SW_TCCR1B : SW_TCCR1B|(1<<ICES1);
+    TIFR1   = (1<<ICF1);
+    edgeW   = (w+1) & (EDGE_QUEUE-1);
+    rxRun();
+}
+
+ISR( TIMER1_COMPB_vect, ISR_NOBLOCK )
+{
+    rxTimeout   = 1;
+    rxRun();
+}
+
+/* ------------------------------------------------------------------------- */
+
+void swuartInit(void)
+{
+uchar   coding[7] = {SW_DEFAULT_BPS & 0xff, SW_DEFAULT_BPS >> 8, 0, 0, 0, 0, 8};
+
+    swRxR   = swRxW = 0;
+    swTxR   = swTxW = 0;
+    edgeR   = edgeW = 0;
+    rxBusy  = rxLock = rxTimeout = 0;
+    txBusy  = txLeft = 0;
+    swuartSetCoding(coding);
+    applyCoding();
+
+    PORTB   |= (1<<PB0);                /* pull-up on RXD */
+    TCCR1A  = (1<<COM1A1)|(1<<COM1A0);  /* set on match */
+    TCCR1C  = (1<<FOC1A);               /* TXD idles high */
+    DDRB    |= (1<<PB1);
+    TCCR1B  = SW_TCCR1B;                /* falling edge: start bit */
+    TIFR1   = (1<<ICF1)|(1<<OCF1A)|(1<<OCF1B);
+    TIMSK1  = (1<<ICIE1);
+}
+
+void swuartOff(void)
+{
+
+    TIMSK1  = 0;
+    DDRB    &= ~(1<<PB1);
+    TCCR1A  = 0;
+}
+
+#endif  /* MUX_CHANNELS */
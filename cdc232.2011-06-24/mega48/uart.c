@@ -19,6 +19,15 @@ General Description:
 #include "oddebug.h"
 #include "usbdrv.h"
 #include "uart.h"
+#include "stats.h"
+#include "bench.h"
+#include "mux.h"
+#include "ep0.h"
+#include "comp.h"
+#include "capture.h"
+#include "autobaud.h"
+#include "rs485.h"
+#include "mpcm.h"
 
 extern uchar    sendEmptyFrame;
 
@@ -26,29 +35,107 @@ extern uchar    sendEmptyFrame;
 uchar    urptr, uwptr, irptr, iwptr;
 uchar    rx_buf[RX_SIZE+HW_CDC_BULK_IN_SIZE], tx_buf[TX_SIZE];
 
+static uchar    txHold, txMark, txBusy;
+static uchar    rxErrors;       /* UART_STATE_* error bits not yet reported */
+#if defined MPCM_MODE || defined BENCH_MODES
+uchar           uartUcsrb;      /* UART_UCSRB_NOW */
+#endif
 
-void uartInit(ulong baudrate, uchar parity, uchar stopbits, uchar databits)
+#ifdef ALT_PROFILES
+static const uartProfile_t  profiles[ALT_PROFILE_COUNT] PROGMEM = {
+    { RX_MASK,      TX_MASK,    0 },    /* ALT_PROFILE_DEFAULT */
+    { 16,           32,         0 },    /* ALT_PROFILE_LATENCY */
+    { RX_SIZE-16,   TX_MASK,    4 },    /* ALT_PROFILE_THROUGHPUT */
+};
+
+uartProfile_t   uartProfile;
+static uchar    rxAge;          /* ticks since the last IN packet, while rx_buf has data */
+
+void uartSetProfile(uchar n)
+{
+    memcpy_P(&uartProfile, &profiles[n], sizeof(uartProfile));
+}
+
+void uartTick(void)
+{
+    if( iwptr!=urptr && rxAge!=0xff )
+        rxAge++;
+}
+#endif
+
+/*
+	Returns nonzero if rx_buf has an IN packet to send. With ALT_PROFILES a
+	short packet waits up to uartProfile.coalesce ticks for more bytes.
+*/
+static inline uchar rxPacketDue(void)
+{
+    if( sendEmptyFrame )
+        return 1;
+    if( iwptr==urptr )
+        return 0;
+#ifdef ALT_PROFILES
+    if( ((iwptr-urptr) & RX_MASK)<HW_CDC_BULK_IN_SIZE && rxAge<uartProfile.coalesce )
+        return 0;
+#endif
+    return 1;
+}
+
+
+void uartConfigure(ulong baudrate, uchar parity, uchar stopbits, uchar databits)
 {
 usbDWord_t   br;
 
     br.dword = ((F_CPU>>3)+(baudrate>>1)) / baudrate - 1;
 	UCSR0A  |= (1<<U2X0);
+#if DEBUG_LEVEL < 1 || defined DEBUG_TRACE
+    UCSR0B  = 0;            /* off before mpcmApply() sets MPCM0 */
+#endif
+    if( mpcmApply() )
+        databits    = 9;
 
-#if DEBUG_LEVEL < 1
+#if DEBUG_LEVEL < 1 || defined DEBUG_TRACE
     /*    USART configuration    */
-    UCSR0B  = 0;
-    UCSR0C  = URSEL_MASK | ((parity==1? 3:parity)<<UPM00) | ((stopbits>>1)<<USBS0) | ((databits-5)<<UCSZ00);
+    UCSR0C  = URSEL_MASK | ((parity==1? 3:parity)<<UPM00) | ((stopbits>>1)<<USBS0) | ((databits>8? 3 : databits-5)<<UCSZ00);
     UBRR0L  = br.bytes[0];
     UBRR0H  = br.bytes[1];
-#else
-    DBG1(0xf0, br.bytes, 2);
 #endif /* DEBUG_LEVEL */
+    DBG1(0xf0, br.bytes, 2);
+
+    rs485Reset(databits);
+#if defined MPCM_MODE || defined BENCH_MODES
+    uartUcsrb   = UART_UCSRB | (databits>8? (1<<UCSZ02) : 0);
+    if( benchRxOff() )
+        uartUcsrb   &= ~(1<<RXEN0);
+#endif
+    UCSR0B  = UART_UCSRB_NOW;
+    capSetFrame((br.dword+1) * (databits + (parity? 3:2) + (stopbits>>1)));
+
+    txHold  = 0;
+    txBusy  = 0;
+}
+
+void uartInit(ulong baudrate, uchar parity, uchar stopbits, uchar databits)
+{
 
-    UCSR0B  = (1<<RXEN0) | (1<<TXEN0);
+    uartConfigure(baudrate, parity, stopbits, databits);
 
 	UART_CTRL_DDR	= (1<<UART_CTRL_DTR) | (1<<UART_CTRL_RTS);
 	UART_CTRL_PORT	= 0xff;
 
+	UART_STAT_PORT	|= 0
+#ifdef UART_STAT_DCD
+		| (1<<UART_STAT_DCD)
+#endif
+#ifdef UART_STAT_DSR
+		| (1<<UART_STAT_DSR)
+#endif
+#ifdef UART_STAT_RI
+		| (1<<UART_STAT_RI)
+#endif
+		;
+
+	rs485Init();
+
 #ifdef UART_INVERT
 	DDRB	|= (1<<PB1)|(1<<PB0);
 	PCMSK1	|= (1<<PCINT9)|(1<<PCINT8);
@@ -56,42 +143,151 @@ usbDWord_t   br;
 #endif
 }
 
+/*
+	Stops the transmitter at mark in tx_buf. Data queued after this point
+	is held back until uartConfigure() applies a new coding.
+*/
+void uartHoldTx(uchar mark)
+{
+    txMark  = mark;
+    txHold  = 1;
+}
+
+/*
+	Returns nonzero when all data before the hold mark has left the shift
+	register. TXC0 is cleared on every write to UDR0. With RS485_DE the
+	interrupt takes TXC0, and DE is released after the hold time.
+*/
+uchar uartTxDrained(void)
+{
+#ifdef RS485_DE
+    return irptr==txMark && !rs485Sending;
+#else
+    return irptr==txMark && (!txBusy || (UCSR0A&(1<<TXC0)));
+#endif
+}
+
 void uartPoll(void)
 {
 	uchar		next;
 
 	/*  device => RS-232C  */
 	while( (UCSR0A&(1<<UDRE0)) && uwptr!=irptr && (UART_CTRL_PIN&(1<<UART_CTRL_CTS)) ) {
-        UDR0    = tx_buf[irptr];
-        irptr   = (irptr+1) & TX_MASK;
+        if( txHold && irptr==txMark )
+            break;
+        if( mpcmActive && mpcmTx(tx_buf[irptr]) ) {   /* escape, no frame */
+            latTxDone(irptr);
+            irptr   = (irptr+1) & TX_MASK;
+        }
+        else {
+            uchar   c   = tx_buf[irptr];
+#ifdef MPCM_MODE
+            uchar   ucsrb   = mpcmTxFrame();    /* TXB80 of an address */
 
-        if( usbAllRequestsAreDisabled() && uartTxBytesFree()>HW_CDC_BULK_OUT_SIZE ) {
+            next    = (UCSR0A&((1<<U2X0) | (1<<MPCM0))) | (1<<TXC0);
+#else
+            next    = (UCSR0A&(1<<U2X0)) | (1<<TXC0);
+#endif
+            if( !rs485Send() )
+                break;
+            /*  TXC0 is cleared after the write, a byte that ended just before
+                it would leave TXC0 set; the new one cannot end that soon  */
+            cli();
+            if( !rs485Begin() ) {               /* DE before the start bit */
+                sei();
+                continue;
+            }
+#ifdef MPCM_MODE
+            UCSR0B  = (UCSR0B&(1<<RXCIE0)) | ucsrb;
+#endif
+            UDR0    = c;
+            UCSR0A  = next;
+            sei();
+            rs485Sent(c);
+            mpcmTxSent();
+            latTxDone(irptr);
+            irptr   = (irptr+1) & TX_MASK;
+            txBusy  = 1;
+        }
+
+        if( usbAllRequestsAreDisabled() && !codingsFull && !compOutPending && uartTxBytesFree()>UART_TX_STOP ) {
             usbEnableAllRequests();
+            perfRequestsEnabled();
+            DBG2(0x31, 0, 0);
         }
     }
 
 	/*  device <= RS-232C  */
-	while( UCSR0A&(1<<RXC0) ) {
+	while( !capActive && !autobaudActive && mpcmRxReady() ) {
 	    next = (iwptr+1) & RX_MASK;
-		if( next!=urptr ) {
+		if( next!=urptr && mpcmRoom() ) {
 	        uchar   status, data;
 
+	        rs485RxStart();                     /* until rs485Echo() is done */
+#ifdef MPCM_MODE
+	        data    = mpcmRxFrame(&status);    /* RXB80 before UDR0 */
+#else
 	        status  = UCSR0A;
 	        data    = UDR0;
+#endif
 	        status  &= (1<<FE0) | (1<<DOR0) | (1<<UPE0);
-	        if(status == 0) { /* no receiver error occurred */
+	        if(status != 0) {
+	            uchar   err = 0;
+
+	            if( status&(1<<DOR0) )  /* bytes before this one were lost */
+	                err |= UART_STATE_OVERRUN;
+	            if( status&(1<<UPE0) )
+	                err |= UART_STATE_PARITY;
+	            if( status&(1<<FE0) )
+	                err |= data? UART_STATE_FRAMING : UART_STATE_BREAK;
+	            rxErrors |= err;
+	            perfRxErrors(err);
+	        }
+	        if((status & ~(1<<DOR0)) == 0 && !rs485Echo(data) && mpcmRx(data)) { /* no error, not our echo, for us */
 	            rx_buf[iwptr] = data;
-	            iwptr = next;
+	            latRxStamp(iwptr);
+	            iwptr = (iwptr+1) & RX_MASK;    /* mpcmRx() may have put an escape */
+	            perfRxLevel((iwptr-urptr) & RX_MASK);
+#ifdef ALT_PROFILES
+	            if( ((iwptr-urptr) & RX_MASK)>=uartProfile.rxLimit )
+	                UART_CTRL_PORT	&= ~(1<<UART_CTRL_RTS);
+#endif
 	        }
+	        rs485RxDone();
 		}
 		else {
 			UART_CTRL_PORT	&= ~(1<<UART_CTRL_RTS);
 			break;
 		}
     }
+    if( capActive )
+        capPoll();      /* records with time and errors instead */
+    if( autobaudActive )
+        autobaudPoll(); /* edges on RXD, the bytes are dropped */
+    rs485Poll();
+    mpcmRxWait();       /* MPCM0 set, the interrupt reads the addresses */
+
+#ifdef BENCH_MODES
+    if( benchMode==BENCH_PRBS_UART )
+        benchUartRx();
+#endif
 
 	/*  USB <= device  */
-    if( usbInterruptIsReady() && (iwptr!=urptr || sendEmptyFrame) ) {
+#ifdef LATENCY_STATS
+    if( usbInterruptIsReady() )
+        latRxDone();    /* the previous packet was taken by an IN token */
+#endif
+    if( muxActive ) {
+        muxPoll();
+        return;
+    }
+    if( ep0Active )     /* rx_buf goes on control transfers */
+        return;
+    if( compActive ) {
+        compPoll(usbInterruptIsReady() && (rxPacketDue() || compSync));
+        return;
+    }
+    if( usbInterruptIsReady() && rxPacketDue() ) {
         uchar   bytesRead, i;
 
         bytesRead = (iwptr-urptr) & RX_MASK;
@@ -104,8 +300,16 @@ void uartPoll(void)
 				rx_buf[RX_SIZE+i]	= rx_buf[i];
 		}
         usbSetInterrupt(rx_buf+urptr, bytesRead);
+        latRxSend(urptr, bytesRead);
+        perfInPacket();
+        benchInPacket(bytesRead);
         urptr   = next;
-		if( bytesRead )
+#ifdef ALT_PROFILES
+        rxAge   = 0;
+		if( bytesRead && !capActive && ((iwptr-urptr) & RX_MASK)<uartProfile.rxLimit )
+#else
+		if( bytesRead && !capActive )
+#endif
 			UART_CTRL_PORT	|= (1<<UART_CTRL_RTS);
 
         /* send an empty block after last data block to indicate transfer end */
@@ -113,6 +317,117 @@ void uartPoll(void)
     }
 }
 
+#ifdef EVENT_FLAGS
+/*
+	Called by the main loop before it sleeps. Returns 0 if uartPoll() has
+	a packet for the interrupt-in endpoint or OUT data to decode into
+	tx_buf (COMP_MODE), otherwise arms the USART interrupts that wake the
+	main loop: a received byte, and UDRE0 while there is data to send.
+	Waiting for CTS or TXC0 is left to the tick.
+*/
+uchar uartIdle(void)
+{
+	uchar		ctrl;
+
+	if( usbInterruptIsReady() && !ep0Active && (muxActive? muxPending() : rxPacketDue()) )
+		return 0;
+	if( compOutPending && uartTxBytesFree() )
+		return 0;
+	ctrl	= UART_UCSRB_NOW | (1<<RXCIE0);
+	if( uwptr!=irptr && !(txHold && irptr==txMark) && (UART_CTRL_PIN&(1<<UART_CTRL_CTS)) )
+		ctrl	|= (1<<UDRIE0);
+	UCSR0B	= ctrl;
+	return 1;
+}
+
+/*
+	Only wakes the main loop. RXC0 and UDRE0 are levels, so the interrupt
+	turns itself off, which also tells idleSleep() in main.c that it came.
+	18 cycles from the interrupt response. With MPCM_MODE it goes on to
+	mpcmIrq() while MPCM0 is set (mpcm.c), with CAPTURE_MODE to capIrq()
+	while the capture mode is on (capture.c); sbrc leaves SREG alone.
+*/
+ISR( USART_RX_vect, ISR_NAKED )
+{
+#ifdef __AVR__
+	asm volatile(
+		"push	r16"    	"\n\t"
+#if defined MPCM_MODE || defined BENCH_MODES
+		"lds	r16, uartUcsrb"	"\n\t"
+#else
+		"ldi	r16, %0"    	"\n\t"
+#endif
+		"sts	%1, r16"    	"\n\t"
+#ifdef MPCM_MODE
+		"lds	r16, mpcmWait"	"\n\t"
+		"sbrc	r16, 0"    	"\n\t"
+		"rjmp	1f"    	"\n\t"
+#endif
+#ifdef CAPTURE_MODE
+		"lds	r16, capActive"	"\n\t"
+		"sbrc	r16, 0"    	"\n\t"
+		"rjmp	2f"    	"\n\t"
+#endif
+		"pop	r16"    	"\n\t"
+#if defined MPCM_MODE || defined CAPTURE_MODE
+		"reti"    		"\n"
+#endif
+#ifdef MPCM_MODE
+	"1:"    			"\n\t"
+		"pop	r16"    	"\n\t"
+		"%~jmp	mpcmIrq"	"\n\t"
+#endif
+#ifdef CAPTURE_MODE
+	"2:"    			"\n\t"
+		"pop	r16"    	"\n\t"
+		"%~jmp	capIrq"	"\n\t"
+#endif
+         :
+         : "M" (UART_UCSRB),
+           "n" (_SFR_MEM_ADDR(UCSR0B))
+        );
+#else   /* host build (host/model) */
+	UCSR0B	= UART_UCSRB_NOW;
+#ifdef MPCM_MODE
+	if( mpcmWait )
+		mpcmIrq();
+#endif
+#ifdef CAPTURE_MODE
+	if( capActive )
+		capIrq();
+#endif
+#endif
+	reti();
+}
+
+ISR( USART_UDRE_vect, ISR_ALIASOF(USART_RX_vect) );
+#endif	/* EVENT_FLAGS */
+
+/*
+	Returns the SERIAL_STATE bitmap: the modem status inputs and the
+	receiver errors since the previous call.
+*/
+uchar uartLineState(void)
+{
+	uchar		state;
+
+	state	= rxErrors;
+	rxErrors	= 0;
+#ifdef UART_STAT_DCD
+	if( UART_STAT_PIN&(1<<UART_STAT_DCD) )
+#endif
+		state	|= UART_STATE_DCD;
+#ifdef UART_STAT_DSR
+	if( UART_STAT_PIN&(1<<UART_STAT_DSR) )
+#endif
+		state	|= UART_STATE_DSR;
+#ifdef UART_STAT_RI
+	if( UART_STAT_PIN&(1<<UART_STAT_RI) )
+		state	|= UART_STATE_RI;
+#endif
+	return state;
+}
+
 
 #ifdef UART_INVERT
 /*
@@ -135,7 +450,7 @@ ISR( PCINT1_vect, ISR_NAKED )
 		"out	__SREG__, r16"	"\n\t"
 		"in		r16, %0"    	"\n\t"
          :
-         : "I" (_SFR_IO_ADDR(GPIOR0)),
+         : "I" (_SFR_IO_ADDR(GPIOR2)),    /* GPIOR0 holds EVENT_FLAGS */
            "I" (_SFR_IO_ADDR(GPIOR1)),
            "I" (_SFR_IO_ADDR(PINC)),
            "I" (_SFR_IO_ADDR(PORTB))
@@ -47,6 +47,16 @@
 #define	UART_CTRL_DTR		3
 #define	UART_CTRL_RTS		4
 #define	UART_CTRL_CTS		5
+#define	UART_CTRL_DE		2	/* RS485_DE, high while sending */
+
+/* Modem status inputs, reported to the host by SERIAL_STATE notifications.
+   High level means asserted, as for CTS. Comment out unconnected inputs;
+   DCD and DSR then read as asserted, RI as not asserted.
+*/
+#define	UART_STAT_PORTNAME	D
+#define	UART_STAT_DCD		4
+#define	UART_STAT_DSR		5
+//#define	UART_STAT_RI		6
 
 #define	RX_SIZE		128      /* UART receive buffer size (must be 2^n, 16-128)  */
 #define	TX_SIZE		256      /* UART transmit buffer size (must be 2^n, 16-256) */
@@ -83,6 +93,68 @@
 #define UART_CTRL_PIN     UART_INPORT(UART_CTRL_PORTNAME)
 #define UART_CTRL_DDR     UART_DDRPORT(UART_CTRL_PORTNAME)
 
+#define UART_STAT_PORT    UART_OUTPORT(UART_STAT_PORTNAME)
+#define UART_STAT_PIN     UART_INPORT(UART_STAT_PORTNAME)
+
+/* SERIAL_STATE bitmap (CDC PSTN subclass, 6.5.4) */
+#define UART_STATE_DCD      0x01
+#define UART_STATE_DSR      0x02
+#define UART_STATE_BREAK    0x04
+#define UART_STATE_RI       0x08
+#define UART_STATE_FRAMING  0x10
+#define UART_STATE_PARITY   0x20
+#define UART_STATE_OVERRUN  0x40
+
+/* UCSR0B while the USART interrupts are off; the transmit complete one
+   of RS485_DE stays on */
+#ifdef RS485_DE
+#define UART_UCSRB          ((1<<RXEN0) | (1<<TXEN0) | (1<<TXCIE0))
+#else
+#define UART_UCSRB          ((1<<RXEN0) | (1<<TXEN0))
+#endif
+#if defined MPCM_MODE || defined BENCH_MODES
+#define UART_UCSRB_NOW      uartUcsrb   /* and UCSZ02 for 9 data bits, no
+                                           RXEN0 in a bench mode without RX */
+#else
+#define UART_UCSRB_NOW      UART_UCSRB
+#endif
+
+/* Main loop events, set by interrupts with sbi. The main loop sleeps until
+   an event, a USART interrupt (uartIdle()) or the USB interrupt. ATmega8
+   has no GPIOR0; its main loop polls, and usbconfig.h leaves the reset
+   check in usbPoll().
+*/
+#ifdef GPIOR0
+#define EVENT_FLAGS         GPIOR0
+#define EVENT_TICK          0       /* Timer0, every millisecond */
+#define EVENT_SWUART        1       /* software UART byte in or out (mux.h) */
+#define EVENT_CAPTURE       2       /* frame stamped for capPoll() (capture.h) */
+#define EVENT_USB           3       /* packet sent, USB_TX_HOOK (usbconfig.h) */
+#endif
+
+#ifdef ALT_PROFILES
+/* Buffering profiles, selected by the alternate setting of the data
+   interface (main.c). The IN coalescing counts Timer0 ticks.
+*/
+#ifndef EVENT_FLAGS
+#error "ALT_PROFILES needs an ATmega48/88/168/328p"
+#endif
+#define ALT_PROFILE_DEFAULT     0   /* as without ALT_PROFILES */
+#define ALT_PROFILE_LATENCY     1   /* small buffers, no coalescing */
+#define ALT_PROFILE_THROUGHPUT  2   /* full packets, early RTS */
+#define ALT_PROFILE_COUNT       3
+#endif
+
+#ifdef MUX_CHANNELS
+/* Software UART of the multi-channel mode (sw-uart.c), RXD on ICP1 (PB0),
+   TXD on OC1A (PB1), 300 to 4800 bps.
+*/
+#define	SW_RX_SIZE	32      /* must be 2^n */
+#define	SW_TX_SIZE	32      /* must be 2^n */
+#define	SW_RX_MASK	(SW_RX_SIZE-1)
+#define	SW_TX_MASK	(SW_TX_SIZE-1)
+#endif
+
 #ifndef __ASSEMBLER__
 
 /* allow ATmega8 compatibility */
@@ -123,12 +195,58 @@ typedef union usbDWord {
     uchar   bytes[4];
 } usbDWord_t;
 
+#ifdef ALT_PROFILES
+typedef struct uartProfile {
+    uchar   rxLimit;    /* RTS is dropped at this many bytes in rx_buf */
+    uchar   txLimit;    /* bulk OUT is refused above this many in tx_buf */
+    uchar   coalesce;   /* ticks a short IN packet waits for more bytes */
+} uartProfile_t;
+#endif
+
 
 extern uchar    urptr, uwptr, irptr, iwptr;
-extern uchar    rx_buf[], tx_buf[]; 
+extern uchar    rx_buf[], tx_buf[];
+extern uchar    codingsFull;    /* main.c: no room for another line coding */
+#if defined MPCM_MODE || defined BENCH_MODES
+extern uchar    uartUcsrb;
+#endif 
 
 extern void uartInit(ulong baudrate, uchar parity, uchar stopbits, uchar databits);
+extern void uartConfigure(ulong baudrate, uchar parity, uchar stopbits, uchar databits);
+extern void uartHoldTx(uchar mark);
+extern uchar uartTxDrained(void);
 extern void uartPoll(void);
+extern uchar uartLineState(void);
+#ifdef EVENT_FLAGS
+extern uchar uartIdle(void);
+#endif
+#ifdef ALT_PROFILES
+extern uartProfile_t    uartProfile;
+extern void uartSetProfile(uchar n);
+extern void uartTick(void);
+#endif
+
+#ifdef MUX_CHANNELS
+extern uchar            swRxR, swTxW;
+extern volatile uchar   swRxW, swTxR;
+extern uchar            swRxBuf[], swTxBuf[];
+
+extern void swuartInit(void);
+extern void swuartOff(void);
+extern void swuartSetCoding(uchar *data);
+extern void swuartPoll(void);
+extern uchar swuartPut(uchar c);
+
+static inline uchar swuartRxBytes(void)
+{
+    return (swRxW - swRxR) & SW_RX_MASK;
+}
+
+static inline uchar swuartTxBytesFree(void)
+{
+    return (swTxR - swTxW - 1) & SW_TX_MASK;
+}
+#endif
 
 
 /* The following function returns the amount of bytes available in the TX
@@ -139,6 +257,15 @@ static inline uchar uartTxBytesFree(void)
     return (irptr - uwptr - 1) & TX_MASK;
 }
 
+/* Bulk OUT is refused while no more than this many bytes are free, so that
+ * a whole packet always fits.
+ */
+#ifdef ALT_PROFILES
+#define UART_TX_STOP    ((uchar)(HW_CDC_BULK_OUT_SIZE + TX_MASK - uartProfile.txLimit))
+#else
+#define UART_TX_STOP    HW_CDC_BULK_OUT_SIZE
+#endif
+
 
 #endif	/*  #ifndef __ASSEMBLER__  */
 #endif  /*  __uart_h_included__  */
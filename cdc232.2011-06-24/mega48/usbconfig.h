@@ -136,10 +136,15 @@ section at the end of this file).
  * (e.g. HID), but never want to send any data. This option saves a couple
  * of bytes in flash memory and the transmit buffers in RAM.
  */
-#define USB_CFG_INTR_POLL_INTERVAL      255
+#ifndef USB_CFG_INTR_POLL_INTERVAL
+#define USB_CFG_INTR_POLL_INTERVAL      10
+#endif
 /* If you compile a version with endpoint 1 (interrupt-in), this is the poll
  * interval. The value is in milliseconds and must not be less than 10 ms for
  * low speed devices.
+ * Here it is the poll interval of the SERIAL_STATE notification endpoint 3.
+ * Notifications are only sent when the state changes, so a short interval
+ * costs nothing on the device.
  */
 #define USB_CFG_IS_SELF_POWERED         0
 /* Define this to 1 if the device has its own power supply. Set it to 0 if the
@@ -198,6 +203,24 @@ section at the end of this file).
 /* This macro (if defined) is executed when a USB SET_ADDRESS request was
  * received.
  */
+/* #define USB_SET_INTERFACE_HOOK(rq)          setAlternate(rq); */
+/* #define USB_GET_INTERFACE_HOOK(rq)          getAlternate(rq) */
+/* These macros (if defined) are executed for the SET_INTERFACE and
+ * GET_INTERFACE requests; rq is the usbRequest_t. The second returns the
+ * alternate setting of the interface in rq->wIndex, which is 0 without it.
+ * SET_INTERFACE is only handled if there is an interrupt-in endpoint.
+ */
+#ifdef ALT_PROFILES
+#define USB_SET_INTERFACE_HOOK(rq)          usbSetInterface((rq)->wIndex.bytes[0], (rq)->wValue.bytes[0]);
+#define USB_GET_INTERFACE_HOOK(rq)          usbGetInterface((rq)->wIndex.bytes[0])
+#ifndef __ASSEMBLER__
+extern void usbSetInterface(unsigned char iface, unsigned char alt);
+extern unsigned char usbGetInterface(unsigned char iface);
+#endif
+#endif
+/* ALT_PROFILES (main.c): the alternate settings of the data interface
+ * select the buffering profile of the UART.
+ */
 #define USB_COUNT_SOF                   0
 /* define this macro to 1 if you need the global variable "usbSofCount" which
  * counts SOF packets. This feature requires that the hardware interrupt is
@@ -222,7 +245,7 @@ section at the end of this file).
  * Please note that Start Of Frame detection works only if D- is wired to the
  * interrupt, not D+. THIS IS DIFFERENT THAN MOST EXAMPLES!
  */
-#define USB_CFG_CHECK_DATA_TOGGLING     0
+#define USB_CFG_CHECK_DATA_TOGGLING     1
 /* define this macro to 1 if you want to filter out duplicate data packets
  * sent by the host. Duplicates occur only as a consequence of communication
  * errors, when the host does not receive an ACK. Please note that you need to
@@ -230,6 +253,36 @@ section at the end of this file).
  * usbFunctionWrite(). Use the global usbCurrentDataToken and a static variable
  * for each control- and out-endpoint to check for duplicate packets.
  */
+#define USB_CFG_DROP_DUPLICATES         1
+/* define this macro to 1 if usbPoll() should drop the duplicates itself,
+ * counted in usbDuplicates. Needs USB_CFG_CHECK_DATA_TOGGLING.
+ */
+#if defined (__AVR_ATmega8__)
+#define USB_CFG_RESET_IN_POLL           1
+#else
+#define USB_CFG_RESET_IN_POLL           0
+#endif
+/* define this macro to 0 if usbPoll() should not sample the bus for a USB
+ * reset on every call. main.c calls usbCheckReset() from the Timer0 tick and
+ * sleeps between events, see usbPending() in usbdrv.h. Not on ATmega8, which
+ * has no GPIOR0 for the event flags (uart.h).
+ */
+#if !USB_CFG_RESET_IN_POLL
+#define USB_TX_HOOK                     sbi _SFR_IO_ADDR(GPIOR0), 3
+#endif
+/* This macro (if defined) is executed in the assembler module after each
+ * packet it sends: data, ACK, NAK or STALL. It must take 2 cycles and leave
+ * the registers and SREG alone. Here it sets EVENT_USB in the event flags
+ * (uart.h), so that a USB interrupt right before idleSleep() in main.c
+ * disables interrupts keeps the main loop awake.
+ */
+#define USB_CFG_CHECK_CRC_IN_POLL       1
+/* define this macro to 1 if usbPoll() should check the CRC of received data
+ * packets that the assembler module does not check (USB_CFG_CHECK_CRC = 0).
+ * The packet has been ACKed already, so a bad one is dropped and counted in
+ * usbCrcErrors rather than retried by the host. Costs one usbCrc16() per
+ * packet, see USB_USE_FAST_CRC.
+ */
 #if USB_CFG_CLOCK_KHZ==16500 || USB_CFG_CLOCK_KHZ==12800
 #define USB_CFG_HAVE_MEASURE_FRAME_LENGTH   1
 #include "osccal.h"
@@ -239,10 +292,11 @@ section at the end of this file).
 /* define this macro to 1 if you want the function usbMeasureFrameLength()
  * compiled in. This function can be used to calibrate the AVR's RC oscillator.
  */
-#define USB_USE_FAST_CRC                0
+#define USB_USE_FAST_CRC                1
 /* The assembler module has two implementations for the CRC algorithm. One is
  * faster, the other is smaller. This CRC routine is only used for transmitted
- * messages where timing is not critical. The faster routine needs 31 cycles
+ * messages, and with USB_CFG_CHECK_CRC_IN_POLL for received ones, where timing
+ * is not critical. The faster routine needs 31 cycles
  * per byte while the smaller one needs 61 to 69 cycles. The faster routine
  * may be worth the 32 bytes bigger code size if you transmit lots of data and
  * run the AVR close to its limit.
@@ -0,0 +1,319 @@
+/* Name: vendor.h
+ * Project: AVR USB driver for CDC interface on Low-Speed USB
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ */
+
+#ifndef __vendor_h_included__
+#define __vendor_h_included__
+
+/*
+General Description:
+    Vendor requests and the multi-channel framing of the ATmega firmware,
+    shared with the host tools. All requests are addressed to the device
+    (bmRequestType 0xc0 for IN, 0x40 for OUT). Multi-byte values are little
+    endian, and every field is aligned to its size so that the structures
+    have the same layout on the host. A request whose feature is not
+    compiled in returns no data.
+*/
+
+#include <stdint.h>
+
+/* Timer ticks: one tick is 2^tickShift / (cpuKHz*1000) s. Timer1 is 16 bit,
+ * so longer intervals are folded.
+ */
+
+/* IN:  read the latency histograms (vendorLatency_t)
+ * OUT: clear the histograms
+ */
+#define VENDOR_RQ_LATENCY       1
+
+#define VENDOR_LAT_BUCKETS      16
+
+/* Bucket n counts the bytes whose latency in timer ticks has n significant
+ * bits, i.e. [2^(n-1), 2^n), bucket 0 counts zero latency. The last bucket
+ * also holds everything above. The counters saturate at 0xffff.
+ */
+typedef struct vendorLatency {
+    uint8_t     tickShift;
+    uint8_t     reserved;
+    uint16_t    cpuKHz;
+    uint16_t    rx[VENDOR_LAT_BUCKETS];     /* UART RX -> IN token */
+    uint16_t    tx[VENDOR_LAT_BUCKETS];     /* OUT packet -> UDR0 */
+} vendorLatency_t;
+
+/* IN:  read the performance counters (vendorPerf_t)
+ * OUT: clear the counters
+ */
+#define VENDOR_RQ_PERF          2
+
+/* Counters wrap around, maxima are in timer ticks. */
+typedef struct vendorPerf {
+    uint8_t     tickShift;
+    uint8_t     reserved;
+    uint16_t    cpuKHz;
+    uint32_t    loopsPerSec;    /* main loop iterations, last 1/8 s */
+    uint16_t    maxLoop;        /* longest iteration */
+    uint16_t    maxUsbPoll;     /* longest usbPoll() */
+    uint16_t    maxUartPoll;    /* longest uartPoll() */
+    uint8_t     rxPeak;         /* peak occupancy of rx_buf in bytes */
+    uint8_t     txPeak;         /* peak occupancy of tx_buf in bytes */
+    uint32_t    inPackets;      /* bulk-IN packets handed to the driver */
+    uint32_t    outPackets;     /* bulk-OUT packets received */
+    uint32_t    disabledTicks;  /* time spent in usbDisableAllRequests() */
+    uint16_t    disabledCount;
+    uint16_t    rxFraming;      /* bytes dropped per cause */
+    uint16_t    rxParity;
+    uint16_t    rxOverrun;      /* overrun events, lost bytes not counted */
+    uint16_t    rxBreak;
+    uint16_t    txDropped;      /* OUT bytes that found tx_buf full */
+    uint16_t    usbCrcErrors;   /* packets dropped by usbPoll(), see usbconfig.h */
+    uint16_t    usbDuplicates;
+} vendorPerf_t;
+
+/* IN:  stop the debug trace ring and read it (odTrace_t in oddebug.h):
+ *      uint8_t next, stopped, then DEBUG_TRACE records of 8 bytes
+ * OUT: clear the ring and restart tracing
+ * Needs -DDEBUG_LEVEL=1 or 2 and -DDEBUG_TRACE=n.
+ */
+#define VENDOR_RQ_TRACE         3
+
+/* Record prefixes */
+#define VENDOR_TRACE_OUT        0x10    /* 0x10+PID&15: SETUP 0x1d, OUT 0x11 (DBG2) */
+#define VENDOR_TRACE_IN0        0x20    /* control IN data queued (DBG2) */
+#define VENDOR_TRACE_IN1        0x21    /* EP1/EP3 IN queued, 0x21..0x24 (DBG2) */
+#define VENDOR_TRACE_NAK_ON     0x30    /* usbDisableAllRequests(): OUT is NAKed (DBG2) */
+#define VENDOR_TRACE_NAK_OFF    0x31    /* usbEnableAllRequests() (DBG2) */
+#define VENDOR_TRACE_BAUD       0xf0    /* UBRR0 programmed (DBG1) */
+#define VENDOR_TRACE_RESET      0xff    /* USB bus reset (DBG1) */
+
+/* IN:  read the benchmark counters (vendorBench_t)
+ * OUT: select the mode in wValue low byte (BENCH_*), the PRBS order (7 or
+ *      15) in wValue high byte, and clear the counters; an unknown mode
+ *      is ignored
+ * Needs -DBENCH_MODES.
+ */
+#define VENDOR_RQ_BENCH         4
+
+#define BENCH_OFF               0
+#define BENCH_LOOPBACK          1   /* bulk-OUT -> bulk-IN, UART unused */
+#define BENCH_PRBS_IN           2   /* PRBS generated on bulk-IN */
+#define BENCH_PRBS_OUT          3   /* PRBS checked on bulk-OUT */
+#define BENCH_PRBS_UART         4   /* PRBS on UART TX, checked on UART RX */
+
+/* SET_LINE_CODING with this baud rate selects BENCH_LOOPBACK without
+ * touching the UART, any other coding returns to BENCH_OFF.
+ */
+#define BENCH_BAUD_LOOPBACK     1
+
+/* The PRBS checker syncs on the first 2 bytes, those are not checked.
+ * A byte with more than 2 wrong bits counts as a resync, not as bit errors.
+ */
+typedef struct vendorBench {
+    uint8_t     mode;
+    uint8_t     order;          /* PRBS order, 7 or 15 */
+    uint8_t     synced;         /* PRBS checker has synced */
+    uint8_t     reserved;
+    uint32_t    outBytes;       /* bytes taken from bulk-OUT */
+    uint32_t    inBytes;        /* bytes handed to bulk-IN */
+    uint32_t    outPackets;
+    uint32_t    dropped;        /* OUT bytes that found the buffer full or
+                                   were not used by the mode */
+    uint32_t    uartBytes;      /* PRBS bytes queued for UART TX */
+    uint32_t    checkedBytes;   /* bytes seen by the PRBS checker */
+    uint32_t    errorBits;
+    uint32_t    resyncs;
+} vendorBench_t;
+
+/* SET_LINE_CODING with this baud rate selects the multi-channel mode
+ * (-DMUX_CHANNELS), any other coding returns to the plain CDC mode. The
+ * bulk endpoints then carry frames, which may span packets. A frame starts
+ * with a header byte:
+ *   bits 7..6  channel: 0 is the USART, 1 the software UART
+ *   bit  5     0: data, bits 4..0 are the number of data bytes - 1
+ *              1: command in bits 4..0, its arguments follow
+ * Data is sent against credit only. The device grants the host the bytes
+ * its transmit buffer can take for each channel, the host grants the
+ * device the bytes it can take from each channel. Both sides start with
+ * no credit when the mode is selected.
+ */
+#define MUX_BAUD_SELECT         2
+
+#define MUX_HDR(channel, cmd)   ((channel) << 6 | (cmd))
+#define MUX_HDR_CHANNEL(hdr)    ((hdr) >> 6)
+#define MUX_HDR_TYPE(hdr)       ((hdr) & 0x3f)  /* command, or length - 1 */
+#define MUX_HDR_CMD             0x20
+#define MUX_DATA_MAX            32
+
+#define MUX_CMD_CREDIT          (MUX_HDR_CMD | 0)   /* 1 byte: bytes granted */
+#define MUX_CMD_CODING          (MUX_HDR_CMD | 1)   /* to the device, 7 bytes as
+                                                       SET_LINE_CODING */
+
+/* IN:  1 byte, the bytes the next OUT transfer may carry, then the bytes
+ *      received by the UART; a short transfer means there are no more
+ * OUT: without data, wValue 1 turns the mode on, 0 turns it off; while it
+ *      is on, received bytes are sent on this request only
+ *      with data, the bytes for the UART; a transfer longer than the room
+ *      from the last IN transfer may be stalled
+ * wLength is at most 254. Needs -DEP0_DATA, see ep0.h.
+ */
+#define VENDOR_RQ_DATA          5
+
+/* IN:  read the compression counters (vendorComp_t)
+ * OUT: wValue 1 turns the compressed mode on, 0 turns it off; both clear
+ *      the counters and start the two directions with an empty history
+ * Needs -DCOMP_MODE, see comp.h.
+ */
+#define VENDOR_RQ_COMP          6
+
+/* The bulk endpoints then carry a byte stream in this code, a token may
+ * span packets:
+ *   0x00..0x7f         the byte itself
+ *   0x80..0xfe, d      match: b - 0x80 + 3 bytes copied from d + 1 bytes
+ *                      back, which may overlap the copy (runs)
+ *   0xff, c            the byte c, 0x80..0xff
+ *   0xff, 0x00         sync: the history starts over
+ * A match reaches at most COMP_WINDOW bytes back. The history starts
+ * with COMP_WINDOW zero bytes.
+ * The device sends the sync on bulk-IN after an OUT packet it dropped for
+ * its CRC, and drops bulk-OUT up to a sync from the host. The host then
+ * starts its encoder over with the sync twice (COMP_SYNC_OUT): the device
+ * may be in the middle of a token of the lost code and miss the first.
+ */
+#define COMP_WINDOW             64
+#define COMP_MATCH              0x80
+#define COMP_ESCAPE             0xff
+#define COMP_MIN_MATCH          3
+#define COMP_MAX_MATCH          (COMP_ESCAPE - 1 - COMP_MATCH + COMP_MIN_MATCH)
+#define COMP_SYNC               0x00
+#define COMP_SYNC_OUT           4   /* bytes */
+
+typedef struct vendorComp {
+    uint8_t     active;
+    uint8_t     resyncs;        /* syncs sent, wraps */
+    uint8_t     reserved[2];
+    uint32_t    rxRaw;          /* bytes taken from rx_buf */
+    uint32_t    rxCoded;        /* bytes of them on bulk-IN */
+    uint32_t    txCoded;        /* bytes from bulk-OUT */
+    uint32_t    txRaw;          /* bytes of them into tx_buf */
+} vendorComp_t;
+
+/* IN:  read the capture counters (vendorCapture_t)
+ * OUT: wValue 1 turns the capture mode on, 0 turns it off; on drops what
+ *      rx_buf holds and clears the counters
+ * Needs -DCAPTURE_MODE, see capture.h.
+ */
+#define VENDOR_RQ_CAPTURE       7
+
+/* Bulk-IN then carries records of the received bytes instead of the
+ * bytes, a record may span packets:
+ *   0x00..0x3f             r + 1 bytes follow, each one character after
+ *                          the byte before
+ *   0x40..0x7f, delta      (r & 0x3f) + 1 bytes follow, the first delta
+ *                          ticks after the byte before, the others one
+ *                          character after it
+ *   0x80..0xbf, [delta]    one byte with the CAP_* flags in r & 0x1f
+ *                          follows, delta ticks after the byte before if
+ *                          CAP_DELTA is set, otherwise one character
+ *   0xc0, hz, char         start: ticks per second (4 bytes) and ticks
+ *                          per character times 256 (4 bytes); it comes
+ *                          first and after each line coding, the times
+ *                          count from the first one
+ * delta is a varint, 7 bits per byte with the low bits first and bit 7
+ * set when another byte follows. A character is the frame of the line
+ * coding; a byte counts as one character after the byte before only
+ * within CAP_JITTER ticks of that (capture.h), any other gap is a delta.
+ */
+#define CAP_RUN                 0x00
+#define CAP_RUN_DELTA           0x40
+#define CAP_FLAGGED             0x80
+#define CAP_START               0xc0
+#define CAP_MAX_RUN             64
+
+#define CAP_FRAMING             0x01    /* no stop bit */
+#define CAP_PARITY              0x02
+#define CAP_OVERRUN             0x04    /* the USART lost bytes before this one */
+#define CAP_LOST                0x08    /* rx_buf was full, bytes were lost before this one */
+#define CAP_BREAK               0x10    /* framing error with all bits 0 */
+#define CAP_DELTA               0x20
+
+typedef struct vendorCapture {
+    uint8_t     active;
+    uint8_t     reserved[3];
+    uint32_t    bytes;          /* bytes received */
+    uint32_t    errors;         /* of them with CAP_FRAMING/PARITY/BREAK */
+    uint32_t    lost;           /* bytes dropped with rx_buf full */
+    uint32_t    coded;          /* record bytes into rx_buf */
+} vendorCapture_t;
+
+/* IN:  read the state of the baud rate detection (vendorAutobaud_t)
+ * OUT: wValue 1 starts the detection, 0 stops it
+ * SET_LINE_CODING with AUTOBAUD_SELECT also starts it and takes the
+ * format of the coding. The detected rate is applied to the USART and
+ * returned by GET_LINE_CODING, which returns AUTOBAUD_SELECT until then.
+ * Needs -DAUTO_BAUD, see autobaud.h.
+ */
+#define VENDOR_RQ_AUTOBAUD      8
+#define AUTOBAUD_SELECT         3
+
+typedef struct vendorAutobaud {
+    uint8_t     active;
+    uint8_t     edges;          /* edges of the current measurement */
+    uint16_t    tries;          /* measurements without a rate */
+    uint32_t    bitTime;        /* of the last rate, CPU cycles times 16 */
+    uint32_t    measured;       /* rate from bitTime */
+    uint32_t    baud;           /* rate applied, 0 before the first one */
+} vendorAutobaud_t;
+
+/* IN:  read the RS-485 state and counters (vendorRs485_t)
+ * OUT: wValue low byte the flags, wIndex the hold time of DE after the
+ *      last stop bit in ticks of 8 CPU cycles (0 releases it in the
+ *      transmit complete interrupt); clears the counters
+ * Needs -DRS485_DE, see rs485.h.
+ */
+#define VENDOR_RQ_RS485         9
+#define RS485_ECHO              1   /* drop the echo of the bytes sent */
+
+typedef struct vendorRs485 {
+    uint8_t     flags;          /* RS485_ECHO */
+    uint8_t     hold;           /* ticks of 8 CPU cycles */
+    uint8_t     lateMax;        /* ticks the release came after the hold */
+    uint8_t     reserved;
+    uint16_t    turnarounds;    /* DE releases */
+    uint16_t    echoes;         /* received bytes dropped as echo */
+    uint16_t    collisions;     /* received bytes that were not the echo */
+} vendorRs485_t;
+
+/* IN:  read the 9 bit mode state and counters (vendorMpcm_t)
+ * OUT: wValue low byte the MPCM_* flags, wIndex low byte the address of
+ *      the device and high byte a second one (MPCM_ADDR2), e.g. for
+ *      broadcasts; applied as a line coding, after the data queued
+ *      before is sent; clears the counters
+ * Needs -DMPCM_MODE, see mpcm.h.
+ */
+#define VENDOR_RQ_MPCM          10
+#define MPCM_NINE_BITS          1   /* 9 data bits, the 9th escaped on USB */
+#define MPCM_FILTER             2   /* only frames for the addresses */
+#define MPCM_ADDR2              4   /* the second address matches too */
+
+/* Both bulk endpoints carry the frames with 9 data bits as bytes, the
+ * 9th bit clear; these sequences stand for the others:
+ *   0xff 0xff              0xff with the 9th bit clear
+ *   0xff 0x01 a            a with the 9th bit set: an address
+ * Other bytes after 0xff are reserved, the device drops both.
+ */
+#define MPCM_ESC                0xff
+#define MPCM_ESC_ADDR           0x01
+
+typedef struct vendorMpcm {
+    uint8_t     flags;          /* MPCM_* */
+    uint8_t     address;
+    uint8_t     address2;
+    uint8_t     selected;       /* the last address matched */
+    uint16_t    addresses;      /* address frames received */
+    uint16_t    matched;        /* of them for the device */
+    uint16_t    dropped;        /* data frames for others past the USART */
+} vendorMpcm_t;
+
+#endif  /*  __vendor_h_included__  */
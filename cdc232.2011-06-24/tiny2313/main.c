@@ -51,6 +51,16 @@ enum {
 };
 
 
+/*  Transfer type of the data endpoints: bulk, or interrupt polled every
+    DATA_EP_INTERVAL ms (see Makefile). Low-speed devices may not have bulk
+    endpoints, and hosts schedule them in different ways.  */
+#ifdef DATA_EP_INTERVAL
+#define DATA_EP_TYPE        0x03    /* Interrupt */
+#else
+#define DATA_EP_TYPE        0x02    /* Bulk */
+#define DATA_EP_INTERVAL    0
+#endif
+
 static PROGMEM const char configDescrCDC[] = {   /* USB configuration descriptor */
     9,          /* sizeof(usbDescrConfig): length of descriptor in bytes */
     USBDESCR_CONFIG,    /* descriptor type */
@@ -123,17 +133,17 @@ static PROGMEM const char configDescrCDC[] = {   /* USB configuration descriptor
     7,           /* sizeof(usbDescrEndpoint) */
     USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
     0x01,        /* OUT endpoint number 1 */
-    0x02,        /* attrib: Bulk endpoint */
+    DATA_EP_TYPE,        /* attrib: Bulk or Interrupt endpoint */
     HW_CDC_BULK_OUT_SIZE, 0,        /* maximum packet size */
-    0,           /* in ms */
+    DATA_EP_INTERVAL,  /* in ms */
 
     /* Endpoint Descriptor */
     7,           /* sizeof(usbDescrEndpoint) */
     USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
     0x81,        /* IN endpoint number 1 */
-    0x02,        /* attrib: Bulk endpoint */
+    DATA_EP_TYPE,        /* attrib: Bulk or Interrupt endpoint */
     HW_CDC_BULK_IN_SIZE, 0,        /* maximum packet size */
-    0,           /* in ms */
+    DATA_EP_INTERVAL,  /* in ms */
 };
 
 
@@ -201,6 +211,14 @@ uchar usbFunctionWrite( uchar *data, uchar len )
 	unsigned 	baudrate;
 	uchar		i;
 
+#if FLASHEND > 0x7ff
+	//	drivers repeat the current coding on open and on each tcsetattr()
+	for( i=0; i<7 && modeBuffer[i]==data[i]; i++ )
+		;
+	if( i==7 )
+		return 1;
+#endif
+
 	//	set baudrate generator
 	baudrate	= *(unsigned *)data;
 	for( i=0; baudrate; i++ )
@@ -251,6 +269,12 @@ static void hardwareInit(void)
 {
 unsigned	i;
 uchar		j;
+#if FLASHEND > 0x7ff
+uchar		resetFlags;
+
+    resetFlags  = MCUSR;
+    MCUSR       = 0;
+#endif
 
     /* activate pull-ups except on USB lines */
     USB_CFG_IOPORT   = (uchar)~((1<<USB_CFG_DMINUS_BIT)|(1<<USB_CFG_DPLUS_BIT));
@@ -262,11 +286,18 @@ uchar		j;
     USBDDR    = (1<<USB_CFG_DMINUS_BIT)|(1<<USB_CFG_DPLUS_BIT);
 #endif
 
-    j = 15;
-    while(--j){          /* USB Reset by device only required on Watchdog Reset */
-        i = 0;
-        while(--i)
-            wdt_reset();
+    /* USB Reset by device only required if the host may still know us;
+       a 2K part has no flash left for the test and always disconnects */
+#if FLASHEND > 0x7ff
+    if( !(resetFlags & (1<<PORF)) )
+#endif
+    {
+        j = 15;
+        while(--j){
+            i = 0;
+            while(--i)
+                wdt_reset();
+        }
     }
 
 #ifdef USB_CFG_PULLUP_IOPORT
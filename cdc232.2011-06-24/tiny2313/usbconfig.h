@@ -230,6 +230,18 @@ section at the end of this file).
  * usbFunctionWrite(). Use the global usbCurrentDataToken and a static variable
  * for each control- and out-endpoint to check for duplicate packets.
  */
+#define USB_CFG_DROP_DUPLICATES         0
+/* define this macro to 1 if usbPoll() should drop the duplicates itself,
+ * counted in usbDuplicates. Needs USB_CFG_CHECK_DATA_TOGGLING.
+ */
+#define USB_CFG_CHECK_CRC_IN_POLL       0
+/* define this macro to 1 if usbPoll() should check the CRC of received data
+ * packets that the assembler module does not check (USB_CFG_CHECK_CRC = 0).
+ * The packet has been ACKed already, so a bad one is dropped and counted in
+ * usbCrcErrors rather than retried by the host. Costs one usbCrc16() per
+ * packet, see USB_USE_FAST_CRC.
+ * Both are off here, the ATtiny2313 has no flash left for them.
+ */
 #if USB_CFG_CLOCK_KHZ==16500 || USB_CFG_CLOCK_KHZ==12800
 #define USB_CFG_HAVE_MEASURE_FRAME_LENGTH   1
 #include "osccal.h"
@@ -38,6 +38,16 @@ enum {
 };
 
 
+/*  Transfer type of the data endpoints: bulk, or interrupt polled every
+    DATA_EP_INTERVAL ms (see Makefile). Low-speed devices may not have bulk
+    endpoints, and hosts schedule them in different ways.  */
+#ifdef DATA_EP_INTERVAL
+#define DATA_EP_TYPE        0x03    /* Interrupt */
+#else
+#define DATA_EP_TYPE        0x02    /* Bulk */
+#define DATA_EP_INTERVAL    0
+#endif
+
 static PROGMEM char configDescrCDC[] = {   /* USB configuration descriptor */
     9,          /* sizeof(usbDescrConfig): length of descriptor in bytes */
     USBDESCR_CONFIG,    /* descriptor type */
@@ -110,17 +120,17 @@ static PROGMEM char configDescrCDC[] = {   /* USB configuration descriptor */
     7,           /* sizeof(usbDescrEndpoint) */
     USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
     0x01,        /* OUT endpoint number 1 */
-    0x02,        /* attrib: Bulk endpoint */
+    DATA_EP_TYPE,        /* attrib: Bulk or Interrupt endpoint */
     HW_CDC_BULK_OUT_SIZE, 0,        /* maximum packet size */
-    0,           /* in ms */
+    DATA_EP_INTERVAL,  /* in ms */
 
     /* Endpoint Descriptor */
     7,           /* sizeof(usbDescrEndpoint) */
     USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
     0x81,        /* IN endpoint number 1 */
-    0x02,        /* attrib: Bulk endpoint */
+    DATA_EP_TYPE,        /* attrib: Bulk or Interrupt endpoint */
     HW_CDC_BULK_IN_SIZE, 0,        /* maximum packet size */
-    0,           /* in ms */
+    DATA_EP_INTERVAL,  /* in ms */
 };
 
 
@@ -202,6 +212,10 @@ uchar usbFunctionWrite( uchar *data, uchar len )
 {
 
     /*    SET_LINE_CODING    */
+    /*  drivers repeat the current coding on open and on each tcsetattr()  */
+    if( baud.bytes[0]==data[0] && baud.bytes[1]==data[1] )
+        return 1;
+
     baud.bytes[0] = data[0];
     baud.bytes[1] = data[1];
 
@@ -228,6 +242,10 @@ void usbFunctionWriteOut( uchar *data, uchar len )
 
 static void hardwareInit(void)
 {
+uchar   resetFlags;
+
+    resetFlags  = MCUSR;
+    MCUSR       = 0;
 
     /* activate pull-ups except on USB lines */
     USB_CFG_IOPORT   = (uchar)~((1<<USB_CFG_DMINUS_BIT)|(1<<USB_CFG_DPLUS_BIT));
@@ -239,9 +257,13 @@ static void hardwareInit(void)
     USBDDR    = (1<<USB_CFG_DMINUS_BIT)|(1<<USB_CFG_DPLUS_BIT);
 #endif
 
-    /* 250 ms disconnect */
-    wdt_reset();
-    _delay_ms(250);
+    /* 250 ms disconnect, only if the host may still know us from before
+     * the reset. After power-on there is nothing to disconnect from.
+     */
+    if( !(resetFlags & (1<<PORF)) ){
+        wdt_reset();
+        _delay_ms(250);
+    }
 
 #ifdef USB_CFG_PULLUP_IOPORT
     usbDeviceConnect();
@@ -222,7 +222,7 @@ section at the end of this file).
  * Please note that Start Of Frame detection works only if D- is wired to the
  * interrupt, not D+. THIS IS DIFFERENT THAN MOST EXAMPLES!
  */
-#define USB_CFG_CHECK_DATA_TOGGLING     0
+#define USB_CFG_CHECK_DATA_TOGGLING     1
 /* define this macro to 1 if you want to filter out duplicate data packets
  * sent by the host. Duplicates occur only as a consequence of communication
  * errors, when the host does not receive an ACK. Please note that you need to
@@ -230,6 +230,17 @@ section at the end of this file).
  * usbFunctionWrite(). Use the global usbCurrentDataToken and a static variable
  * for each control- and out-endpoint to check for duplicate packets.
  */
+#define USB_CFG_DROP_DUPLICATES         1
+/* define this macro to 1 if usbPoll() should drop the duplicates itself,
+ * counted in usbDuplicates. Needs USB_CFG_CHECK_DATA_TOGGLING.
+ */
+#define USB_CFG_CHECK_CRC_IN_POLL       1
+/* define this macro to 1 if usbPoll() should check the CRC of received data
+ * packets that the assembler module does not check (USB_CFG_CHECK_CRC = 0).
+ * The packet has been ACKed already, so a bad one is dropped and counted in
+ * usbCrcErrors rather than retried by the host. Costs one usbCrc16() per
+ * packet, see USB_USE_FAST_CRC.
+ */
 #if USB_CFG_CLOCK_KHZ==16500 || USB_CFG_CLOCK_KHZ==12800
 #define USB_CFG_HAVE_MEASURE_FRAME_LENGTH   1
 #include "osccal.h"
@@ -239,10 +250,11 @@ section at the end of this file).
 /* define this macro to 1 if you want the function usbMeasureFrameLength()
  * compiled in. This function can be used to calibrate the AVR's RC oscillator.
  */
-#define USB_USE_FAST_CRC                0
+#define USB_USE_FAST_CRC                1
 /* The assembler module has two implementations for the CRC algorithm. One is
  * faster, the other is smaller. This CRC routine is only used for transmitted
- * messages where timing is not critical. The faster routine needs 31 cycles
+ * messages, and with USB_CFG_CHECK_CRC_IN_POLL for received ones, where timing
+ * is not critical. The faster routine needs 31 cycles
  * per byte while the smaller one needs 61 to 69 cycles. The faster routine
  * may be worth the 32 bytes bigger code size if you transmit lots of data and
  * run the AVR close to its limit.
@@ -12,6 +12,43 @@
 
 #if DEBUG_LEVEL > 0
 
+#ifdef DEBUG_TRACE
+
+odTrace_t   odTrace;
+
+void    odTraceClear(void)
+{
+uchar   *p = (uchar *)&odTrace;
+uchar   i;
+
+    for(i = 0; i < sizeof(odTrace); i++)
+        *p++ = 0;
+}
+
+void    odDebug(uchar prefix, uchar *data, uchar len)
+{
+odTraceRec_t    *r;
+uchar           i;
+
+    if(odTrace.stopped)
+        return;
+    r = &odTrace.rec[(odTrace.next - 1) & (DEBUG_TRACE - 1)];
+    if(len == 0 && r->len == 0 && r->prefix == prefix){
+        if(r->data[0] != 0xff)
+            r->data[0]++;
+        return;
+    }
+    r = &odTrace.rec[odTrace.next];
+    odTrace.next = (odTrace.next + 1) & (DEBUG_TRACE - 1);
+    r->prefix = prefix;
+    r->len = len;
+    r->data[0] = 0;
+    for(i = 0; i < len && i < ODDBG_TRACE_DATA; i++)
+        r->data[i] = data[i];
+}
+
+#else   /* DEBUG_TRACE */
+
 #warning "Never compile production devices with debugging enabled"
 
 static void uartPutc(char c)
@@ -47,4 +84,5 @@ void    odDebug(uchar prefix, uchar *data, uchar len)
     uartPutc('\n');
 }
 
+#endif  /* DEBUG_TRACE */
 #endif
@@ -21,6 +21,15 @@ calls are no-ops. If it is 1, DBG1 logs will appear, but not DBG2. If it is
 
 A debug log consists of a label ('prefix') to indicate which debug log created
 the output and a memory block to dump in hex ('data' and 'len').
+
+If DEBUG_TRACE is defined to n (a power of 2, at most 16), the logs are not
+printed but stored in a ring of n binary records in RAM. Storing a record
+takes a few dozen cycles and the UART stays free for the application. A record
+is 8 bytes: prefix, len and the first ODDBG_TRACE_DATA data bytes. Repeated
+records without data are merged, data[0] then counts the repetitions.
+odTrace.next is the next record to write, which is the oldest one once the
+ring has wrapped. odTraceStop() freezes the ring for reading, e.g. by a
+debugger, a simulator or a vendor request; odTraceClear() restarts it.
 */
 
 
@@ -35,7 +44,7 @@ the output and a memory block to dump in hex ('data' and 'len').
 #   define  uchar   unsigned char
 #endif
 
-#if DEBUG_LEVEL > 0 && !(defined TXEN || defined TXEN0) /* no UART in device */
+#if DEBUG_LEVEL > 0 && !(defined TXEN || defined TXEN0) && !defined DEBUG_TRACE /* no UART in device */
 #   warning "Debugging disabled because device has no UART"
 #   undef   DEBUG_LEVEL
 #endif
@@ -63,6 +72,34 @@ the output and a memory block to dump in hex ('data' and 'len').
 #if DEBUG_LEVEL > 0
 extern void odDebug(uchar prefix, uchar *data, uchar len);
 
+#ifdef DEBUG_TRACE
+
+#if DEBUG_TRACE > 16 || (DEBUG_TRACE & (DEBUG_TRACE - 1))
+#   error "DEBUG_TRACE must be a power of 2, at most 16"
+#endif
+
+#define ODDBG_TRACE_DATA    6
+
+typedef struct odTraceRec{
+    uchar   prefix;
+    uchar   len;
+    uchar   data[ODDBG_TRACE_DATA];
+}odTraceRec_t;
+
+typedef struct odTrace{
+    uchar           next;
+    uchar           stopped;
+    odTraceRec_t    rec[DEBUG_TRACE];
+}odTrace_t;
+
+extern odTrace_t    odTrace;
+
+extern void odTraceClear(void);
+#define odTraceStop()   (odTrace.stopped = 1)
+#define odDebugInit()
+
+#else   /* DEBUG_TRACE */
+
 /* Try to find our control registers; ATMEL likes to rename these */
 
 #if defined UBRR
@@ -114,6 +151,8 @@ static inline void  odDebugInit(void)
     ODDBG_UCR |= (1<<ODDBG_TXEN);
     ODDBG_UBRR = F_CPU / (19200 * 16L) - 1;
 }
+
+#endif  /* DEBUG_TRACE */
 #else
 #   define odDebugInit()
 #endif
@@ -172,6 +172,13 @@ section at the end of this file).
 /* This macro (if defined) is executed when a USB SET_ADDRESS request was
  * received.
  */
+/* #define USB_SET_INTERFACE_HOOK(rq)          setAlternate(rq); */
+/* #define USB_GET_INTERFACE_HOOK(rq)          getAlternate(rq) */
+/* These macros (if defined) are executed for the SET_INTERFACE and
+ * GET_INTERFACE requests; rq is the usbRequest_t. The second returns the
+ * alternate setting of the interface in rq->wIndex, which is 0 without it.
+ * SET_INTERFACE is only handled if there is an interrupt-in endpoint.
+ */
 #define USB_COUNT_SOF                   0
 /* define this macro to 1 if you need the global variable "usbSofCount" which
  * counts SOF packets. This feature requires that the hardware interrupt is
@@ -204,6 +211,29 @@ section at the end of this file).
  * usbFunctionWrite(). Use the global usbCurrentDataToken and a static variable
  * for each control- and out-endpoint to check for duplicate packets.
  */
+#define USB_CFG_DROP_DUPLICATES         0
+/* define this macro to 1 if usbPoll() should drop the duplicates itself,
+ * counted in usbDuplicates. Needs USB_CFG_CHECK_DATA_TOGGLING.
+ */
+#define USB_CFG_RESET_IN_POLL           1
+/* define this macro to 0 if usbPoll() should not sample the bus for a USB
+ * reset on every call. The application calls usbCheckReset() from a timer
+ * tick instead and may sleep between events, see usbPending() in usbdrv.h.
+ */
+/* #define USB_TX_HOOK                     sbi _SFR_IO_ADDR(GPIOR0), 0 */
+/* This macro (if defined) is executed in the assembler module after each
+ * packet it sends: data, ACK, NAK or STALL. It must take 2 cycles and leave
+ * the registers and SREG alone. A main loop that sleeps between events can
+ * set a flag with it, which it checks with interrupts disabled right before
+ * sleep_cpu(): usbPending() alone misses an interrupt after its call.
+ */
+#define USB_CFG_CHECK_CRC_IN_POLL       0
+/* define this macro to 1 if usbPoll() should check the CRC of received data
+ * packets that the assembler module does not check (USB_CFG_CHECK_CRC = 0).
+ * The packet has been ACKed already, so a bad one is dropped and counted in
+ * usbCrcErrors rather than retried by the host. Costs one usbCrc16() per
+ * packet, see USB_USE_FAST_CRC.
+ */
 #define USB_CFG_HAVE_MEASURE_FRAME_LENGTH   0
 /* define this macro to 1 if you want the function usbMeasureFrameLength()
  * compiled in. This function can be used to calibrate the AVR's RC oscillator.
@@ -43,6 +43,14 @@ usbTxStatus_t  usbTxStatus3;
 #if USB_CFG_CHECK_DATA_TOGGLING
 uchar       usbCurrentDataToken;/* when we check data toggling to ignore duplicate packets */
 #endif
+#if USB_CFG_CHECK_CRC_IN_POLL
+unsigned    usbCrcErrors;       /* packets dropped by usbPoll() for a bad CRC */
+#endif
+#if USB_CFG_DROP_DUPLICATES
+unsigned    usbDuplicates;      /* packets dropped by usbPoll() as retransmissions */
+uchar       usbOutToken[2];     /* data PID of the last packet, zero sized ones set by
+                                 * the interrupt: control, other OUT endpoint */
+#endif
 
 /* USB status registers / not shared with asm code */
 uchar               *usbMsgPtr;     /* data to transmit next -- ROM or RAM address */
@@ -204,6 +212,13 @@ static inline void  usbResetDataToggling(void)
 #endif
 }
 
+static inline void  usbResetOutToggling(void)
+{
+#if USB_CFG_DROP_DUPLICATES
+    usbOutToken[1] = 0;     /* the host starts with DATA0, accept either */
+#endif
+}
+
 static inline void  usbResetStall(void)
 {
 #if USB_CFG_IMPLEMENT_HALT && USB_CFG_HAVE_INTRIN_ENDPOINT
@@ -285,6 +300,9 @@ USB_PUBLIC void usbSetInterrupt3(uchar *data, uchar len)
 #ifndef USB_SET_ADDRESS_HOOK
 #define USB_SET_ADDRESS_HOOK()
 #endif
+#ifndef USB_SET_INTERFACE_HOOK
+#define USB_SET_INTERFACE_HOOK(rq)
+#endif
 
 /* ------------------------------------------------------------------------- */
 
@@ -398,12 +416,18 @@ uchar   index = rq->wIndex.bytes[0];
     SWITCH_CASE(USBRQ_SET_CONFIGURATION)    /* 9 */
         usbConfiguration = value;
         usbResetStall();
+        usbResetOutToggling();
     SWITCH_CASE(USBRQ_GET_INTERFACE)        /* 10 */
+#ifdef USB_GET_INTERFACE_HOOK
+        dataPtr[0] = USB_GET_INTERFACE_HOOK(rq);
+#endif
         len = 1;
 #if USB_CFG_HAVE_INTRIN_ENDPOINT && !USB_CFG_SUPPRESS_INTR_CODE
     SWITCH_CASE(USBRQ_SET_INTERFACE)        /* 11 */
         usbResetDataToggling();
         usbResetStall();
+        usbResetOutToggling();
+        USB_SET_INTERFACE_HOOK(rq);
 #endif
     SWITCH_DEFAULT                          /* 7=SET_DESCRIPTOR, 12=SYNC_FRAME */
         /* Should we add an optional hook here? */
@@ -562,19 +586,69 @@ uchar           isReset = !notResetState;
 
 /* ------------------------------------------------------------------------- */
 
+/* usbRxValid() returns 0 for a received packet that must be ignored: the
+ * retransmission of a packet whose ACK the host has missed, or one with a bad
+ * CRC. The ACK has been sent already, so a packet with a bad CRC is lost; if
+ * you need to recover from that, check the data on application level.
+ * A retransmission has the data toggle of the previous packet on the same
+ * endpoint. The interrupt does not pass on zero sized packets, but stores
+ * their toggle in usbOutToken (asmcommon.inc). After a packet with a bad CRC
+ * either toggle is accepted: the host may have its ACK or send it again.
+ */
+static inline uchar usbRxValid(uchar *data, schar len)
+{
+#if USB_CFG_DROP_DUPLICATES
+uchar       i = usbRxToken < 0x10;  /* OUT endpoint other than 0 */
+
+    if(usbRxToken != USBPID_SETUP && usbOutToken[i] == usbCurrentDataToken){
+        usbDuplicates++;
+        return 0;
+    }
+    usbOutToken[i] = usbCurrentDataToken;
+#endif
+#if USB_CFG_CHECK_CRC_IN_POLL
+    if(usbCrc16(data, len) != (data[len] | (unsigned)data[len + 1] << 8)){
+#if USB_CFG_DROP_DUPLICATES
+        usbOutToken[i] = 0;
+#endif
+        usbCrcErrors++;
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+/* usbBusReset() samples the bus for the SE0 of a reset. A keep-alive EOP is
+ * shorter than the 20 samples.
+ */
+static inline void usbBusReset(void)
+{
+uchar   i;
+
+    for(i = 20; i > 0; i--){
+        uchar usbLineStatus = USBIN & USBMASK;
+        if(usbLineStatus != 0)  /* SE0 has ended */
+            goto isNotReset;
+    }
+    /* RESET condition, called multiple times during reset */
+    usbNewDeviceAddr = 0;
+    usbDeviceAddr = 0;
+    usbResetStall();
+    usbResetOutToggling();
+    DBG1(0xff, 0, 0);
+isNotReset:
+    usbHandleResetHook(i);
+}
+
 USB_PUBLIC void usbPoll(void)
 {
 schar   len;
-uchar   i;
 
     len = usbRxLen - 3;
     if(len >= 0){
-/* We could check CRC16 here -- but ACK has already been sent anyway. If you
- * need data integrity checks with this driver, check the CRC in your app
- * code and report errors back to the host. Since the ACK was already sent,
- * retries must be handled on application level.
- * unsigned crc = usbCrc16(buffer + 1, usbRxLen - 3);
- */
+#if USB_CFG_CHECK_CRC_IN_POLL || USB_CFG_DROP_DUPLICATES
+        if(usbRxValid(usbRxBuf + USB_BUFSIZE + 1 - usbInputBufOffset, len))
+#endif
         usbProcessRx(usbRxBuf + USB_BUFSIZE + 1 - usbInputBufOffset, len);
 #if USB_CFG_HAVE_FLOWCONTROL
         if(usbRxLen > 0)    /* only mark as available if not inactivated */
@@ -588,20 +662,32 @@ uchar   i;
             usbBuildTxBlock();
         }
     }
-    for(i = 20; i > 0; i--){
-        uchar usbLineStatus = USBIN & USBMASK;
-        if(usbLineStatus != 0)  /* SE0 has ended */
-            goto isNotReset;
+#if USB_CFG_RESET_IN_POLL
+    usbBusReset();
+#endif
+}
+
+#if !USB_CFG_RESET_IN_POLL
+USB_PUBLIC void usbCheckReset(void)
+{
+#if USB_COUNT_SOF
+static uchar    sofCount;
+
+    if(usbSofCount != sofCount){    /* a SOF since the last call: no reset */
+        sofCount = usbSofCount;
+        usbHandleResetHook(1);
+        return;
     }
-    /* RESET condition, called multiple times during reset */
-    usbNewDeviceAddr = 0;
-    usbDeviceAddr = 0;
-    usbResetStall();
-    DBG1(0xff, 0, 0);
-isNotReset:
-    usbHandleResetHook(i);
+#endif
+    usbBusReset();
 }
 
+USB_PUBLIC uchar usbPending(void)
+{
+    return usbRxLen > 0 || ((usbTxLen & 0x10) && usbMsgLen != USB_NO_MSG);
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 USB_PUBLIC void usbInit(void)
@@ -178,6 +178,19 @@ USB_PUBLIC void usbPoll(void);
  * Please note that debug outputs through the UART take ~ 0.5ms per byte
  * at 19200 bps.
  */
+#if defined(USB_CFG_RESET_IN_POLL) && !USB_CFG_RESET_IN_POLL
+USB_PUBLIC void usbCheckReset(void);
+/* Checks the bus for a USB reset, which usbPoll() does not do if
+ * USB_CFG_RESET_IN_POLL is 0. Call it at least every 5 ms, e.g. from a timer
+ * tick; a reset lasts 10 ms. With USB_COUNT_SOF the bus is only sampled if no
+ * SOF has been seen since the previous call.
+ */
+USB_PUBLIC uchar usbPending(void);
+/* Returns nonzero while usbPoll() has work: a received message or the next
+ * block of a control-in transfer. A main loop that sleeps between events
+ * checks it before sleeping. Only available if USB_CFG_RESET_IN_POLL is 0.
+ */
+#endif
 extern uchar *usbMsgPtr;
 /* This variable may be used to pass transmit data to the driver from the
  * implementation of usbFunctionWrite(). It is also used internally by the
@@ -306,8 +319,11 @@ USB_PUBLIC void usbFunctionWriteOut(uchar *data, uchar len);
  *     USB_INTR_ENABLE &= ~(1 << USB_INTR_ENABLE_BIT)
  * or use cli() to disable interrupts globally.
  */
+#ifndef USB_PTR_UINT
+#define USB_PTR_UINT(p)     ((unsigned)(p))     /* see usbportability.h */
+#endif
 extern unsigned usbCrc16(unsigned data, uchar len);
-#define usbCrc16(data, len) usbCrc16((unsigned)(data), len)
+#define usbCrc16(data, len) usbCrc16(USB_PTR_UINT(data), len)
 /* This function calculates the binary complement of the data CRC used in
  * USB data packets. The value is used to build raw transmit packets.
  * You may want to use this function for data checksums or to verify received
@@ -315,7 +331,7 @@ extern unsigned usbCrc16(unsigned data, uchar len);
  * tiny memory model.
  */
 extern unsigned usbCrc16Append(unsigned data, uchar len);
-#define usbCrc16Append(data, len)    usbCrc16Append((unsigned)(data), len)
+#define usbCrc16Append(data, len)    usbCrc16Append(USB_PTR_UINT(data), len)
 /* This function is equivalent to usbCrc16() above, except that it appends
  * the 2 bytes CRC (lowbyte first) in the 'data' buffer after reading 'len'
  * bytes.
@@ -349,6 +365,18 @@ extern uchar    usbCurrentDataToken;
  * to ignore duplicate packets.
  */
 #endif
+#if USB_CFG_CHECK_CRC_IN_POLL
+extern unsigned usbCrcErrors;
+/* Number of received packets that usbPoll() dropped because of a bad CRC.
+ * Only available if USB_CFG_CHECK_CRC_IN_POLL is defined to a value != 0.
+ */
+#endif
+#if USB_CFG_DROP_DUPLICATES
+extern unsigned usbDuplicates;
+/* Number of received packets that usbPoll() dropped as retransmissions.
+ * Only available if USB_CFG_DROP_DUPLICATES is defined to a value != 0.
+ */
+#endif
 
 #define USB_STRING_DESCRIPTOR_HEADER(stringLength) ((2*(stringLength)+2) | (3<<8))
 /* This macro builds a descriptor header for a string descriptor given the
@@ -562,6 +590,24 @@ const int usbDescriptorStringSerialNumber[];
 #define USB_CFG_HAVE_INTRIN_ENDPOINT3   0
 #endif
 
+#ifndef USB_CFG_CHECK_CRC_IN_POLL
+#define USB_CFG_CHECK_CRC_IN_POLL   0
+#endif
+#if USB_CFG_CHECK_CRC   /* the assembler module checks already */
+#undef USB_CFG_CHECK_CRC_IN_POLL
+#define USB_CFG_CHECK_CRC_IN_POLL   0
+#endif
+
+#ifndef USB_CFG_RESET_IN_POLL
+#define USB_CFG_RESET_IN_POLL       1
+#endif
+#ifndef USB_CFG_DROP_DUPLICATES
+#define USB_CFG_DROP_DUPLICATES     0
+#endif
+#if USB_CFG_DROP_DUPLICATES && !USB_CFG_CHECK_DATA_TOGGLING
+#error "USB_CFG_DROP_DUPLICATES needs USB_CFG_CHECK_DATA_TOGGLING"
+#endif
+
 #define USB_BUFSIZE     11  /* PID, 8 bytes data, 2 bytes CRC */
 
 /* ----- Try to find registers and bits responsible for ext interrupt 0 ----- */
@@ -657,7 +703,11 @@ extern usbTxStatus_t   usbTxStatus1, usbTxStatus3;
 
 
 typedef union usbWord{
+#ifdef __AVR__
     unsigned    word;
+#else   /* host builds (host/model), unsigned has 32 bits there */
+    unsigned short  word;
+#endif
     uchar       bytes[2];
 }usbWord_t;
 
@@ -122,7 +122,9 @@ static inline void  sei(void)
 #ifdef __ASSEMBLER__
 #   define _VECTOR(N)   __vector_ ## N   /* io.h does not define this for asm */
 #else
+#   include <stdint.h>
 #   include <avr/pgmspace.h>
+#   define USB_PTR_UINT(p)  ((unsigned)(uintptr_t)(p))  /* no warning where pointers are wider (host builds) */
 #endif
 
 #if USB_CFG_DRIVER_FLASH_PAGE